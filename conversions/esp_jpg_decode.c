@@ -12,13 +12,18 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "esp_jpg_decode.h"
+#include <stdlib.h>
+#include <string.h>
 
 #include "esp_system.h"
 #if ESP_IDF_VERSION_MAJOR >= 4 // IDF 4+
 #if CONFIG_IDF_TARGET_ESP32 // ESP32/PICO-D4
 #include "esp32/rom/tjpgd.h"
-#elif CONFIG_IDF_TARGET_ESP32S2
+#elif CONFIG_IDF_TARGET_ESP32S2 || CONFIG_IDF_TARGET_LINUX
 #include "tjpgd.h"
+// the ROM decoders have no jd_decomp_rect() or jd_prepare_mem(), they decode every MCU and the writer crops,
+// and a JPEG in memory is copied out through _jpg_read()
+#define JPG_DECODE_LOCAL_TJPGD 1
 #elif CONFIG_IDF_TARGET_ESP32S3
 #include "esp32s3/rom/tjpgd.h"
 #else
@@ -27,6 +32,7 @@
 #else // ESP32 Before IDF 4.0
 #include "rom/tjpgd.h"
 #endif
+#include "tjpgd_pool.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -36,6 +42,17 @@
 static const char* TAG = "esp_jpg_decode";
 #endif
 
+// the pool takes the same blocks in the jd_prepare() of every target, the input buffer is the JD_SZBUF of its header
+#if JPG_DECODE_LOCAL_TJPGD
+// the local tjpgd also keeps a look up table per Huffman table
+#define JPG_HUFFLUT_SIZE JPG_TJPGD_HUFFLUT_SIZE
+#else
+// the ROM decoders are tjpgd R0.01, without look up tables
+#define JPG_HUFFLUT_SIZE 0
+#endif
+
+#define JPG_WORK_SIZE JPG_POOL_SIZE(JPG_HUFFLUT_SIZE)
+
 typedef struct {
         jpg_scale_t scale;
         jpg_reader_cb reader;
@@ -43,8 +60,44 @@ typedef struct {
         void * arg;
         size_t len;
         size_t index;
+        const JRECT * roi;
+        const uint8_t * src;//the JPEG in memory, instead of the reader
+        jpg_format_t format;
 } esp_jpg_decoder_t;
 
+#if JPG_DECODE_LOCAL_TJPGD
+// tjpgd writes the jpg_format_t, with these bytes per pixel
+static const uint8_t jpg_format_bpp[] = { 3, 3, 2, 2, 1 };
+#else
+// the ROM decoders write R, G, B, the other formats are packed in place over it
+static void _jpg_convert(uint8_t *data, size_t pixels, jpg_format_t format)
+{
+    uint8_t *o = data;
+    for (size_t i = 0; i < pixels; i++, data += 3) {
+        uint8_t r = data[0], g = data[1], b = data[2];
+        uint16_t c = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+        switch (format) {
+        case JPG_FORMAT_BGR888:
+            *o++ = b;
+            *o++ = g;
+            *o++ = r;
+            break;
+        case JPG_FORMAT_RGB565_LE:
+            *o++ = c & 0xff;
+            *o++ = c >> 8;
+            break;
+        case JPG_FORMAT_RGB565_BE:
+            *o++ = c >> 8;
+            *o++ = c & 0xff;
+            break;
+        default:
+            *o++ = (r * 77 + g * 150 + b * 29 + 128) >> 8;
+            break;
+        }
+    }
+}
+#endif
+
 static const char * jd_errors[] = {
     "Succeeded",
     "Interrupted by output function",
@@ -66,6 +119,40 @@ static uint32_t _jpg_write(JDEC *decoder, void *bitmap, JRECT *rect)
     uint8_t *data = (uint8_t *)bitmap;
 
     esp_jpg_decoder_t * jpeg = (esp_jpg_decoder_t *)decoder->device;
+#if JPG_DECODE_LOCAL_TJPGD
+    size_t bpp = jpg_format_bpp[jpeg->format];
+#else
+    size_t bpp = 3;
+#endif
+
+    if (jpeg->roi) {
+        // MCUs on the edge of the region are cropped to it, the rows are moved up in place
+        const JRECT *roi = jpeg->roi;
+        uint16_t left = (rect->left > roi->left) ? rect->left : roi->left;
+        uint16_t right = (rect->right < roi->right) ? rect->right : roi->right;
+        uint16_t top = (rect->top > roi->top) ? rect->top : roi->top;
+        uint16_t bottom = (rect->bottom < roi->bottom) ? rect->bottom : roi->bottom;
+        if (left > right || top > bottom) {
+            return 1;
+        }
+        uint16_t cw = right + 1 - left;
+        uint8_t *src = data + ((top - y) * w + (left - x)) * bpp;
+        h = bottom + 1 - top;
+        if (src != data || cw != w) {
+            for (uint16_t iy = 0; iy < h; iy++) {
+                memmove(data + iy * cw * bpp, src + iy * w * bpp, cw * bpp);
+            }
+        }
+        x = left - roi->left;
+        y = top - roi->top;
+        w = cw;
+    }
+
+#if !JPG_DECODE_LOCAL_TJPGD
+    if (jpeg->format != JPG_FORMAT_RGB888) {
+        _jpg_convert(data, (size_t)w * h, jpeg->format);
+    }
+#endif
 
     if (jpeg->writer) {
         return jpeg->writer(jpeg->arg, x, y, w, h, data);
@@ -79,7 +166,12 @@ static uint32_t _jpg_read(JDEC *decoder, uint8_t *buf, uint32_t len)
     if (jpeg->len && len > (jpeg->len - jpeg->index)) {
         len = jpeg->len - jpeg->index;
     }
-    if (len) {
+    if (len && jpeg->src) {
+        if (buf) {
+            memcpy(buf, jpeg->src + jpeg->index, len);
+        }
+        jpeg->index += len;
+    } else if (len) {
         len = jpeg->reader(jpeg->arg, jpeg->index, buf, len);
         if (!len) {
             ESP_LOGE(TAG, "Read Fail at %u/%u", jpeg->index, jpeg->len);
@@ -89,32 +181,78 @@ static uint32_t _jpg_read(JDEC *decoder, uint8_t *buf, uint32_t len)
     return len;
 }
 
-esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg)
+// jpeg has the source, the writer, the scale and the region, roi NULL is all of the image.
+// width and height 0 decode at that scale, otherwise at the largest one that keeps the image at least that size.
+// A NULL work pool is allocated for the call.
+static esp_err_t jpg_decode(esp_jpg_decoder_t * jpeg, uint16_t width, uint16_t height, void * work, size_t work_size)
 {
-    static uint8_t work[3100];
-    JDEC decoder;
-    esp_jpg_decoder_t jpeg;
+    if (!work) {
+        work = malloc(JPG_WORK_SIZE);
+        if (!work) {
+            ESP_LOGE(TAG, "JPG work pool malloc failed");
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t err = jpg_decode(jpeg, width, height, work, JPG_WORK_SIZE);
+        free(work);
+        return err;
+    }
 
-    jpeg.len = len;
-    jpeg.reader = reader;
-    jpeg.writer = writer;
-    jpeg.arg = arg;
-    jpeg.scale = scale;
-    jpeg.index = 0;
+    JDEC decoder;
+    const JRECT * roi = jpeg->roi;
+    jpg_writer_cb writer = jpeg->writer;
+    void * arg = jpeg->arg;
+    size_t len = jpeg->len;
+    JRESULT jres;
 
-    JRESULT jres = jd_prepare(&decoder, _jpg_read, work, 3100, &jpeg);
+#if JPG_DECODE_LOCAL_TJPGD
+    if (jpeg->src) {
+        jres = jd_prepare_mem(&decoder, jpeg->src, len, work, work_size, jpeg);
+    } else
+#endif
+    {
+        jres = jd_prepare(&decoder, _jpg_read, work, work_size, jpeg);
+    }
     if(jres != JDR_OK){
         ESP_LOGE(TAG, "JPG Header Parse Failed! %s", jd_errors[jres]);
         return ESP_FAIL;
     }
+#if JPG_DECODE_LOCAL_TJPGD
+    decoder.format = jd_formats[jpeg->format];
+#endif
 
-    uint16_t output_width = decoder.width / (1 << (uint8_t)(jpeg.scale));
-    uint16_t output_height = decoder.height / (1 << (uint8_t)(jpeg.scale));
+    if (width && height) {
+        if (decoder.width < width || decoder.height < height) {
+            ESP_LOGE(TAG, "JPG is %ux%u, smaller than %ux%u", decoder.width, decoder.height, width, height);
+            return ESP_FAIL;
+        }
+        jpeg->scale = JPG_SCALE_NONE;
+        while (jpeg->scale < JPG_SCALE_MAX && (decoder.width >> (jpeg->scale + 1)) >= width && (decoder.height >> (jpeg->scale + 1)) >= height) {
+            jpeg->scale++;
+        }
+    }
+
+    uint16_t output_width = decoder.width / (1 << (uint8_t)(jpeg->scale));
+    uint16_t output_height = decoder.height / (1 << (uint8_t)(jpeg->scale));
+    if (roi) {
+        if (roi->right >= output_width || roi->bottom >= output_height) {
+            ESP_LOGE(TAG, "JPG region %u,%u-%u,%u is outside of %ux%u", roi->left, roi->top, roi->right, roi->bottom, output_width, output_height);
+            return ESP_FAIL;
+        }
+        output_width = roi->right + 1 - roi->left;
+        output_height = roi->bottom + 1 - roi->top;
+    }
 
     //output start
-    writer(arg, 0, 0, output_width, output_height, NULL);
+    if (!writer(arg, 0, 0, output_width, output_height, NULL)) {
+        ESP_LOGE(TAG, "JPG output start failed");
+        return ESP_FAIL;
+    }
     //output write
-    jres = jd_decomp(&decoder, _jpg_write, (uint8_t)jpeg.scale);
+#if JPG_DECODE_LOCAL_TJPGD
+    jres = jd_decomp_rect(&decoder, _jpg_write, (uint8_t)jpeg->scale, roi);
+#else
+    jres = jd_decomp(&decoder, _jpg_write, (uint8_t)jpeg->scale);
+#endif
     //output end
     writer(arg, output_width, output_height, output_width, output_height, NULL);
 
@@ -123,10 +261,134 @@ esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jp
         return ESP_FAIL;
     }
     //check if all data has been consumed.
-    if (len && jpeg.index < len) {
-        _jpg_read(&decoder, NULL, len - jpeg.index);
+    if (len && !jpeg->src && jpeg->index < len) {
+        _jpg_read(&decoder, NULL, len - jpeg->index);
     }
 
     return ESP_OK;
 }
 
+esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg)
+{
+    esp_jpg_decoder_t jpeg = { .scale = scale, .reader = reader, .writer = writer, .arg = arg, .len = len };
+    return jpg_decode(&jpeg, 0, 0, NULL, 0);
+}
+
+esp_err_t esp_jpg_decode_mem(const uint8_t * jpg, size_t len, jpg_scale_t scale, jpg_writer_cb writer, void * arg)
+{
+    if (!jpg || !len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_jpg_decoder_t jpeg = { .scale = scale, .writer = writer, .arg = arg, .len = len, .src = jpg };
+    return jpg_decode(&jpeg, 0, 0, NULL, 0);
+}
+
+esp_err_t esp_jpg_decode_mem_format(const uint8_t * jpg, size_t len, jpg_scale_t scale, jpg_format_t format, jpg_writer_cb writer, void * arg)
+{
+    if (!jpg || !len || format > JPG_FORMAT_GRAY) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_jpg_decoder_t jpeg = { .scale = scale, .writer = writer, .arg = arg, .len = len, .src = jpg, .format = format };
+    return jpg_decode(&jpeg, 0, 0, NULL, 0);
+}
+
+esp_err_t esp_jpg_decode_to_size(size_t len, uint16_t width, uint16_t height, jpg_reader_cb reader, jpg_writer_cb writer, void * arg)
+{
+    if (!width || !height) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_jpg_decoder_t jpeg = { .scale = JPG_SCALE_NONE, .reader = reader, .writer = writer, .arg = arg, .len = len };
+    return jpg_decode(&jpeg, width, height, NULL, 0);
+}
+
+esp_err_t esp_jpg_decode_roi(size_t len, jpg_scale_t scale, uint16_t x, uint16_t y, uint16_t w, uint16_t h, jpg_reader_cb reader, jpg_writer_cb writer, void * arg)
+{
+    if (!w || !h || x + w - 1 > 0xFFFF || y + h - 1 > 0xFFFF) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    JRECT roi = {
+        .left = x,
+        .right = x + w - 1,
+        .top = y,
+        .bottom = y + h - 1,
+    };
+    esp_jpg_decoder_t jpeg = { .scale = scale, .reader = reader, .writer = writer, .arg = arg, .len = len, .roi = &roi };
+    return jpg_decode(&jpeg, 0, 0, NULL, 0);
+}
+
+esp_err_t esp_jpg_decode_with_pool(size_t len, jpg_scale_t scale, void * pool, size_t pool_size, jpg_reader_cb reader, jpg_writer_cb writer, void * arg)
+{
+    if (!pool || !pool_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_jpg_decoder_t jpeg = { .scale = scale, .reader = reader, .writer = writer, .arg = arg, .len = len };
+    return jpg_decode(&jpeg, 0, 0, pool, pool_size);
+}
+
+// walks the segments up to the start of scan and adds up what jd_prepare() of the target allocates for them
+esp_err_t esp_jpg_decode_pool_size(size_t len, jpg_reader_cb reader, void * arg, size_t * pool_size)
+{
+    uint8_t seg[17];
+    size_t index = 2;
+    size_t size = JD_SZBUF;//stream input buffer
+    size_t blocks = 0;//Y blocks in the MCU
+
+    if (reader(arg, 0, seg, 2) != 2 || seg[0] != 0xFF || seg[1] != 0xD8) {
+        ESP_LOGE(TAG, "JPG has no SOI");
+        return ESP_FAIL;
+    }
+    for (;;) {
+        if ((len && index + 4 > len) || reader(arg, index, seg, 4) != 4) {
+            break;
+        }
+        size_t seg_len = (seg[2] << 8) | seg[3];
+        if (seg[0] != 0xFF || seg_len <= 2) {
+            break;
+        }
+        uint8_t marker = seg[1];
+        index += 4;
+        seg_len -= 2;
+        if (len && index + seg_len > len) {
+            break;
+        }
+        if (marker == 0xC0) {
+            //Y sampling factor
+            if (seg_len < 8 || reader(arg, index, seg, 8) != 8) {
+                break;
+            }
+            blocks = (seg[7] >> 4) * (seg[7] & 15);
+        } else if (marker == 0xDB) {
+            //a table of 64 LONGs for every 65 bytes
+            size += (seg_len / 65) * JPG_POOL_ALIGN(64 * sizeof(LONG));
+        } else if (marker == 0xC4) {
+            //every table: the 16 code counts, a WORD code and a BYTE value per code
+            size_t t = 0;
+            while (t + 17 <= seg_len) {
+                if (reader(arg, index + t, seg, 17) != 17) {
+                    break;
+                }
+                size_t codes = 0;
+                for (int i = 1; i < 17; i++) {
+                    codes += seg[i];
+                }
+                size += 16 + JPG_POOL_ALIGN(codes * sizeof(WORD)) + JPG_POOL_ALIGN(codes) + JPG_HUFFLUT_SIZE;
+                t += 17 + codes;
+            }
+            if (t != seg_len) {
+                break;
+            }
+        } else if (marker == 0xDA) {
+            if (!blocks) {
+                break;
+            }
+            //the IDCT and RGB buffer, and the MCU
+            size_t workbuf = blocks * 64 * 2 + 64;
+            size += JPG_POOL_ALIGN(workbuf < 256 ? 256 : workbuf) + (blocks + 2) * 64;
+            *pool_size = size;
+            return ESP_OK;
+        }
+        index += seg_len;
+    }
+    ESP_LOGE(TAG, "JPG header ends before the start of scan");
+    return ESP_FAIL;
+}
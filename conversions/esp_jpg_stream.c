@@ -0,0 +1,141 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "esp_jpg_decode.h"
+#include <stdlib.h>
+#include <string.h>
+
+// the local tjpgd on every target, the ROM decoders of ESP32 and ESP32-S3 can not wait between MCUs
+#include "tjpgd.h"
+#include "tjpgd_pool.h"
+
+#if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
+#include "esp32-hal-log.h"
+#define TAG ""
+#else
+#include "esp_log.h"
+static const char* TAG = "esp_jpg_stream";
+#endif
+
+// with the Huffman look up tables of the local tjpgd
+#define JPG_STREAM_POOL_SIZE JPG_POOL_SIZE(JPG_TJPGD_HUFFLUT_SIZE)
+
+typedef enum {
+    JPG_STREAM_HEADER,//waiting for the segments up to the start of scan
+    JPG_STREAM_SCAN,
+    JPG_STREAM_DONE,
+    JPG_STREAM_FAILED,
+} jpg_stream_state_t;
+
+struct esp_jpg_stream_s {
+    JDEC decoder;
+    jpg_stream_state_t state;
+    jpg_scale_t scale;
+    jpg_format_t format;
+    jpg_writer_cb writer;
+    void * arg;
+    const uint8_t * jpg;
+    size_t len;//bytes of jpg the decoder has
+    uint16_t width;
+    uint16_t height;
+    uint32_t pool[(JPG_STREAM_POOL_SIZE + 3) / 4];
+};
+
+// tjpgd writes the blocks in the format of the stream
+static uint32_t _jpg_stream_write(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    esp_jpg_stream_t stream = (esp_jpg_stream_t)decoder->device;
+    return stream->writer(stream->arg, rect->left, rect->top, rect->right + 1 - rect->left, rect->bottom + 1 - rect->top, (uint8_t *)bitmap);
+}
+
+static esp_err_t jpg_stream_fail(esp_jpg_stream_t stream, const char * what, JRESULT jres)
+{
+    ESP_LOGE(TAG, "JPG %s Failed! JRESULT %d", what, jres);
+    stream->state = JPG_STREAM_FAILED;
+    return ESP_FAIL;
+}
+
+esp_jpg_stream_t esp_jpg_stream_create(jpg_scale_t scale, jpg_format_t format, jpg_writer_cb writer, void * arg)
+{
+    if (scale > JPG_SCALE_MAX || format > JPG_FORMAT_GRAY || !writer) {
+        return NULL;
+    }
+    esp_jpg_stream_t stream = (esp_jpg_stream_t)calloc(1, sizeof(struct esp_jpg_stream_s));
+    if (!stream) {
+        ESP_LOGE(TAG, "JPG stream malloc failed");
+        return NULL;
+    }
+    stream->scale = scale;
+    stream->format = format;
+    stream->writer = writer;
+    stream->arg = arg;
+    stream->state = JPG_STREAM_HEADER;
+    return stream;
+}
+
+esp_err_t esp_jpg_stream_write(esp_jpg_stream_t stream, const uint8_t * jpg, size_t len, bool * done)
+{
+    if (!stream || !jpg || !done || (stream->jpg && (jpg != stream->jpg || len < stream->len))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    JRESULT jres;
+    *done = false;
+    stream->jpg = jpg;
+
+    switch (stream->state) {
+    case JPG_STREAM_HEADER:
+        //parsed again with every write until the start of scan is in, it is only a few hundred bytes
+        jres = jd_prepare_mem(&stream->decoder, jpg, len, stream->pool, sizeof(stream->pool), stream);
+        if (jres == JDR_INP) {
+            stream->len = len;
+            return ESP_OK;
+        }
+        if (jres != JDR_OK) {
+            return jpg_stream_fail(stream, "Header Parse", jres);
+        }
+        stream->decoder.format = jd_formats[stream->format];
+        stream->len = len;
+        stream->width = stream->decoder.width / (1 << (uint8_t)(stream->scale));
+        stream->height = stream->decoder.height / (1 << (uint8_t)(stream->scale));
+        if (!stream->writer(stream->arg, 0, 0, stream->width, stream->height, NULL)) {
+            ESP_LOGE(TAG, "JPG output start failed");
+            stream->state = JPG_STREAM_FAILED;
+            return ESP_FAIL;
+        }
+        stream->state = JPG_STREAM_SCAN;
+        //fall through
+    case JPG_STREAM_SCAN:
+        jres = jd_decomp_stream(&stream->decoder, _jpg_stream_write, (uint8_t)stream->scale, len - stream->len);
+        stream->len = len;
+        if (jres == JDR_INP) {
+            return ESP_OK;
+        }
+        stream->writer(stream->arg, stream->width, stream->height, stream->width, stream->height, NULL);
+        if (jres != JDR_OK) {
+            return jpg_stream_fail(stream, "Decompression", jres);
+        }
+        stream->state = JPG_STREAM_DONE;
+        *done = true;
+        return ESP_OK;
+    case JPG_STREAM_DONE:
+        *done = true;
+        return ESP_OK;
+    default:
+        return ESP_FAIL;
+    }
+}
+
+void esp_jpg_stream_delete(esp_jpg_stream_t stream)
+{
+    free(stream);
+}
@@ -31,11 +31,106 @@ typedef enum {
     JPG_SCALE_MAX = JPG_SCALE_8X
 } jpg_scale_t;
 
+typedef enum {
+    JPG_FORMAT_RGB888,      // R, G, B, what the writer gets from the other esp_jpg_decode calls
+    JPG_FORMAT_BGR888,      // B, G, R, as fmt2rgb888() writes it
+    JPG_FORMAT_RGB565_LE,   // low byte first, as jpg2rgb565() writes it
+    JPG_FORMAT_RGB565_BE,   // high byte first, as the sensors send it
+    JPG_FORMAT_GRAY,        // Y only, one byte per pixel
+} jpg_format_t;
+
 typedef size_t (* jpg_reader_cb)(void * arg, size_t index, uint8_t *buf, size_t len);
 typedef bool (* jpg_writer_cb)(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data);
 
+/**
+ * @brief Decode a JPEG, the reader is read forward only and the writer gets the start call (data NULL at 0, 0),
+ *        the blocks and the end call (data NULL at width, height)
+ *
+ * Every call allocates its own work pool, so tasks can decode at the same time.
+ */
 esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg);
 
+/**
+ * @brief esp_jpg_decode() of a JPEG in memory, like a camera_fb_t buffer. It is read in place and not written,
+ *        without a reader call and copy for every JD_SZBUF bytes. The ROM decoders of ESP32 and ESP32-S3 still copy.
+ */
+esp_err_t esp_jpg_decode_mem(const uint8_t * jpg, size_t len, jpg_scale_t scale, jpg_writer_cb writer, void * arg);
+
+/**
+ * @brief esp_jpg_decode_mem() to the pixel format the writer needs, its blocks are w x h pixels of that format
+ *
+ * The local tjpgd of ESP32-S2 writes the format directly and decodes only the luminance for JPG_FORMAT_GRAY.
+ * With the ROM decoders of ESP32 and ESP32-S3 the RGB888 blocks are converted in place before the writer.
+ */
+esp_err_t esp_jpg_decode_mem_format(const uint8_t * jpg, size_t len, jpg_scale_t scale, jpg_format_t format, jpg_writer_cb writer, void * arg);
+
+/**
+ * @brief esp_jpg_decode() with a work pool of the caller, it is in use until the call returns
+ *
+ * @return ESP_FAIL also when the pool is too small for the JPEG, see esp_jpg_decode_pool_size()
+ */
+esp_err_t esp_jpg_decode_with_pool(size_t len, jpg_scale_t scale, void * pool, size_t pool_size, jpg_reader_cb reader, jpg_writer_cb writer, void * arg);
+
+/**
+ * @brief The exact size of the pool esp_jpg_decode_with_pool() needs for a JPEG, read from its header
+ *
+ * The size is for the decoder of the target: the ROM decoder on ESP32 and ESP32-S3, the tjpgd of the
+ * component with its Huffman look up tables on the others. Pool sizes do not carry over between them.
+ * The reader is called with the index of every segment it needs, up to the start of scan.
+ */
+esp_err_t esp_jpg_decode_pool_size(size_t len, jpg_reader_cb reader, void * arg, size_t * pool_size);
+
+/**
+ * @brief Decode at the largest jpg_scale_t that keeps the image at least width x height,
+ *        the writer gets the scaled size with the start call (data NULL at 0, 0) and resamples from there
+ *
+ * @return ESP_FAIL also when the JPEG is smaller than width x height
+ */
+esp_err_t esp_jpg_decode_to_size(size_t len, uint16_t width, uint16_t height, jpg_reader_cb reader, jpg_writer_cb writer, void * arg);
+
+/**
+ * @brief Decode only the w x h region at x, y of the image scaled by scale,
+ *        the writer gets the region as if it was the whole image: its size with the start call and blocks relative to it
+ *
+ * The MCUs outside of the region are not transformed and the decoder stops after the last one inside it.
+ * If the JPEG has restart markers the intervals without any of the region are skipped to the next marker.
+ * ESP32 and ESP32-S3 decode with the tjpgd in ROM, they decode every MCU and only crop.
+ *
+ * @return ESP_FAIL also when the region is not inside of the scaled image
+ */
+esp_err_t esp_jpg_decode_roi(size_t len, jpg_scale_t scale, uint16_t x, uint16_t y, uint16_t w, uint16_t h, jpg_reader_cb reader, jpg_writer_cb writer, void * arg);
+
+typedef struct esp_jpg_stream_s * esp_jpg_stream_t;
+
+/**
+ * @brief Start to decode a JPEG that is still being written into memory, like a JPEG frame buffer while cam_task appends the DMA chunks
+ *
+ * The writer gets the start call once the header is in, every MCU as soon as its data is in,
+ * and the end call after the last one, like with esp_jpg_decode_mem_format().
+ * The ROM decoders can not wait between MCUs, so this decodes with the tjpgd of the component on every target,
+ * its work pool is part of the stream.
+ *
+ * @return NULL for an invalid argument or when the decoder and its work pool could not be allocated
+ */
+esp_jpg_stream_t esp_jpg_stream_create(jpg_scale_t scale, jpg_format_t format, jpg_writer_cb writer, void * arg);
+
+/**
+ * @brief The first len bytes of jpg are written, decode what they hold
+ *
+ * jpg is the same buffer with every call and len does not shrink. The bytes given before are read in place
+ * and must not change. An MCU whose data ends is decoded again from its start by the next call.
+ *
+ * @param done  Set when the whole image has been passed to the writer, the bytes after it are not read
+ *
+ * @return ESP_OK also while more of the JPEG is needed, ESP_FAIL for a JPEG that can not be decoded or a failed start call
+ */
+esp_err_t esp_jpg_stream_write(esp_jpg_stream_t stream, const uint8_t * jpg, size_t len, bool * done);
+
+/**
+ * @brief Free a stream decoder, done or not. The writer gets no end call from here
+ */
+void esp_jpg_stream_delete(esp_jpg_stream_t stream);
+
 #ifdef __cplusplus
 }
 #endif
@@ -83,6 +83,106 @@ bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
  */
 bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len);
 
+/**
+ * @brief Convert image buffer to JPEG in a buffer owned by the caller
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Buffer to write the JPEG to
+ * @param out_size  Size in bytes of the output buffer
+ * @param out_len   Pointer to be populated with the length of the JPEG.
+ *                  If it is larger than out_size, the image did not fit and the buffer holds only its start.
+ *
+ * @return true on success, false on error or if the buffer was too small
+ */
+bool fmt2jpg_buf(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t * out, size_t out_size, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to JPEG in a buffer owned by the caller
+ *
+ * @param fb        Source camera frame buffer
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Buffer to write the JPEG to
+ * @param out_size  Size in bytes of the output buffer
+ * @param out_len   Pointer to be populated with the length of the JPEG, or the size needed if it did not fit
+ *
+ * @return true on success, false on error or if the buffer was too small
+ */
+bool frame2jpg_buf(camera_fb_t * fb, uint8_t quality, uint8_t * out, size_t out_size, size_t * out_len);
+
+typedef struct jpg_encoder_ctx_s * jpg_encoder_ctx_t;
+
+/**
+ * @brief Create a JPEG encoder for frames of one size, format and quality
+ *
+ * The buffers and tables are allocated here once, encoding with the context allocates nothing.
+ * A context may only be used by one task at a time, separate contexts can encode in parallel.
+ *
+ * @param width     Width in pixels of the frames
+ * @param height    Height in pixels of the frames
+ * @param format    RGB565, RGB888, YUYV or GRAYSCALE
+ * @param quality   JPEG quality of the resulting images
+ *
+ * @return the encoder, NULL if out of memory or the format is not supported
+ */
+jpg_encoder_ctx_t jpg_encoder_create(uint16_t width, uint16_t height, pixformat_t format, uint8_t quality);
+
+/**
+ * @brief Create a JPEG encoder that splits frames into strips encoded in parallel
+ *
+ * The frames are cut into strips of whole MCU rows. The calling task encodes the first one,
+ * a task per strip the others, on whichever core is free. Restart markers join the strips into
+ * one baseline JPEG. Every strip task keeps a buffer for its output, which grows as needed.
+ *
+ * @param width     Width in pixels of the frames
+ * @param height    Height in pixels of the frames
+ * @param format    RGB565, RGB888, YUYV or GRAYSCALE
+ * @param quality   JPEG quality of the resulting images
+ * @param strips    Number of strips, 2 for both cores of the ESP32 and ESP32-S3.
+ *                  Small frames may get fewer, 1 is the same as jpg_encoder_create().
+ *
+ * @return the encoder, NULL if out of memory or the format is not supported
+ */
+jpg_encoder_ctx_t jpg_encoder_create_parallel(uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t strips);
+
+/**
+ * @brief Encode a frame with an encoder context
+ *
+ * @param ctx       Encoder created with jpg_encoder_create()
+ * @param src       Source frame in the format of the encoder
+ * @param src_len   Length in bytes of the source frame
+ * @param cb        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool jpg_encoder_encode_cb(jpg_encoder_ctx_t ctx, const uint8_t *src, size_t src_len, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Encode a frame with an encoder context into a buffer owned by the caller
+ *
+ * @param ctx       Encoder created with jpg_encoder_create()
+ * @param src       Source frame in the format of the encoder
+ * @param src_len   Length in bytes of the source frame
+ * @param out       Buffer to write the JPEG to
+ * @param out_size  Size in bytes of the output buffer
+ * @param out_len   Pointer to be populated with the length of the JPEG, or the size needed if it did not fit
+ *
+ * @return true on success, false on error or if the buffer was too small
+ */
+bool jpg_encoder_encode_buf(jpg_encoder_ctx_t ctx, const uint8_t *src, size_t src_len, uint8_t * out, size_t out_size, size_t * out_len);
+
+/**
+ * @brief Free an encoder context
+ *
+ * @param ctx       Encoder created with jpg_encoder_create(), may be NULL
+ */
+void jpg_encoder_delete(jpg_encoder_ctx_t ctx);
+
 /**
  * @brief Convert image buffer to BMP buffer
  *
@@ -123,6 +223,23 @@ bool fmt2rgb888(const uint8_t *src_buf, size_t src_len, pixformat_t format, uint
 
 bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale);
 
+/**
+ * @brief Decode a JPEG straight to a smaller size, like the input of a neural network
+ *
+ * The decoder scales down by the largest power of two that keeps the image at least
+ * width x height, an area-weighted box filter takes it the rest of the way.
+ *
+ * @param src       Source JPEG buffer
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the output, at most the width of the JPEG
+ * @param height    Height in pixels of the output, at most the height of the JPEG
+ * @param format    PIXFORMAT_RGB565 (as jpg2rgb565 writes it), PIXFORMAT_RGB888 (as fmt2rgb888 writes it) or PIXFORMAT_GRAYSCALE
+ * @param out       Pointer to the output buffer (width * height * bytes per pixel)
+ *
+ * @return true on success
+ */
+bool jpg2fmt_scaled(const uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t * out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,13 @@
 #define JPGE_MAX(a,b) (((a)>(b))?(a):(b))
 #define JPGE_MIN(a,b) (((a)<(b))?(a):(b))
 
+// GCC 8 and later unroll the zigzag reordering, the indexes become constants
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 8)
+#define JPGE_UNROLL_ZIGZAG _Pragma("GCC unroll 64")
+#else
+#define JPGE_UNROLL_ZIGZAG
+#endif
+
 namespace jpge {
 
     static inline void *jpge_malloc(size_t nSize) {
@@ -34,12 +41,23 @@ namespace jpge {
     static inline void jpge_free(void *p) { free(p); }
 
     // Various JPEG enums and tables.
-    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_RST0 = 0xD0, M_APP0 = 0xE0 };
     enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
     static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
     static const int16 s_std_lum_quant[64] = { 16,11,12,14,12,10,16,14,13,14,18,17,16,19,24,40,26,24,22,22,24,49,35,37,29,40,58,51,61,60,57,51,56,55,64,72,92,78,64,68,87,69,55,56,80,109,81,87,95,98,103,104,103,62,77,113,121,112,100,120,92,101,103,99 };
     static const int16 s_std_croma_quant[64] = { 17,18,18,24,21,24,47,26,26,47,99,66,56,66,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
+    // AAN scale factors of the 2D DCT outputs in natural order, cos(k*pi/16)*sqrt(2) for k > 0, 14 bit fixed point
+    static const int32 s_aan_scales[64] = {
+        16384,22725,21407,19266,16384,12873, 8867, 4520,
+        22725,31521,29692,26722,22725,17855,12299, 6270,
+        21407,29692,27969,25172,21407,16819,11585, 5906,
+        19266,26722,25172,22654,19266,15137,10426, 5315,
+        16384,22725,21407,19266,16384,12873, 8867, 4520,
+        12873,17855,16819,15137,12873,10114, 6967, 3552,
+         8867,12299,11585,10426, 8867, 6967, 4799, 2446,
+         4520, 6270, 5906, 5315, 4520, 3552, 2446, 1247
+    };
     static const uint8 s_dc_lum_bits[17] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
     static const uint8 s_dc_lum_val[DC_LUM_CODES] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
     static const uint8 s_ac_lum_bits[17] = { 0,0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
@@ -65,14 +83,9 @@ namespace jpge {
 
     const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
 
-    static int32 m_last_quality = 0;
-    static int32 m_quantization_tables[2][64];
-
-    static bool m_huff_initialized = false;
-    static uint m_huff_codes[4][256];
-    static uint8 m_huff_code_sizes[4][256];
-    static uint8 m_huff_bits[4][17];
-    static uint8 m_huff_val[4][256];
+    // DC luma, AC luma, DC chroma, AC chroma
+    static const uint8 *const s_huff_bits[4] = { s_dc_lum_bits, s_ac_lum_bits, s_dc_chroma_bits, s_ac_chroma_bits };
+    static const uint8 *const s_huff_val[4] = { s_dc_lum_val, s_ac_lum_val, s_dc_chroma_val, s_ac_chroma_val };
 
     static inline uint8 clamp(int i) {
         if (i < 0) {
@@ -83,71 +96,146 @@ namespace jpge {
         return static_cast<uint8>(i);
     }
 
-    static void RGB_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
-        for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--) {
-            const int r = pSrc[0], g = pSrc[1], b = pSrc[2];
-            pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
-            pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
-            pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+    // The colour kernels write Y, Cb and Cr to the planes of an MCU line, see load_mcu().
+    // Red is the byte ri of a 3 channel pixel, 0 for RGB or 2 for BGR, and blue the byte 2 - ri.
+    static void RGB_to_YCC(uint8* pY, uint8* pCb, uint8* pCr, const uint8 *pSrc, int num_pixels, int ri) {
+        for ( ; num_pixels; pSrc += 3, num_pixels--) {
+            const int r = pSrc[ri], g = pSrc[1], b = pSrc[2 - ri];
+            *pY++ = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+            *pCb++ = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
+            *pCr++ = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
         }
     }
 
-    static void RGB_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+    // Horizontally subsampled chroma, computed once per pixel pair from the sums of the pair.
+    static void RGB_to_YCC_h2(uint8* pY, uint8* pCb, uint8* pCr, const uint8 *pSrc, int num_pixels, int ri) {
+        for ( ; num_pixels > 1; pY += 2, pSrc += 6, num_pixels -= 2) {
+            const int r0 = pSrc[ri], g0 = pSrc[1], b0 = pSrc[2 - ri], r1 = pSrc[3 + ri], g1 = pSrc[4], b1 = pSrc[5 - ri];
+            const int r = r0 + r1, g = g0 + g1, b = b0 + b1;
+            pY[0] = static_cast<uint8>((r0 * YR + g0 * YG + b0 * YB + 32768) >> 16);
+            pY[1] = static_cast<uint8>((r1 * YR + g1 * YG + b1 * YB + 32768) >> 16);
+            *pCb++ = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 65536) >> 17));
+            *pCr++ = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 65536) >> 17));
+        }
+        if (num_pixels) {
+            RGB_to_YCC(pY, pCb, pCr, pSrc, 1, ri);
+        }
+    }
+
+    static void RGB_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels, int ri) {
         for ( ; num_pixels; pDst++, pSrc += 3, num_pixels--) {
-            pDst[0] = static_cast<uint8>((pSrc[0] * YR + pSrc[1] * YG + pSrc[2] * YB + 32768) >> 16);
+            pDst[0] = static_cast<uint8>((pSrc[ri] * YR + pSrc[1] * YG + pSrc[2 - ri] * YB + 32768) >> 16);
         }
     }
 
-    static void Y_to_YCC(uint8* pDst, const uint8* pSrc, int num_pixels) {
-        for( ; num_pixels; pDst += 3, pSrc++, num_pixels--) {
-            pDst[0] = pSrc[0];
-            pDst[1] = 128;
-            pDst[2] = 128;
+    // RGB565 as the sensors send it, big endian, widened like the bytes of an RGB888 line
+    static inline void RGB565_unpack(const uint8 *pSrc, int &r, int &g, int &b) {
+        r = pSrc[0] & 0xF8;
+        g = ((pSrc[0] & 0x07) << 5) | ((pSrc[1] & 0xE0) >> 3);
+        b = (pSrc[1] & 0x1F) << 3;
+    }
+
+    static void RGB565_to_YCC(uint8* pY, uint8* pCb, uint8* pCr, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pSrc += 2, num_pixels--) {
+            int r, g, b;
+            RGB565_unpack(pSrc, r, g, b);
+            *pY++ = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+            *pCb++ = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
+            *pCr++ = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+        }
+    }
+
+    static void RGB565_to_YCC_h2(uint8* pY, uint8* pCb, uint8* pCr, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels > 1; pY += 2, pSrc += 4, num_pixels -= 2) {
+            int r0, g0, b0, r1, g1, b1;
+            RGB565_unpack(pSrc, r0, g0, b0);
+            RGB565_unpack(pSrc + 2, r1, g1, b1);
+            const int r = r0 + r1, g = g0 + g1, b = b0 + b1;
+            pY[0] = static_cast<uint8>((r0 * YR + g0 * YG + b0 * YB + 32768) >> 16);
+            pY[1] = static_cast<uint8>((r1 * YR + g1 * YG + b1 * YB + 32768) >> 16);
+            *pCb++ = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 65536) >> 17));
+            *pCr++ = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 65536) >> 17));
+        }
+        if (num_pixels) {
+            RGB565_to_YCC(pY, pCb, pCr, pSrc, 1);
         }
     }
 
-    // Forward DCT - DCT derived from jfdctint.
-    enum { CONST_BITS = 13, ROW_BITS = 2 };
-#define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
-#define DCT_MUL(var, c) (static_cast<int16>(var) * static_cast<int32>(c))
-#define DCT1D(s0, s1, s2, s3, s4, s5, s6, s7) \
+    static void RGB565_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            int r, g, b;
+            RGB565_unpack(pSrc, r, g, b);
+            pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+        }
+    }
+
+    // YUYV from the sensor is limited range (BT.601), JFIF expects the full 0-255:
+    // clamp(((y - 16) * 76309 + 32768) >> 16) and clamp(128 + (((c - 128) * 74606 + 32768) >> 16))
+    static const uint8 s_yuv_y[256] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,2,3,5,6,7,8,9,10,12,13,14,15,16,17,19,20,21,22,23,24,26,27,28,29,30,31,33,34,35,36,37,38,40,41,42,43,44,45,47,48,49,50,51,52,54,55,56,57,58,59,61,62,63,64,65,66,68,69,70,71,72,73,75,76,77,78,79,80,82,83,84,85,86,87,88,90,91,92,93,94,95,97,98,99,100,101,102,104,105,106,107,108,109,111,112,113,114,115,116,118,119,120,121,122,123,125,126,127,128,129,130,132,133,134,135,136,137,139,140,141,142,143,144,146,147,148,149,150,151,153,154,155,156,157,158,160,161,162,163,164,165,167,168,169,170,171,172,173,175,176,177,178,179,180,182,183,184,185,186,187,189,190,191,192,193,194,196,197,198,199,200,201,203,204,205,206,207,208,210,211,212,213,214,215,217,218,219,220,221,222,224,225,226,227,228,229,231,232,233,234,235,236,238,239,240,241,242,243,245,246,247,248,249,250,252,253,254,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255 };
+    static const uint8 s_yuv_c[256] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,2,3,4,5,6,7,8,10,11,12,13,14,15,16,18,19,20,21,22,23,24,26,27,28,29,30,31,32,34,35,36,37,38,39,40,41,43,44,45,46,47,48,49,51,52,53,54,55,56,57,59,60,61,62,63,64,65,67,68,69,70,71,72,73,74,76,77,78,79,80,81,82,84,85,86,87,88,89,90,92,93,94,95,96,97,98,100,101,102,103,104,105,106,108,109,110,111,112,113,114,115,117,118,119,120,121,122,123,125,126,127,128,129,130,131,133,134,135,136,137,138,139,141,142,143,144,145,146,147,148,150,151,152,153,154,155,156,158,159,160,161,162,163,164,166,167,168,169,170,171,172,174,175,176,177,178,179,180,182,183,184,185,186,187,188,189,191,192,193,194,195,196,197,199,200,201,202,203,204,205,207,208,209,210,211,212,213,215,216,217,218,219,220,221,222,224,225,226,227,228,229,230,232,233,234,235,236,237,238,240,241,242,243,244,245,246,248,249,250,251,252,253,254,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255 };
+
+    // h2: the chroma is subsampled horizontally like in the source, else it is repeated for both pixels
+    static void YUYV_to_YCC(uint8* pY, uint8* pCb, uint8* pCr, const uint8 *pSrc, int num_pixels, bool h2) {
+        const int step = h2 ? 1 : 2;
+        for ( ; num_pixels > 1; pY += 2, pCb += step, pCr += step, pSrc += 4, num_pixels -= 2) {
+            pY[0] = s_yuv_y[pSrc[0]];
+            pY[1] = s_yuv_y[pSrc[2]];
+            pCb[0] = pCb[step - 1] = s_yuv_c[pSrc[1]];
+            pCr[0] = pCr[step - 1] = s_yuv_c[pSrc[3]];
+        }
+    }
+
+    static void YUYV_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            pDst[0] = s_yuv_y[pSrc[0]];
+        }
+    }
+
+    // Forward DCT - AAN (Arai, Agui, Nakajima) as in jfdctfst, 5 multiplies per 1D pass.
+    // The outputs are left scaled by 8 << DCT_PASS_BITS and the AAN factors, compute_quant_table
+    // folds all of them into the reciprocal quantization tables.
+    enum { DCT_CONST_BITS = 13, DCT_PASS_BITS = 2 };
+#define DCT_MUL(var, c) (((var) * static_cast<int32>(c) + (1 << (DCT_CONST_BITS - 1))) >> DCT_CONST_BITS)
+#define DCT_FIX_0_382683433 3135
+#define DCT_FIX_0_541196100 4433
+#define DCT_FIX_0_707106781 5793
+#define DCT_FIX_1_306562965 10703
+#define DCT1D(s0, s1, s2, s3, s4, s5, s6, s7) { \
     int32 t0 = s0 + s7, t7 = s0 - s7, t1 = s1 + s6, t6 = s1 - s6, t2 = s2 + s5, t5 = s2 - s5, t3 = s3 + s4, t4 = s3 - s4; \
     int32 t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2; \
-    int32 u1 = DCT_MUL(t12 + t13, 4433); \
-    s2 = u1 + DCT_MUL(t13, 6270); \
-    s6 = u1 + DCT_MUL(t12, -15137); \
-    u1 = t4 + t7; \
-    int32 u2 = t5 + t6, u3 = t4 + t6, u4 = t5 + t7; \
-    int32 z5 = DCT_MUL(u3 + u4, 9633); \
-    t4 = DCT_MUL(t4, 2446); t5 = DCT_MUL(t5, 16819); \
-    t6 = DCT_MUL(t6, 25172); t7 = DCT_MUL(t7, 12299); \
-    u1 = DCT_MUL(u1, -7373); u2 = DCT_MUL(u2, -20995); \
-    u3 = DCT_MUL(u3, -16069); u4 = DCT_MUL(u4, -3196); \
-    u3 += z5; u4 += z5; \
-    s0 = t10 + t11; s1 = t7 + u1 + u4; s3 = t6 + u2 + u3; s4 = t10 - t11; s5 = t5 + u2 + u4; s7 = t4 + u1 + u3;
+    s0 = t10 + t11; s4 = t10 - t11; \
+    int32 z1 = DCT_MUL(t12 + t13, DCT_FIX_0_707106781); \
+    s2 = t13 + z1; s6 = t13 - z1; \
+    t10 = t4 + t5; t11 = t5 + t6; t12 = t6 + t7; \
+    int32 z5 = DCT_MUL(t10 - t12, DCT_FIX_0_382683433); \
+    int32 z2 = DCT_MUL(t10, DCT_FIX_0_541196100) + z5; \
+    int32 z4 = DCT_MUL(t12, DCT_FIX_1_306562965) + z5; \
+    int32 z3 = DCT_MUL(t11, DCT_FIX_0_707106781); \
+    int32 z11 = t7 + z3, z13 = t7 - z3; \
+    s5 = z13 + z2; s3 = z13 - z2; s1 = z11 + z4; s7 = z11 - z4; }
 
     static void DCT2D(int32 *p) {
         int32 c, *q = p;
         for (c = 7; c >= 0; c--, q += 8) {
-            int32 s0 = q[0], s1 = q[1], s2 = q[2], s3 = q[3], s4 = q[4], s5 = q[5], s6 = q[6], s7 = q[7];
+            const int32 k = 1 << DCT_PASS_BITS;
+            int32 s0 = q[0] * k, s1 = q[1] * k, s2 = q[2] * k, s3 = q[3] * k, s4 = q[4] * k, s5 = q[5] * k, s6 = q[6] * k, s7 = q[7] * k;
             DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
-            q[0] = s0 << ROW_BITS; q[1] = DCT_DESCALE(s1, CONST_BITS-ROW_BITS); q[2] = DCT_DESCALE(s2, CONST_BITS-ROW_BITS); q[3] = DCT_DESCALE(s3, CONST_BITS-ROW_BITS);
-            q[4] = s4 << ROW_BITS; q[5] = DCT_DESCALE(s5, CONST_BITS-ROW_BITS); q[6] = DCT_DESCALE(s6, CONST_BITS-ROW_BITS); q[7] = DCT_DESCALE(s7, CONST_BITS-ROW_BITS);
+            q[0] = s0; q[1] = s1; q[2] = s2; q[3] = s3; q[4] = s4; q[5] = s5; q[6] = s6; q[7] = s7;
         }
         for (q = p, c = 7; c >= 0; c--, q++) {
             int32 s0 = q[0*8], s1 = q[1*8], s2 = q[2*8], s3 = q[3*8], s4 = q[4*8], s5 = q[5*8], s6 = q[6*8], s7 = q[7*8];
             DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
-            q[0*8] = DCT_DESCALE(s0, ROW_BITS+3); q[1*8] = DCT_DESCALE(s1, CONST_BITS+ROW_BITS+3); q[2*8] = DCT_DESCALE(s2, CONST_BITS+ROW_BITS+3); q[3*8] = DCT_DESCALE(s3, CONST_BITS+ROW_BITS+3);
-            q[4*8] = DCT_DESCALE(s4, ROW_BITS+3); q[5*8] = DCT_DESCALE(s5, CONST_BITS+ROW_BITS+3); q[6*8] = DCT_DESCALE(s6, CONST_BITS+ROW_BITS+3); q[7*8] = DCT_DESCALE(s7, CONST_BITS+ROW_BITS+3);
+            q[0*8] = s0; q[1*8] = s1; q[2*8] = s2; q[3*8] = s3; q[4*8] = s4; q[5*8] = s5; q[6*8] = s6; q[7*8] = s7;
         }
     }
 
     // Compute the actual canonical Huffman codes/code sizes given the JPEG huff bits and val arrays.
-    static void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val)
+    // codes holds code << 8 | code size for every symbol.
+    static void compute_huffman_table(uint32 *codes, const uint8 *bits, const uint8 *val)
     {
         int i, l, last_p, si;
-        static uint8 huff_size[257];
-        static uint huff_code[257];
+        uint8 huff_size[257];
+        uint huff_code[257];
         uint code;
 
         int p = 0;
@@ -171,20 +259,34 @@ namespace jpge {
         }
 
         memset(codes, 0, sizeof(codes[0])*256);
-        memset(code_sizes, 0, sizeof(code_sizes[0])*256);
         for (p = 0; p < last_p; p++) {
-            codes[val[p]]      = huff_code[p];
-            code_sizes[val[p]] = huff_size[p];
+            codes[val[p]] = (huff_code[p] << 8) | huff_size[p];
         }
     }
 
+    // The standard tables do not depend on the quality, they are built once and shared by all encoders.
+    struct huffman_tables {
+        uint32 m_codes[4][256];
+        huffman_tables() {
+            for (int i = 0; i < 4; i++)
+                compute_huffman_table(m_codes[i], s_huff_bits[i], s_huff_val[i]);
+        }
+    };
+
+    static const huffman_tables &get_huffman_tables()
+    {
+        // initialized on first use, thread safe
+        static const huffman_tables tables;
+        return tables;
+    }
+
     void jpeg_encoder::flush_output_buffer()
     {
-        if (m_out_buf_left != JPGE_OUT_BUF_SIZE) {
-            m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(m_out_buf, JPGE_OUT_BUF_SIZE - m_out_buf_left);
+        if (m_out_buf_left != m_params.m_flush_size) {
+            m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(m_out_buf, m_params.m_flush_size - m_out_buf_left);
         }
         m_pOut_buf = m_out_buf;
-        m_out_buf_left = JPGE_OUT_BUF_SIZE;
+        m_out_buf_left = m_params.m_flush_size;
     }
 
     void jpeg_encoder::emit_byte(uint8 i)
@@ -195,19 +297,50 @@ namespace jpge {
         }
     }
 
-    void jpeg_encoder::put_bits(uint bits, uint len)
+    // Writes 32 bits of entropy coded data, stuffing a 0 after every 0xFF byte.
+    void jpeg_encoder::emit_bit_word(uint32 w)
     {
-        uint8 c = 0;
-        m_bit_buffer |= ((uint32)bits << (24 - (m_bits_in += len)));
-        while (m_bits_in >= 8) {
-            c = (uint8)((m_bit_buffer >> 16) & 0xFF);
+        // a byte of w is 0xFF when the same byte of ~w is 0
+        if (!((~w - 0x01010101U) & w & 0x80808080U) && (m_out_buf_left > 4)) {
+            m_pOut_buf[0] = uint8(w >> 24); m_pOut_buf[1] = uint8(w >> 16); m_pOut_buf[2] = uint8(w >> 8); m_pOut_buf[3] = uint8(w);
+            m_pOut_buf += 4;
+            m_out_buf_left -= 4;
+            return;
+        }
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            uint8 c = uint8(w >> shift);
             emit_byte(c);
             if (c == 0xFF) {
                 emit_byte(0);
             }
-            m_bit_buffer <<= 8;
+        }
+    }
+
+    // The lowest m_bits_in bits of m_bit_buffer are pending, len is at most 32.
+    inline void jpeg_encoder::put_bits(uint32 bits, uint len)
+    {
+        m_bit_buffer = (m_bit_buffer << len) | bits;
+        if ((m_bits_in += len) >= 32) {
+            m_bits_in -= 32;
+            emit_bit_word(static_cast<uint32>(m_bit_buffer >> m_bits_in));
+        }
+    }
+
+    // Pads the pending bits with 1s to a whole byte and writes them out.
+    void jpeg_encoder::flush_bits()
+    {
+        uint pad = (8 - (m_bits_in & 7)) & 7;
+        m_bit_buffer = (m_bit_buffer << pad) | ((1U << pad) - 1);
+        m_bits_in += pad;
+        while (m_bits_in) {
             m_bits_in -= 8;
+            uint8 c = uint8(m_bit_buffer >> m_bits_in);
+            emit_byte(c);
+            if (c == 0xFF) {
+                emit_byte(0);
+            }
         }
+        m_bit_buffer = 0;
     }
 
     void jpeg_encoder::emit_word(uint i)
@@ -246,7 +379,7 @@ namespace jpge {
             emit_word(64 + 1 + 2);
             emit_byte(static_cast<uint8>(i));
             for (int j = 0; j < 64; j++)
-                emit_byte(static_cast<uint8>(m_quantization_tables[i][j]));
+                emit_byte(static_cast<uint8>(m_pQuant->m_tables[i][j]));
         }
     }
 
@@ -268,7 +401,7 @@ namespace jpge {
     }
 
     // Emit Huffman table.
-    void jpeg_encoder::emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag)
+    void jpeg_encoder::emit_dht(const uint8 *bits, const uint8 *val, int index, bool ac_flag)
     {
         emit_marker(M_DHT);
 
@@ -289,11 +422,38 @@ namespace jpge {
     // Emit all Huffman tables.
     void jpeg_encoder::emit_dhts()
     {
-        emit_dht(m_huff_bits[0+0], m_huff_val[0+0], 0, false);
-        emit_dht(m_huff_bits[2+0], m_huff_val[2+0], 0, true);
+        emit_dht(s_huff_bits[0], s_huff_val[0], 0, false);
+        emit_dht(s_huff_bits[1], s_huff_val[1], 0, true);
         if (m_num_components == 3) {
-            emit_dht(m_huff_bits[0+1], m_huff_val[0+1], 1, false);
-            emit_dht(m_huff_bits[2+1], m_huff_val[2+1], 1, true);
+            emit_dht(s_huff_bits[2], s_huff_val[2], 1, false);
+            emit_dht(s_huff_bits[3], s_huff_val[3], 1, true);
+        }
+    }
+
+    // Emit the restart interval
+    void jpeg_encoder::emit_dri()
+    {
+        emit_marker(M_DRI);
+        emit_word(4);
+        emit_word(m_params.m_restart_interval);
+    }
+
+    // Ends the restart interval, the next MCU is coded as if it started the scan
+    void jpeg_encoder::emit_restart()
+    {
+        flush_bits();
+        emit_marker(M_RST0 + (m_restart_num++ & 7));
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+        m_mcus_to_restart = m_params.m_restart_interval;
+    }
+
+    inline void jpeg_encoder::next_mcu()
+    {
+        if (m_params.m_restart_interval) {
+            if (!m_mcus_to_restart) {
+                emit_restart();
+            }
+            m_mcus_to_restart--;
         }
     }
 
@@ -316,153 +476,110 @@ namespace jpge {
         emit_byte(0);
     }
 
-    void jpeg_encoder::load_block_8_8_grey(int x)
-    {
-        uint8 *pSrc;
-        sample_array_t *pDst = m_sample_array;
-        x <<= 3;
-        for (int i = 0; i < 8; i++, pDst += 8)
-        {
-            pSrc = m_mcu_lines[i] + x;
-            pDst[0] = pSrc[0] - 128; pDst[1] = pSrc[1] - 128; pDst[2] = pSrc[2] - 128; pDst[3] = pSrc[3] - 128;
-            pDst[4] = pSrc[4] - 128; pDst[5] = pSrc[5] - 128; pDst[6] = pSrc[6] - 128; pDst[7] = pSrc[7] - 128;
-        }
-    }
-
     void jpeg_encoder::load_block_8_8(int x, int y, int c)
     {
         uint8 *pSrc;
         sample_array_t *pDst = m_sample_array;
-        x = (x * (8 * 3)) + c;
+        x = (x << 3) + m_comp_ofs[c];
         y <<= 3;
         for (int i = 0; i < 8; i++, pDst += 8)
         {
             pSrc = m_mcu_lines[y + i] + x;
-            pDst[0] = pSrc[0 * 3] - 128; pDst[1] = pSrc[1 * 3] - 128; pDst[2] = pSrc[2 * 3] - 128; pDst[3] = pSrc[3 * 3] - 128;
-            pDst[4] = pSrc[4 * 3] - 128; pDst[5] = pSrc[5 * 3] - 128; pDst[6] = pSrc[6 * 3] - 128; pDst[7] = pSrc[7 * 3] - 128;
+            pDst[0] = pSrc[0] - 128; pDst[1] = pSrc[1] - 128; pDst[2] = pSrc[2] - 128; pDst[3] = pSrc[3] - 128;
+            pDst[4] = pSrc[4] - 128; pDst[5] = pSrc[5] - 128; pDst[6] = pSrc[6] - 128; pDst[7] = pSrc[7] - 128;
         }
     }
 
+    // The chroma of H2V2, already subsampled horizontally by load_mcu(), is averaged over line pairs.
     void jpeg_encoder::load_block_16_8(int x, int c)
     {
         uint8 *pSrc1, *pSrc2;
         sample_array_t *pDst = m_sample_array;
-        x = (x * (16 * 3)) + c;
-        int a = 0, b = 2;
+        x = (x << 3) + m_comp_ofs[c];
+        int a = 0, b = 1;
         for (int i = 0; i < 16; i += 2, pDst += 8)
         {
             pSrc1 = m_mcu_lines[i + 0] + x;
             pSrc2 = m_mcu_lines[i + 1] + x;
-            pDst[0] = ((pSrc1[ 0 * 3] + pSrc1[ 1 * 3] + pSrc2[ 0 * 3] + pSrc2[ 1 * 3] + a) >> 2) - 128; pDst[1] = ((pSrc1[ 2 * 3] + pSrc1[ 3 * 3] + pSrc2[ 2 * 3] + pSrc2[ 3 * 3] + b) >> 2) - 128;
-            pDst[2] = ((pSrc1[ 4 * 3] + pSrc1[ 5 * 3] + pSrc2[ 4 * 3] + pSrc2[ 5 * 3] + a) >> 2) - 128; pDst[3] = ((pSrc1[ 6 * 3] + pSrc1[ 7 * 3] + pSrc2[ 6 * 3] + pSrc2[ 7 * 3] + b) >> 2) - 128;
-            pDst[4] = ((pSrc1[ 8 * 3] + pSrc1[ 9 * 3] + pSrc2[ 8 * 3] + pSrc2[ 9 * 3] + a) >> 2) - 128; pDst[5] = ((pSrc1[10 * 3] + pSrc1[11 * 3] + pSrc2[10 * 3] + pSrc2[11 * 3] + b) >> 2) - 128;
-            pDst[6] = ((pSrc1[12 * 3] + pSrc1[13 * 3] + pSrc2[12 * 3] + pSrc2[13 * 3] + a) >> 2) - 128; pDst[7] = ((pSrc1[14 * 3] + pSrc1[15 * 3] + pSrc2[14 * 3] + pSrc2[15 * 3] + b) >> 2) - 128;
+            pDst[0] = ((pSrc1[0] + pSrc2[0] + a) >> 1) - 128; pDst[1] = ((pSrc1[1] + pSrc2[1] + b) >> 1) - 128;
+            pDst[2] = ((pSrc1[2] + pSrc2[2] + a) >> 1) - 128; pDst[3] = ((pSrc1[3] + pSrc2[3] + b) >> 1) - 128;
+            pDst[4] = ((pSrc1[4] + pSrc2[4] + a) >> 1) - 128; pDst[5] = ((pSrc1[5] + pSrc2[5] + b) >> 1) - 128;
+            pDst[6] = ((pSrc1[6] + pSrc2[6] + a) >> 1) - 128; pDst[7] = ((pSrc1[7] + pSrc2[7] + b) >> 1) - 128;
             int temp = a; a = b; b = temp;
         }
     }
 
-    void jpeg_encoder::load_block_16_8_8(int x, int c)
+    // Quantizes in natural order, the high word of the product with the reciprocal is the rounded quotient,
+    // then puts the coefficients in zigzag order. m_nonzero gets a bit for every coefficient that is not 0.
+    void jpeg_encoder::load_quantized_coefficients(int component_num)
     {
-        uint8 *pSrc1;
-        sample_array_t *pDst = m_sample_array;
-        x = (x * (16 * 3)) + c;
-        for (int i = 0; i < 8; i++, pDst += 8)
+        const uint32 *r = m_pQuant->m_recip[component_num > 0];
+        int16 quantized[64];
+        for (int i = 0; i < 64; i++)
         {
-            pSrc1 = m_mcu_lines[i + 0] + x;
-            pDst[0] = ((pSrc1[ 0 * 3] + pSrc1[ 1 * 3]) >> 1) - 128; pDst[1] = ((pSrc1[ 2 * 3] + pSrc1[ 3 * 3]) >> 1) - 128;
-            pDst[2] = ((pSrc1[ 4 * 3] + pSrc1[ 5 * 3]) >> 1) - 128; pDst[3] = ((pSrc1[ 6 * 3] + pSrc1[ 7 * 3]) >> 1) - 128;
-            pDst[4] = ((pSrc1[ 8 * 3] + pSrc1[ 9 * 3]) >> 1) - 128; pDst[5] = ((pSrc1[10 * 3] + pSrc1[11 * 3]) >> 1) - 128;
-            pDst[6] = ((pSrc1[12 * 3] + pSrc1[13 * 3]) >> 1) - 128; pDst[7] = ((pSrc1[14 * 3] + pSrc1[15 * 3]) >> 1) - 128;
+            // branch free: sign is 0 or -1, (x ^ sign) - sign negates x when j is negative
+            sample_array_t j = m_sample_array[i];
+            int32 sign = j >> 31;
+            uint32 a = (j ^ sign) - sign;
+            uint32 v = static_cast<uint32>((static_cast<uint64>(a) * r[i] + 0x80000000U) >> 32);
+            quantized[i] = static_cast<int16>((v ^ sign) - sign);
+        }
+        JPGE_UNROLL_ZIGZAG
+        for (int k = 0; k < 64; k++)
+            m_coefficient_array[k] = quantized[s_zag[k]];
+
+        // four coefficients at a time: the top bit of each 16 bit lane of t is set when the lane is not 0,
+        // the multiplication gathers the four bits in bits 48 to 51
+        const uint64 low = 0x7FFF7FFF7FFF7FFFULL;
+        uint64 nonzero = 0;
+        for (int k = 0; k < 64; k += 4)
+        {
+            uint64 w;
+            memcpy(&w, m_coefficient_array + k, sizeof(w));
+            uint64 t = ((w | ((w & low) + low)) >> 15) & 0x0001000100010001ULL;
+            nonzero |= ((t * 0x0001000200040008ULL) >> 48) << k;
         }
+        m_nonzero = nonzero;
     }
 
-    void jpeg_encoder::load_quantized_coefficients(int component_num)
+    // Codes the symbol of run (<< 4) and the size of v, followed by the bits of v, in one put_bits().
+    inline void jpeg_encoder::put_coded(const uint32 *codes, int run, int v)
     {
-        int32 *q = m_quantization_tables[component_num > 0];
-        int16 *pDst = m_coefficient_array;
-        for (int i = 0; i < 64; i++)
-        {
-            sample_array_t j = m_sample_array[s_zag[i]];
-            if (j < 0)
-            {
-                if ((j = -j + (*q >> 1)) < *q)
-                    *pDst++ = 0;
-                else
-                    *pDst++ = static_cast<int16>(-(j / *q));
-            }
-            else
-            {
-                if ((j = j + (*q >> 1)) < *q)
-                    *pDst++ = 0;
-                else
-                    *pDst++ = static_cast<int16>((j / *q));
-            }
-            q++;
-        }
+        uint a = (v < 0) ? -v : v;
+        uint nbits = a ? 32 - __builtin_clz(a) : 0;
+        uint bits = static_cast<uint>((v < 0) ? v - 1 : v) & ((1U << nbits) - 1);
+        uint32 c = codes[run + nbits];
+        put_bits(((c >> 8) << nbits) | bits, (c & 0xFF) + nbits);
     }
 
     void jpeg_encoder::code_coefficients_pass_two(int component_num)
     {
-        int i, j, run_len, nbits, temp1, temp2;
-        int16 *pSrc = m_coefficient_array;
-        uint *codes[2];
-        uint8 *code_sizes[2];
-
-        if (component_num == 0)
-        {
-            codes[0] = m_huff_codes[0 + 0]; codes[1] = m_huff_codes[2 + 0];
-            code_sizes[0] = m_huff_code_sizes[0 + 0]; code_sizes[1] = m_huff_code_sizes[2 + 0];
-        }
-        else
-        {
-            codes[0] = m_huff_codes[0 + 1]; codes[1] = m_huff_codes[2 + 1];
-            code_sizes[0] = m_huff_code_sizes[0 + 1]; code_sizes[1] = m_huff_code_sizes[2 + 1];
-        }
-
-        temp1 = temp2 = pSrc[0] - m_last_dc_val[component_num];
-        m_last_dc_val[component_num] = pSrc[0];
-
-        if (temp1 < 0)
+        const int t = (component_num > 0) * 2;
+        const uint32 *dc_codes = m_pHuff->m_codes[t];
+        const uint32 *ac_codes = m_pHuff->m_codes[t + 1];
+
+        int dc = m_coefficient_array[0];
+        put_coded(dc_codes, 0, dc - m_last_dc_val[component_num]);
+        m_last_dc_val[component_num] = dc;
+
+        // only the coefficients that are not 0 are visited, in zigzag order
+        uint64 nonzero = m_nonzero & ~1ULL;
+        int last = 0;
+        while (nonzero)
         {
-            temp1 = -temp1; temp2--;
-        }
-
-        nbits = 0;
-        while (temp1)
-        {
-            nbits++; temp1 >>= 1;
-        }
-
-        put_bits(codes[0][nbits], code_sizes[0][nbits]);
-        if (nbits) put_bits(temp2 & ((1 << nbits) - 1), nbits);
-
-        for (run_len = 0, i = 1; i < 64; i++)
-        {
-            if ((temp1 = m_coefficient_array[i]) == 0)
-                run_len++;
-            else
+            int k = __builtin_ctzll(nonzero);
+            int run_len = k - last - 1;
+            while (run_len >= 16)
             {
-                while (run_len >= 16)
-                {
-                    put_bits(codes[1][0xF0], code_sizes[1][0xF0]);
-                    run_len -= 16;
-                }
-                if ((temp2 = temp1) < 0)
-                {
-                    temp1 = -temp1;
-                    temp2--;
-                }
-                nbits = 1;
-                while (temp1 >>= 1)
-                    nbits++;
-                j = (run_len << 4) + nbits;
-                put_bits(codes[1][j], code_sizes[1][j]);
-                put_bits(temp2 & ((1 << nbits) - 1), nbits);
-                run_len = 0;
+                put_bits(ac_codes[0xF0] >> 8, ac_codes[0xF0] & 0xFF);
+                run_len -= 16;
             }
+            put_coded(ac_codes, run_len << 4, m_coefficient_array[k]);
+            last = k;
+            nonzero &= nonzero - 1;
         }
-        if (run_len)
-            put_bits(codes[1][0], code_sizes[1][0]);
+        if (last != 63)
+            put_bits(ac_codes[0] >> 8, ac_codes[0] & 0xFF);
     }
 
     void jpeg_encoder::code_block(int component_num)
@@ -478,13 +595,15 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
-                load_block_8_8_grey(i); code_block(0);
+                next_mcu();
+                load_block_8_8(i, 0, 0); code_block(0);
             }
         }
         else if ((m_comp_h_samp[0] == 1) && (m_comp_v_samp[0] == 1))
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                next_mcu();
                 load_block_8_8(i, 0, 0); code_block(0); load_block_8_8(i, 0, 1); code_block(1); load_block_8_8(i, 0, 2); code_block(2);
             }
         }
@@ -492,14 +611,16 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                next_mcu();
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
-                load_block_16_8_8(i, 1); code_block(1); load_block_16_8_8(i, 2); code_block(2);
+                load_block_8_8(i, 0, 1); code_block(1); load_block_8_8(i, 0, 2); code_block(2);
             }
         }
         else if ((m_comp_h_samp[0] == 2) && (m_comp_v_samp[0] == 2))
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                next_mcu();
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_8_8(i * 2 + 0, 1, 0); code_block(0); load_block_8_8(i * 2 + 1, 1, 0); code_block(0);
                 load_block_16_8(i, 1); code_block(1); load_block_16_8(i, 2); code_block(2);
@@ -511,31 +632,45 @@ namespace jpge {
     {
         const uint8* Psrc = reinterpret_cast<const uint8*>(pSrc);
 
-        uint8* pDst = m_mcu_lines[m_mcu_y_ofs]; // OK to write up to m_image_bpl_xlt bytes to pDst
+        uint8* pDst = m_mcu_lines[m_mcu_y_ofs];
+        const int ri = m_params.m_bgr ? 2 : 0;
 
         if (m_num_components == 1) {
             if (m_image_bpp == 3)
-                RGB_to_Y(pDst, Psrc, m_image_x);
+                RGB_to_Y(pDst, Psrc, m_image_x, ri);
+            else if (m_image_bpp == 2 && m_params.m_rgb565)
+                RGB565_to_Y(pDst, Psrc, m_image_x);
+            else if (m_image_bpp == 2)
+                YUYV_to_Y(pDst, Psrc, m_image_x);
             else
                 memcpy(pDst, Psrc, m_image_x);
-        } else {
-            if (m_image_bpp == 3)
-                RGB_to_YCC(pDst, Psrc, m_image_x);
-            else
-                Y_to_YCC(pDst, Psrc, m_image_x);
-        }
 
-        // Possibly duplicate pixels at end of scanline if not a multiple of 8 or 16
-        if (m_num_components == 1)
-            memset(m_mcu_lines[m_mcu_y_ofs] + m_image_bpl_xlt, pDst[m_image_bpl_xlt - 1], m_image_x_mcu - m_image_x);
-        else
-        {
-            const uint8 y = pDst[m_image_bpl_xlt - 3 + 0], cb = pDst[m_image_bpl_xlt - 3 + 1], cr = pDst[m_image_bpl_xlt - 3 + 2];
-            uint8 *q = m_mcu_lines[m_mcu_y_ofs] + m_image_bpl_xlt;
-            for (int i = m_image_x; i < m_image_x_mcu; i++)
-            {
-                *q++ = y; *q++ = cb; *q++ = cr;
+            // Possibly duplicate pixels at end of scanline if not a multiple of 8
+            memset(pDst + m_image_x, pDst[m_image_x - 1], m_image_x_mcu - m_image_x);
+        } else {
+            // Y, Cb and Cr planes one after the other, the chroma already subsampled horizontally
+            const int h = m_comp_h_samp[0];
+            uint8 *pCb = pDst + m_comp_ofs[1], *pCr = pDst + m_comp_ofs[2];
+            if (m_image_bpp == 3 && h == 2)
+                RGB_to_YCC_h2(pDst, pCb, pCr, Psrc, m_image_x, ri);
+            else if (m_image_bpp == 3)
+                RGB_to_YCC(pDst, pCb, pCr, Psrc, m_image_x, ri);
+            else if (m_image_bpp == 2 && m_params.m_rgb565 && h == 2)
+                RGB565_to_YCC_h2(pDst, pCb, pCr, Psrc, m_image_x);
+            else if (m_image_bpp == 2 && m_params.m_rgb565)
+                RGB565_to_YCC(pDst, pCb, pCr, Psrc, m_image_x);
+            else if (m_image_bpp == 2)
+                YUYV_to_YCC(pDst, pCb, pCr, Psrc, m_image_x, h == 2);
+            else {
+                memcpy(pDst, Psrc, m_image_x);
+                memset(pCb, 128, m_image_bpl_mcu - m_comp_ofs[1]);
             }
+
+            // Possibly duplicate pixels at end of scanline if not a multiple of 8 or 16
+            const int chroma_x = (m_image_x + h - 1) / h, chroma_x_mcu = m_image_x_mcu / h;
+            memset(pDst + m_image_x, pDst[m_image_x - 1], m_image_x_mcu - m_image_x);
+            memset(pCb + chroma_x, pCb[chroma_x - 1], chroma_x_mcu - chroma_x);
+            memset(pCr + chroma_x, pCr[chroma_x - 1], chroma_x_mcu - chroma_x);
         }
 
         if (++m_mcu_y_ofs == m_mcu_y)
@@ -546,7 +681,7 @@ namespace jpge {
     }
 
     // Quantization table generation.
-    void jpeg_encoder::compute_quant_table(int32 *pDst, const int16 *pSrc)
+    void jpeg_encoder::compute_quant_table(int32 *pDst, uint32 *pRecip, const int16 *pSrc)
     {
         int32 q;
         if (m_params.m_quality < 50)
@@ -556,7 +691,18 @@ namespace jpge {
         for (int i = 0; i < 64; i++)
         {
             int32 j = *pSrc++; j = (j * q + 50L) / 100L;
-            *pDst++ = JPGE_MIN(JPGE_MAX(j, 1), 255);
+            pDst[i] = JPGE_MIN(JPGE_MAX(j, 1), 255);
+
+            // the DCT output is divided by pDst[i] * aan * (8 << DCT_PASS_BITS), aan has 14 fractional bits
+            const int descale = 14 - 3 - DCT_PASS_BITS;
+            const int z = s_zag[i];
+            const uint64_t d = static_cast<uint64_t>(pDst[i]) * s_aan_scales[z];
+            uint8 shift = 1;
+            while (((1ULL << (shift + descale)) / d) < (1U << 14))
+                shift++;
+            // a 15 bit reciprocal of 2^shift, moved up to 2^32 so the quotient is the high word of the product
+            const uint32 r = static_cast<uint32>(((1ULL << (shift + descale)) + d / 2) / d);
+            pRecip[z] = r << (32 - shift);
         }
     }
 
@@ -603,37 +749,37 @@ namespace jpge {
         m_image_bpl      = m_image_x * src_channels;
         m_image_x_mcu    = (m_image_x + m_mcu_x - 1) & (~(m_mcu_x - 1));
         m_image_y_mcu    = (m_image_y + m_mcu_y - 1) & (~(m_mcu_y - 1));
-        m_image_bpl_xlt  = m_image_x * m_num_components;
-        m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
+        // the MCU lines hold the planes of the components, each with its horizontal subsampling
+        m_comp_ofs[0]    = 0;
+        m_comp_ofs[1]    = m_image_x_mcu;
+        m_comp_ofs[2]    = m_image_x_mcu + m_image_x_mcu / m_comp_h_samp[0];
+        m_image_bpl_mcu  = (m_num_components == 1) ? m_image_x_mcu : m_comp_ofs[2] + m_image_x_mcu / m_comp_h_samp[0];
         m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
 
-        if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
+        // the quantization tables, the MCU lines and the output buffer share one allocation
+        if ((m_pQuant = static_cast<quant_tables*>(jpge_malloc(sizeof(quant_tables) + m_image_bpl_mcu * m_mcu_y + m_params.m_flush_size))) == NULL) {
             return false;
         }
+        m_mcu_lines[0] = reinterpret_cast<uint8*>(m_pQuant + 1);
         for (int i = 1; i < m_mcu_y; i++)
             m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
+        m_out_buf = m_mcu_lines[0] + m_image_bpl_mcu * m_mcu_y;
 
-        if(m_last_quality != m_params.m_quality){
-            m_last_quality = m_params.m_quality;
-            compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
-            compute_quant_table(m_quantization_tables[1], s_std_croma_quant);
-        }
-
-        if(!m_huff_initialized){
-            m_huff_initialized = true;
-
-            memcpy(m_huff_bits[0+0], s_dc_lum_bits, 17);    memcpy(m_huff_val[0+0], s_dc_lum_val, DC_LUM_CODES);
-            memcpy(m_huff_bits[2+0], s_ac_lum_bits, 17);    memcpy(m_huff_val[2+0], s_ac_lum_val, AC_LUM_CODES);
-            memcpy(m_huff_bits[0+1], s_dc_chroma_bits, 17); memcpy(m_huff_val[0+1], s_dc_chroma_val, DC_CHROMA_CODES);
-            memcpy(m_huff_bits[2+1], s_ac_chroma_bits, 17); memcpy(m_huff_val[2+1], s_ac_chroma_val, AC_CHROMA_CODES);
-
-            compute_huffman_table(&m_huff_codes[0+0][0], &m_huff_code_sizes[0+0][0], m_huff_bits[0+0], m_huff_val[0+0]);
-            compute_huffman_table(&m_huff_codes[2+0][0], &m_huff_code_sizes[2+0][0], m_huff_bits[2+0], m_huff_val[2+0]);
-            compute_huffman_table(&m_huff_codes[0+1][0], &m_huff_code_sizes[0+1][0], m_huff_bits[0+1], m_huff_val[0+1]);
-            compute_huffman_table(&m_huff_codes[2+1][0], &m_huff_code_sizes[2+1][0], m_huff_bits[2+1], m_huff_val[2+1]);
-        }
+        compute_quant_table(m_pQuant->m_tables[0], m_pQuant->m_recip[0], s_std_lum_quant);
+        compute_quant_table(m_pQuant->m_tables[1], m_pQuant->m_recip[1], s_std_croma_quant);
+        m_pHuff = &get_huffman_tables();
+        return true;
+    }
 
-        m_out_buf_left = JPGE_OUT_BUF_SIZE;
+    bool jpeg_encoder::start(output_stream *pStream, segment_t segment)
+    {
+        if ((!pStream) || (!m_pQuant)) return false;
+        m_pStream = pStream;
+        m_segment = segment;
+        m_restart_num = 0;
+        m_mcus_to_restart = m_params.m_restart_interval;
+        m_all_stream_writes_succeeded = true;
+        m_out_buf_left = m_params.m_flush_size;
         m_pOut_buf = m_out_buf;
         m_bit_buffer = 0;
         m_bits_in = 0;
@@ -641,12 +787,19 @@ namespace jpge {
         m_pass_num = 2;
         memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
 
+        if (segment == NEXT_SEGMENT) {
+            return true;
+        }
+
         // Emit all markers at beginning of image file.
         emit_marker(M_SOI);
         emit_jfif_app0();
         emit_dqt();
         emit_sof();
         emit_dhts();
+        if (m_params.m_restart_interval) {
+            emit_dri();
+        }
         emit_sos();
 
         return m_all_stream_writes_succeeded;
@@ -663,7 +816,13 @@ namespace jpge {
             process_mcu_row();
         }
 
-        put_bits(0x7F, 7);
+        flush_bits();
+        if (m_segment != WHOLE_IMAGE) {
+            // the caller joins the segments and ends the image
+            flush_output_buffer();
+            m_pass_num++;
+            return true;
+        }
         emit_marker(M_EOI);
         flush_output_buffer();
         m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(NULL, 0);
@@ -673,7 +832,10 @@ namespace jpge {
 
     void jpeg_encoder::clear()
     {
+        m_pQuant = NULL;
+        m_pHuff = NULL;
         m_mcu_lines[0] = NULL;
+        m_out_buf = NULL;
         m_pass_num = 0;
         m_all_stream_writes_succeeded = true;
     }
@@ -689,17 +851,22 @@ namespace jpge {
     }
 
     bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        return pStream && setup(width, height, src_channels, comp_params) && start(pStream);
+    }
+
+    bool jpeg_encoder::setup(int width, int height, int src_channels, const params &comp_params)
     {
         deinit();
-        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
-        m_pStream = pStream;
+        if (((width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 2) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+        if ((src_channels == 2) && !comp_params.m_rgb565 && (width & 1)) return false; // YUYV comes in pixel pairs
         m_params = comp_params;
         return jpg_open(width, height, src_channels);
     }
 
     void jpeg_encoder::deinit()
     {
-        jpge_free(m_mcu_lines[0]);
+        jpge_free(m_pQuant);
         clear();
     }
 
@@ -12,13 +12,14 @@ namespace jpge
     typedef unsigned short uint16;
     typedef unsigned int   uint32;
     typedef unsigned int   uint;
+    typedef unsigned long long uint64;
 
     // JPEG chroma subsampling factors. Y_ONLY (grayscale images) and H2V2 (color images) are the most common.
     enum subsampling_t { Y_ONLY = 0, H1V1 = 1, H2V1 = 2, H2V2 = 3 };
 
     // JPEG compression parameters structure.
     struct params {
-            inline params() : m_quality(85), m_subsampling(H2V2) { }
+            inline params() : m_quality(85), m_subsampling(H2V2), m_flush_size(512), m_restart_interval(0), m_bgr(false), m_rgb565(false) { }
 
             inline bool check() const {
                 if ((m_quality < 1) || (m_quality > 100)) {
@@ -27,6 +28,12 @@ namespace jpge
                 if ((uint)m_subsampling > (uint)H2V2) {
                     return false;
                 }
+                if (m_flush_size < 64) {
+                    return false;
+                }
+                if (m_restart_interval > 0xFFFF) {
+                    return false;
+                }
                 return true;
             }
 
@@ -39,10 +46,22 @@ namespace jpge
             // 2 = H2V1 subsampling (YCbCr 2x1x1, 4 blocks per MCU)
             // 3 = H2V2 subsampling (YCbCr 4x1x1, 6 blocks per MCU-- very common)
             subsampling_t m_subsampling;
+
+            // Bytes collected before they are handed to output_stream::put_buf(), at least 64.
+            uint m_flush_size;
+
+            // MCUs between restart markers, 0 for none.
+            uint m_restart_interval;
+
+            // 3 channel sources are B, G, R rather than R, G, B.
+            bool m_bgr;
+
+            // 2 channel sources are big endian RGB565 rather than YUYV.
+            bool m_rgb565;
     };
     
     // Output stream abstract class - used by the jpeg_encoder class to write to the output stream.
-    // put_buf() is generally called with len==JPGE_OUT_BUF_SIZE bytes, but for headers it'll be called with smaller amounts.
+    // put_buf() is generally called with len==params::m_flush_size bytes, the last call of the image may be shorter.
     class output_stream {
         public:
             virtual ~output_stream() { };
@@ -50,6 +69,13 @@ namespace jpge
             virtual uint get_size() const = 0;
     };
     
+    struct huffman_tables;
+
+    // What start() writes around the entropy coded data. An image can be encoded in parts of whole
+    // restart intervals by separate encoders: the first part gets the headers, the caller joins
+    // the parts with RSTn markers and ends the image with EOI.
+    enum segment_t { WHOLE_IMAGE = 0, FIRST_SEGMENT, NEXT_SEGMENT };
+
     // Lower level jpeg_encoder class - useful if more control is needed than the above helper functions.
     class jpeg_encoder {
         public:
@@ -60,12 +86,20 @@ namespace jpge
             // pStream: The stream object to use for writing compressed data.
             // params - Compression parameters structure, defined above.
             // width, height  - Image dimensions.
-            // channels - May be 1, or 3. 1 indicates grayscale, 3 indicates RGB source data.
+            // channels - May be 1, 2 or 3. 1 indicates grayscale, 2 YUYV (4:2:2, even width only) or RGB565 (see params::m_rgb565),
+            //            3 RGB (or BGR, see params::m_bgr) source data.
+            //            YUYV is only scaled from limited to full range, there is no round trip through RGB.
             // Returns false on out of memory or if a stream write fails.
             bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
 
+            // init() in two steps, for encoding many images of the same size and parameters.
+            // setup() allocates the buffers and builds the tables, start() begins an image, written to pStream.
+            // start() may be called again once the previous image is finished or abandoned.
+            bool setup(int width, int height, int src_channels, const params &comp_params = params());
+            bool start(output_stream *pStream, segment_t segment = WHOLE_IMAGE);
+
             // Call this method with each source scanline.
-            // width * src_channels bytes per scanline is expected (RGB or Y format).
+            // width * src_channels bytes per scanline is expected (RGB, YUYV, RGB565 or Y format).
             // You must call with NULL after all scanlines are processed to finish compression.
             // Returns false on out of memory or if a stream write fails.
             bool process_scanline(const void* pScanline);
@@ -78,35 +112,50 @@ namespace jpge
             jpeg_encoder &operator =(const jpeg_encoder &);
 
             typedef int32 sample_array_t;
-            enum { JPGE_OUT_BUF_SIZE = 512 };
+
+            // the tables in zigzag order as emitted, the reciprocals 2^32 / divisor of the scaled DCT outputs in natural order
+            struct quant_tables {
+                int32 m_tables[2][64];
+                uint32 m_recip[2][64];
+            };
 
             output_stream *m_pStream;
             params m_params;
+            quant_tables *m_pQuant;
+            const huffman_tables *m_pHuff;
             uint8 m_num_components;
             uint8 m_comp_h_samp[3], m_comp_v_samp[3];
             int m_image_x, m_image_y, m_image_bpp, m_image_bpl;
             int m_image_x_mcu, m_image_y_mcu;
-            int m_image_bpl_xlt, m_image_bpl_mcu;
+            int m_image_bpl_mcu;
+            int m_comp_ofs[3];
             int m_mcus_per_row;
             int m_mcu_x, m_mcu_y;
             uint8 *m_mcu_lines[16];
             uint8 m_mcu_y_ofs;
             sample_array_t m_sample_array[64];
-            int16 m_coefficient_array[64];
+            int16 m_coefficient_array[64]; // in zigzag order
+            uint64 m_nonzero;
 
             int m_last_dc_val[3];
-            uint8 m_out_buf[JPGE_OUT_BUF_SIZE];
+            uint8 *m_out_buf;
             uint8 *m_pOut_buf;
             uint m_out_buf_left;
-            uint32 m_bit_buffer;
+            uint64 m_bit_buffer;
             uint m_bits_in;
             uint8 m_pass_num;
+            segment_t m_segment;
+            uint m_restart_num;
+            uint m_mcus_to_restart;
             bool m_all_stream_writes_succeeded;
 
             bool jpg_open(int p_x_res, int p_y_res, int src_channels);
 
             void flush_output_buffer();
-            void put_bits(uint bits, uint len);
+            void emit_bit_word(uint32 w);
+            void put_bits(uint32 bits, uint len);
+            void flush_bits();
+            void put_coded(const uint32 *codes, int run, int v);
 
             void emit_byte(uint8 i);
             void emit_word(uint i);
@@ -115,17 +164,18 @@ namespace jpge
             void emit_jfif_app0();
             void emit_dqt();
             void emit_sof();
-            void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
+            void emit_dht(const uint8 *bits, const uint8 *val, int index, bool ac_flag);
             void emit_dhts();
             void emit_sos();
+            void emit_dri();
+            void emit_restart();
+            void next_mcu();
 
-            void compute_quant_table(int32 *dst, const int16 *src);
+            void compute_quant_table(int32 *dst, uint32 *recip, const int16 *src);
             void load_quantized_coefficients(int component_num);
 
-            void load_block_8_8_grey(int x);
             void load_block_8_8(int x, int y, int c);
             void load_block_16_8(int x, int c);
-            void load_block_16_8_8(int x, int c);
 
             void code_coefficients_pass_two(int component_num);
             void code_block(int component_num);
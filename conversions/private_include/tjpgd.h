@@ -6,13 +6,29 @@
 /*---------------------------------------------------------------------------*/
 /* System Configurations */
 
+#include "sdkconfig.h"
+
+#ifdef CONFIG_CAMERA_JD_SZBUF
+#define	JD_SZBUF		CONFIG_CAMERA_JD_SZBUF	/* Size of stream input buffer */
+#else
 #define	JD_SZBUF		512	/* Size of stream input buffer */
-#define JD_FORMAT		0	/* Output pixel format 0:RGB888 (3 BYTE/pix), 1:RGB565 (1 WORD/pix) */
+#endif
+#define JD_FORMAT		0	/* Default output pixel format, one of JD_FMT_* below (jd->format selects it for a session) */
 #define	JD_USE_SCALE	1	/* Use descaling feature for output */
 #define JD_TBLCLIP		1	/* Use table for saturation (might be a bit faster but increases 1K bytes of code size) */
+#define JD_HUFFLUT_BITS	9	/* Huffman codes up to this long are decoded with one look up (2 << JD_HUFFLUT_BITS bytes of pool per table) */
 
 /*---------------------------------------------------------------------------*/
 
+/* Output pixel formats */
+#define JD_FMT_RGB888		0	/* R, G, B (3 BYTE/pix) */
+#define JD_FMT_RGB565_LE	1	/* RGB565, low byte first (2 BYTE/pix) */
+#define JD_FMT_RGB565_BE	2	/* RGB565, high byte first (2 BYTE/pix) */
+#define JD_FMT_BGR888		3	/* B, G, R (3 BYTE/pix) */
+#define JD_FMT_Y8			4	/* Luminance only, chroma is not decoded (1 BYTE/pix) */
+
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,9 +49,10 @@ typedef unsigned short	WORD;
 typedef unsigned short	WCHAR;
 
 /* These types must be 32-bit integer */
-typedef long			LONG;
-typedef unsigned long	ULONG;
-typedef unsigned long	DWORD;
+/* (long is 64-bit on a host, the IDCT buffer is sized for 32-bit) */
+typedef int32_t			LONG;
+typedef uint32_t		ULONG;
+typedef uint32_t		DWORD;
 
 
 /* Error code */
@@ -64,18 +81,26 @@ typedef struct {
 typedef struct JDEC JDEC;
 struct JDEC {
 	UINT dctr;				/* Number of bytes available in the input buffer */
-	BYTE* dptr;				/* Current data read ptr */
+	const BYTE* dptr;		/* Current data read ptr */
 	BYTE* inbuf;			/* Bit stream input buffer */
-	BYTE dmsk;				/* Current bit in the current read byte */
+	const BYTE* mem;		/* Memory input: rest of the JPEG image (0:input through infunc) */
+	UINT szmem;				/* Memory input: number of bytes left */
+	DWORD wreg;				/* Bit buffer, the low dbit bits are the next data */
+	BYTE dbit;				/* Number of bits in the bit buffer */
+	BYTE marker;			/* Marker that ended the data in the bit buffer (0:none yet) */
 	BYTE scale;				/* Output scaling ratio */
+	BYTE format;			/* Output pixel format (JD_FMT_*) */
 	BYTE msx, msy;			/* MCU size in unit of block (width, height) */
 	BYTE qtid[3];			/* Quantization table ID of each component */
 	SHORT dcv[3];			/* Previous DC element of each component */
 	WORD nrst;				/* Restart inverval */
+	UINT nmcu;				/* Stream input: next MCU to decompress */
+	WORD rst, rsc;			/* Stream input: MCUs into the restart interval and its sequence number */
 	UINT width, height;		/* Size of the input image (pixel) */
 	BYTE* huffbits[2][2];	/* Huffman bit distribution tables [id][dcac] */
 	WORD* huffcode[2][2];	/* Huffman code word tables [id][dcac] */
 	BYTE* huffdata[2][2];	/* Huffman decoded data tables [id][dcac] */
+	WORD* hufflut[2][2];	/* Huffman fast lookup tables [id][dcac], code length << 8 | decoded data */
 	LONG* qttbl[4];			/* Dequaitizer tables [id] */
 	void* workbuf;			/* Working buffer for IDCT and RGB output */
 	BYTE* mcubuf;			/* Working buffer for the MCU */
@@ -87,9 +112,21 @@ struct JDEC {
 
 
 
+/* ESP32 and ESP32-S3 have a tjpgd of their own in ROM, this copy links under other names next to it */
+#if !CONFIG_IDF_TARGET_ESP32S2 && !CONFIG_IDF_TARGET_LINUX
+#define jd_prepare			jd_local_prepare
+#define jd_prepare_mem		jd_local_prepare_mem
+#define jd_decomp			jd_local_decomp
+#define jd_decomp_rect		jd_local_decomp_rect
+#define jd_decomp_stream	jd_local_decomp_stream
+#endif
+
 /* TJpgDec API functions */
 JRESULT jd_prepare (JDEC*, UINT(*)(JDEC*,BYTE*,UINT), void*, UINT, void*);
+JRESULT jd_prepare_mem (JDEC*, const BYTE*, UINT, void*, UINT, void*);
 JRESULT jd_decomp (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE);
+JRESULT jd_decomp_rect (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE, const JRECT*);
+JRESULT jd_decomp_stream (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE, UINT);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,34 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _CONVERSIONS_TJPGD_POOL_H_
+#define _CONVERSIONS_TJPGD_POOL_H_
+
+// Work pools of the tjpgd decoders, included after the tjpgd.h of the decoder in use (local or ROM)
+
+// tjpgd allocates from the pool in words
+#define JPG_POOL_ALIGN(n) (((n) + 3) & ~(size_t)3)
+
+// a Huffman look up table of the local tjpgd
+#define JPG_TJPGD_HUFFLUT_SIZE ((1 << JD_HUFFLUT_BITS) * sizeof(WORD))
+
+// enough for the input buffer and the two quantization and four Huffman tables of a camera JPEG,
+// hufflut_size is what a Huffman look up table takes in the decoder, 0 for the ROM decoders
+#define JPG_POOL_SIZE(hufflut_size) (2588 + JD_SZBUF + 4 * (hufflut_size))
+
+#ifdef JD_FMT_Y8
+// jpg_format_t to the output format of the local tjpgd, the ROM decoders only write RGB888
+static const BYTE jd_formats[] = { JD_FMT_RGB888, JD_FMT_BGR888, JD_FMT_RGB565_LE, JD_FMT_RGB565_BE, JD_FMT_Y8 };
+#endif
+
+#endif /* _CONVERSIONS_TJPGD_POOL_H_ */
@@ -18,9 +18,46 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
-void yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b);
+// BT.601 in fixed point with 13 fraction bits. Every term truncates toward zero like the entries
+// of the lookup table it replaced, so the results are the same. The macros take scalars or vectors.
+#define YUV_TERM(c, x) ((c) * (x) / 8192)
+#define YUV_Y(y) YUV_TERM(9535, (y) - 16)
+#define YUV_VR(v) YUV_TERM(13075, (v) - 128)
+#define YUV_VG(v) YUV_TERM(-3204, (v) - 128)
+#define YUV_UG(u) YUV_TERM(-6656, (u) - 128)
+#define YUV_UB(u) YUV_TERM(16531, (u) - 128)
+
+static inline uint8_t yuv_clamp(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline void yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    int yt = YUV_Y(y);
+    *r = yuv_clamp(yt + YUV_VR(v));
+    *g = yuv_clamp(yt + YUV_UG(u) + YUV_VG(v));
+    *b = yuv_clamp(yt + YUV_UB(u));
+}
+
+// Y0 U Y1 V to B, G, R like fmt2rgb888 writes them, with the chroma terms once per pair.
+// An odd last pixel is left out.
+static inline void yuv422_to_rgb888_row(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i + 2 <= pixels; i += 2, src += 4, dst += 6) {
+        int r = YUV_VR(src[3]), g = YUV_UG(src[1]) + YUV_VG(src[3]), b = YUV_UB(src[1]);
+        int y0 = YUV_Y(src[0]), y1 = YUV_Y(src[2]);
+        dst[0] = yuv_clamp(y0 + b);
+        dst[1] = yuv_clamp(y0 + g);
+        dst[2] = yuv_clamp(y0 + r);
+        dst[3] = yuv_clamp(y1 + b);
+        dst[4] = yuv_clamp(y1 + g);
+        dst[5] = yuv_clamp(y1 + r);
+    }
+}
 
 #ifdef __cplusplus
 }
@@ -19,6 +19,7 @@
 /----------------------------------------------------------------------------*/
 
 #include "tjpgd.h"
+#include <string.h>
 
 #define SUPPORT_JPEG 1
 
@@ -200,9 +201,9 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 	UINT ndata				/* Size of input data */
 )
 {
-	UINT i, j, b, np, cls, num;
+	UINT i, j, b, np, cls, num, l, n;
 	BYTE d, *pb, *pd;
-	WORD hc, *ph;
+	WORD hc, *ph, *pl;
 
 
 	while (ndata) {	/* Process all tables in the segment */
@@ -239,6 +240,19 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 			if (!cls && d > 11) return JDR_FMT1;
 			*pd++ = d;
 		}
+
+		pl = alloc_pool(jd, (1 << JD_HUFFLUT_BITS) * sizeof (WORD));	/* Allocate a memory block for the fast lookup table */
+		if (!pl) return JDR_MEM1;			/* Err: not enough memory */
+		jd->hufflut[num][cls] = pl;
+		for (i = 0; i < (1 << JD_HUFFLUT_BITS); i++) pl[i] = 0;	/* 0: longer code, search it in the code word table */
+		pd = jd->huffdata[num][cls];
+		for (j = 0, l = 1; l <= JD_HUFFLUT_BITS; l++) {	/* Every code of up to JD_HUFFLUT_BITS bits fills the entries it prefixes */
+			for (b = pb[l - 1]; b; b--, j++) {
+				if (ph[j] >> l) continue;	/* Overflowed code word never matches */
+				i = ph[j] << (JD_HUFFLUT_BITS - l);
+				for (n = 1 << (JD_HUFFLUT_BITS - l); n; n--) pl[i++] = (WORD)(l << 8 | pd[j]);
+			}
+		}
 	}
 
 	return JDR_OK;
@@ -248,51 +262,103 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 
 
 /*-----------------------------------------------------------------------*/
-/* Extract N bits from input stream                                      */
+/* Get the next part of the stream                                       */
 /*-----------------------------------------------------------------------*/
 
 static
-INT bitext (	/* >=0: extracted data, <0: error code */
-	JDEC* jd,	/* Pointer to the decompressor object */
-	UINT nbit	/* Number of bits to extract (1 to 11) */
+UINT refill (			/* Number of bytes available (0:read error or end of stream) */
+	JDEC* jd,			/* Pointer to the decompressor object */
+	const BYTE** dp		/* Returns the top of the data */
+)
+{
+	UINT n;
+
+
+	if (jd->mem) {		/* Memory input: all of the rest at once, in place */
+		*dp = jd->mem;
+		n = jd->szmem;
+		jd->mem += n; jd->szmem = 0;
+		return n;
+	}
+	*dp = jd->inbuf;	/* Top of input buffer */
+	return jd->infunc(jd, jd->inbuf, JD_SZBUF);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Load whole bytes into the bit buffer                                  */
+/*-----------------------------------------------------------------------*/
+
+static
+void fill_bits (
+	JDEC* jd	/* Pointer to the decompressor object */
 )
 {
-	BYTE msk, s, *dp;
-	UINT dc, v, f;
-
-
-	msk = jd->dmsk; dc = jd->dctr; dp = jd->dptr;	/* Bit mask, number of data available, read ptr */
-	s = *dp; v = f = 0;
-	do {
-		if (!msk) {				/* Next byte? */
-			if (!dc) {			/* No input data is available, re-fill input buffer */
-				dp = jd->inbuf;	/* Top of input buffer */
-				dc = jd->infunc(jd, dp, JD_SZBUF);
-				if (!dc) return 0 - (INT)JDR_INP;	/* Err: read error or wrong stream termination */
+	UINT dc, dbit;
+	DWORD w;
+	BYTE d;
+	const BYTE *dp;
+
+
+	dc = jd->dctr; dp = jd->dptr;	/* Number of data available, read ptr */
+	w = jd->wreg; dbit = jd->dbit;	/* Bit buffer and number of bits in it */
+	while (dbit <= 24 && !jd->marker) {	/* Until it holds 25 bits or a marker ends the data */
+		if (!dc) {			/* No input data is available, re-fill input buffer */
+			dc = refill(jd, &dp);
+			if (!dc) break;	/* End of stream, the bits that are left may still be enough */
+		} else {
+			dp++;
+		}
+		dc--;
+		d = *dp;
+		if (d == 0xFF) {	/* Flag sequence: 0xFF 0x00 is a data 0xFF, anything else is a marker */
+			if (!dc) {
+				dc = refill(jd, &dp);
+				if (!dc) {
+					if (jd->mem) {	/* Memory input: leave the 0xFF to be read with the data written after it */
+						dp = jd->mem - 2; dc = 1;
+					}
+					break;
+				}
 			} else {
-				dp++;			/* Next data ptr */
+				dp++;
 			}
-			dc--;				/* Decrement number of available bytes */
-			if (f) {			/* In flag sequence? */
-				f = 0;			/* Exit flag sequence */
-				if (*dp != 0) return 0 - (INT)JDR_FMT1;	/* Err: unexpected flag is detected (may be collapted data) */
-				*dp = s = 0xFF;			/* The flag is a data 0xFF */
-			} else {
-				s = *dp;				/* Get next data byte */
-				if (s == 0xFF) {		/* Is start of flag sequence? */
-					f = 1; continue;	/* Enter flag sequence */
-				}
+			dc--;
+			if (*dp) {
+				jd->marker = *dp;	/* The data of this interval ends here */
+				break;
 			}
-			msk = 0x80;		/* Read from MSB */
 		}
-		v <<= 1;	/* Get a bit */
-		if (s & msk) v++;
-		msk >>= 1;
-		nbit--;
-	} while (nbit);
-	jd->dmsk = msk; jd->dctr = dc; jd->dptr = dp;
-
-	return (INT)v;
+		w = w << 8 | d;
+		dbit += 8;
+	}
+	jd->dctr = dc; jd->dptr = dp;
+	jd->wreg = w; jd->dbit = (BYTE)dbit;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Extract N bits from input stream                                      */
+/*-----------------------------------------------------------------------*/
+
+static
+INT bitext (	/* >=0: extracted data, <0: error code */
+	JDEC* jd,	/* Pointer to the decompressor object */
+	UINT nbit	/* Number of bits to extract (1 to 11) */
+)
+{
+	if (jd->dbit < nbit) {
+		fill_bits(jd);
+		if (jd->dbit < nbit)	/* Err: the data ends (may be collapted data) */
+			return 0 - (INT)(jd->marker ? JDR_FMT1 : JDR_INP);
+	}
+	jd->dbit -= nbit;
+
+	return (INT)(jd->wreg >> jd->dbit & ((1UL << nbit) - 1));
 }
 
 
@@ -305,54 +371,45 @@ INT bitext (	/* >=0: extracted data, <0: error code */
 static
 INT huffext (			/* >=0: decoded data, <0: error code */
 	JDEC* jd,			/* Pointer to the decompressor object */
-	const BYTE* hbits,	/* Pointer to the bit distribution table */
-	const WORD* hcode,	/* Pointer to the code word table */
-	const BYTE* hdata	/* Pointer to the data table */
+	UINT id,			/* Huffman table ID */
+	UINT cls			/* Table class, 0:DC, 1:AC */
 )
 {
-	BYTE msk, s, *dp;
-	UINT dc, v, f, bl, nd;
+	const BYTE *hb, *hd;
+	const WORD *hc;
+	UINT dbit, v, nd, bl;
+	WORD e;
 
 
-	msk = jd->dmsk; dc = jd->dctr; dp = jd->dptr;	/* Bit mask, number of data available, read ptr */
-	s = *dp; v = f = 0;
-	bl = 16;	/* Max code length */
-	do {
-		if (!msk) {		/* Next byte? */
-			if (!dc) {	/* No input data is available, re-fill input buffer */
-				dp = jd->inbuf;	/* Top of input buffer */
-				dc = jd->infunc(jd, dp, JD_SZBUF);
-				if (!dc) return 0 - (INT)JDR_INP;	/* Err: read error or wrong stream termination */
-			} else {
-				dp++;	/* Next data ptr */
-			}
-			dc--;		/* Decrement number of available bytes */
-			if (f) {		/* In flag sequence? */
-				f = 0;		/* Exit flag sequence */
-				if (*dp != 0)
-					return 0 - (INT)JDR_FMT1;	/* Err: unexpected flag is detected (may be collapted data) */
-				*dp = s = 0xFF;			/* The flag is a data 0xFF */
-			} else {
-				s = *dp;				/* Get next data byte */
-				if (s == 0xFF) {		/* Is start of flag sequence? */
-					f = 1; continue;	/* Enter flag sequence, get trailing byte */
-				}
-			}
-			msk = 0x80;		/* Read from MSB */
-		}
-		v <<= 1;	/* Get a bit */
-		if (s & msk) v++;
-		msk >>= 1;
-
-		for (nd = *hbits++; nd; nd--) {	/* Search the code word in this bit length */
-			if (v == *hcode++) {		/* Matched? */
-				jd->dmsk = msk; jd->dctr = dc; jd->dptr = dp;
-				return *hdata;			/* Return the decoded data */
+	if (jd->dbit < 16) fill_bits(jd);	/* The longest code */
+	dbit = jd->dbit;
+
+	/* Codes of up to JD_HUFFLUT_BITS bits in one look up, zeros are padded at the end of data */
+	v = (dbit >= JD_HUFFLUT_BITS) ? jd->wreg >> (dbit - JD_HUFFLUT_BITS) : jd->wreg << (JD_HUFFLUT_BITS - dbit);
+	e = jd->hufflut[id][cls][v & ((1 << JD_HUFFLUT_BITS) - 1)];
+	if (e) {
+		bl = e >> 8;					/* Code length */
+		if (bl > dbit) return 0 - (INT)(jd->marker ? JDR_FMT1 : JDR_INP);	/* Err: the data ends */
+		jd->dbit = dbit - bl;
+		return e & 0xFF;				/* Return the decoded data */
+	}
+
+	/* Longer codes: search the code word table from JD_HUFFLUT_BITS + 1 bits */
+	hb = jd->huffbits[id][cls]; hc = jd->huffcode[id][cls]; hd = jd->huffdata[id][cls];
+	for (bl = 0; bl < JD_HUFFLUT_BITS; bl++) {
+		hc += hb[bl]; hd += hb[bl];
+	}
+	for (bl = JD_HUFFLUT_BITS + 1; bl <= 16; bl++) {
+		if (bl > dbit) return 0 - (INT)(jd->marker ? JDR_FMT1 : JDR_INP);	/* Err: the data ends */
+		v = jd->wreg >> (dbit - bl) & ((1 << bl) - 1);
+		for (nd = hb[bl - 1]; nd; nd--) {	/* Search the code word in this bit length */
+			if (v == *hc++) {		/* Matched? */
+				jd->dbit = dbit - bl;
+				return *hd;			/* Return the decoded data */
 			}
-			hdata++;
+			hd++;
 		}
-		bl--;
-	} while (bl);
+	}
 
 	return 0 - (INT)JDR_FMT1;	/* Err: code not found (may be collapted data) */
 }
@@ -377,6 +434,14 @@ void block_idct (
 
 	/* Process columns */
 	for (i = 0; i < 8; i++) {
+		if (!(src[8 * 1] | src[8 * 2] | src[8 * 3] | src[8 * 4] | src[8 * 5] | src[8 * 6] | src[8 * 7])) {
+			v0 = src[8 * 0];	/* No AC element in this column, every output is the DC value */
+			src[8 * 1] = v0; src[8 * 2] = v0; src[8 * 3] = v0; src[8 * 4] = v0;
+			src[8 * 5] = v0; src[8 * 6] = v0; src[8 * 7] = v0;
+			src++;	/* Next column */
+			continue;
+		}
+
 		v0 = src[8 * 0];	/* Get even elements */
 		v1 = src[8 * 2];
 		v2 = src[8 * 4];
@@ -424,6 +489,15 @@ void block_idct (
 	/* Process rows */
 	src -= 8;
 	for (i = 0; i < 8; i++) {
+		if (!(src[1] | src[2] | src[3] | src[4] | src[5] | src[6] | src[7])) {
+			v0 = BYTECLIP((src[0] + (128L << 8)) >> 8);	/* No AC element in this row, fill it with the DC value */
+			dst[0] = v0; dst[1] = v0; dst[2] = v0; dst[3] = v0;
+			dst[4] = v0; dst[5] = v0; dst[6] = v0; dst[7] = v0;
+			dst += 8;
+			src += 8;	/* Next row */
+			continue;
+		}
+
 		v0 = src[0] + (128L << 8);	/* Get even elements (remove DC offset (-128) here) */
 		v1 = src[2];
 		v2 = src[4];
@@ -479,15 +553,14 @@ void block_idct (
 
 static
 JRESULT mcu_load (
-	JDEC* jd		/* Pointer to the decompressor object */
+	JDEC* jd,		/* Pointer to the decompressor object */
+	UINT skip		/* 1: Only walk the huffman stream, the MCU is not output */
 )
 {
 	LONG *tmp = (LONG*)jd->workbuf;	/* Block working buffer for de-quantize and IDCT */
-	UINT blk, nby, nbc, i, z, id, cmp;
+	UINT blk, nby, nbc, i, z, id, cmp, walk;
 	INT b, d, e;
 	BYTE *bp;
-	const BYTE *hb, *hd;
-	const WORD *hc;
 	const LONG *dqf;
 
 
@@ -498,12 +571,10 @@ JRESULT mcu_load (
 	for (blk = 0; blk < nby + nbc; blk++) {
 		cmp = (blk < nby) ? 0 : blk - nby + 1;	/* Component number 0:Y, 1:Cb, 2:Cr */
 		id = cmp ? 1 : 0;						/* Huffman table ID of the component */
+		walk = skip || (cmp && jd->format == JD_FMT_Y8);	/* Chroma is not used for luminance output */
 
 		/* Extract a DC element from input stream */
-		hb = jd->huffbits[id][0];				/* Huffman table for the DC element */
-		hc = jd->huffcode[id][0];
-		hd = jd->huffdata[id][0];
-		b = huffext(jd, hb, hc, hd);			/* Extract a huffman coded data (bit length) */
+		b = huffext(jd, id, 0);					/* Extract a huffman coded data (bit length) */
 		if (b < 0) return 0 - b;				/* Err: invalid code or input */
 		d = jd->dcv[cmp];						/* DC value of previous block */
 		if (b) {								/* If there is any difference from previous block */
@@ -515,16 +586,15 @@ JRESULT mcu_load (
 			jd->dcv[cmp] = (SHORT)d;			/* Save current DC value for next block */
 		}
 		dqf = jd->qttbl[jd->qtid[cmp]];			/* De-quantizer table ID for this component */
-		tmp[0] = d * dqf[0] >> 8;				/* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+		if (!walk) {
+			tmp[0] = d * dqf[0] >> 8;			/* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+			for (i = 1; i < 64; i++) tmp[i] = 0;/* Clear rest of elements */
+		}
 
 		/* Extract following 63 AC elements from input stream */
-		for (i = 1; i < 64; i++) tmp[i] = 0;	/* Clear rest of elements */
-		hb = jd->huffbits[id][1];				/* Huffman table for the AC elements */
-		hc = jd->huffcode[id][1];
-		hd = jd->huffdata[id][1];
 		i = 1;					/* Top of the AC elements */
 		do {
-			b = huffext(jd, hb, hc, hd);		/* Extract a huffman coded value (zero runs and bit length) */
+			b = huffext(jd, id, 1);				/* Extract a huffman coded value (zero runs and bit length) */
 			if (b == 0) break;					/* EOB? */
 			if (b < 0) return 0 - b;			/* Err: invalid code or input error */
 			z = (UINT)b >> 4;					/* Number of leading zero elements */
@@ -535,6 +605,7 @@ JRESULT mcu_load (
 			if (b &= 0x0F) {					/* Bit length */
 				d = bitext(jd, b);				/* Extract data bits */
 				if (d < 0) return 0 - d;		/* Err: input device */
+				if (walk) continue;				/* Only the bits are consumed */
 				b = 1 << (b - 1);				/* MSB position */
 				if (!(d & b)) d -= (b << 1) - 1;/* Restore negative value if needed */
 				z = ZIG(i);						/* Zigzag-order to raster-order converted index */
@@ -542,6 +613,8 @@ JRESULT mcu_load (
 			}
 		} while (++i < 64);		/* Next AC element */
 
+		if (walk) continue;		/* No IDCT for an MCU that is not output or an unused chroma block */
+
 		if (JD_USE_SCALE && jd->scale == 3)
 			*bp = (*tmp / 256) + 128;	/* If scale ratio is 1/8, IDCT can be ommited and only DC element is used */
 		else
@@ -557,7 +630,7 @@ JRESULT mcu_load (
 
 
 /*-----------------------------------------------------------------------*/
-/* Output an MCU: Convert YCrCb to RGB and output it in RGB form         */
+/* Output an MCU: Convert YCrCb to RGB and output it in jd->format       */
 /*-----------------------------------------------------------------------*/
 
 static
@@ -569,7 +642,7 @@ JRESULT mcu_output (
 )
 {
 	const INT CVACC = (sizeof (INT) > 2) ? 1024 : 128;
-	UINT ix, iy, mx, my, rx, ry;
+	UINT ix, iy, mx, my, rx, ry, nc;
 	INT yy, cb, cr;
 	BYTE *py, *pc, *rgb24;
 	JRECT rect;
@@ -585,36 +658,52 @@ JRESULT mcu_output (
 	}
 	rect.left = x; rect.right = x + rx - 1;				/* Rectangular area in the frame buffer */
 	rect.top = y; rect.bottom = y + ry - 1;
+	nc = (jd->format == JD_FMT_Y8) ? 1 : 3;				/* Number of components in the working buffer (Y or RGB) */
 
 
 	if (!JD_USE_SCALE || jd->scale != 3) {	/* Not for 1/8 scaling */
 
-		/* Build an RGB MCU from discrete comopnents */
 		rgb24 = (BYTE*)jd->workbuf;
-		for (iy = 0; iy < my; iy++) {
-			pc = jd->mcubuf;
-			py = pc + iy * 8;
-			if (my == 16) {		/* Double block height? */
-				pc += 64 * 4 + (iy >> 1) * 8;
-				if (iy >= 8) py += 64;
-			} else {			/* Single block height */
-				pc += mx * 8 + iy * 8;
-			}
-			for (ix = 0; ix < mx; ix++) {
-				cb = pc[0] - 128; 	/* Get Cb/Cr component and restore right level */
-				cr = pc[64] - 128;
-				if (mx == 16) {					/* Double block width? */
-					if (ix == 8) py += 64 - 8;	/* Jump to next block if double block heigt */
-					pc += ix & 1;				/* Increase chroma pointer every two pixels */
-				} else {						/* Single block width */
-					pc++;						/* Increase chroma pointer every pixel */
+		if (nc == 1) {
+
+			/* Build a luminance MCU from the Y blocks */
+			for (iy = 0; iy < my; iy++) {
+				py = jd->mcubuf + iy * 8;
+				if (iy >= 8) py += 64;			/* Lower blocks of double block height */
+				for (ix = 0; ix < mx; ix++) {
+					if (ix == 8) py += 64 - 8;	/* Jump to next block if double block width */
+					*rgb24++ = *py++;
 				}
-				yy = *py++;			/* Get Y component */
+			}
 
-				/* Convert YCbCr to RGB */
-				*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb) / CVACC);
+		} else {
+
+			/* Build an RGB MCU from discrete comopnents */
+			for (iy = 0; iy < my; iy++) {
+				pc = jd->mcubuf;
+				py = pc + iy * 8;
+				if (my == 16) {		/* Double block height? */
+					pc += 64 * 4 + (iy >> 1) * 8;
+					if (iy >= 8) py += 64;
+				} else {			/* Single block height */
+					pc += mx * 8 + iy * 8;
+				}
+				for (ix = 0; ix < mx; ix++) {
+					cb = pc[0] - 128; 	/* Get Cb/Cr component and restore right level */
+					cr = pc[64] - 128;
+					if (mx == 16) {					/* Double block width? */
+						if (ix == 8) py += 64 - 8;	/* Jump to next block if double block heigt */
+						pc += ix & 1;				/* Increase chroma pointer every two pixels */
+					} else {						/* Single block width */
+						pc++;						/* Increase chroma pointer every pixel */
+					}
+					yy = *py++;			/* Get Y component */
+
+					/* Convert YCbCr to RGB */
+					*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr) / CVACC);
+					*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
+					*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb) / CVACC);
+				}
 			}
 		}
 
@@ -626,23 +715,27 @@ JRESULT mcu_output (
 			/* Get averaged RGB value of each square correcponds to a pixel */
 			s = jd->scale * 2;	/* Bumber of shifts for averaging */
 			w = 1 << jd->scale;	/* Width of square */
-			a = (mx - w) * 3;	/* Bytes to skip for next line in the square */
+			a = (mx - w) * nc;	/* Bytes to skip for next line in the square */
 			op = (BYTE*)jd->workbuf;
 			for (iy = 0; iy < my; iy += w) {
 				for (ix = 0; ix < mx; ix += w) {
-					rgb24 = (BYTE*)jd->workbuf + (iy * mx + ix) * 3;
+					rgb24 = (BYTE*)jd->workbuf + (iy * mx + ix) * nc;
 					r = g = b = 0;
 					for (y = 0; y < w; y++) {	/* Accumulate RGB value in the square */
 						for (x = 0; x < w; x++) {
 							r += *rgb24++;
-							g += *rgb24++;
-							b += *rgb24++;
+							if (nc == 3) {
+								g += *rgb24++;
+								b += *rgb24++;
+							}
 						}
 						rgb24 += a;
 					}							/* Put the averaged RGB value as a pixel */
 					*op++ = (BYTE)(r >> s);
-					*op++ = (BYTE)(g >> s);
-					*op++ = (BYTE)(b >> s);
+					if (nc == 3) {
+						*op++ = (BYTE)(g >> s);
+						*op++ = (BYTE)(b >> s);
+					}
 				}
 			}
 		}
@@ -661,6 +754,11 @@ JRESULT mcu_output (
 				yy = *py;	/* Get Y component */
 				py += 64;
 
+				if (nc == 1) {	/* Luminance only */
+					*rgb24++ = (BYTE)yy;
+					continue;
+				}
+
 				/* Convert YCbCr to RGB */
 				*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr / CVACC));
 				*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
@@ -677,30 +775,49 @@ JRESULT mcu_output (
 
 		s = d = (BYTE*)jd->workbuf;
 		for (y = 0; y < ry; y++) {
-			for (x = 0; x < rx; x++) {	/* Copy effective pixels */
-				*d++ = *s++;
-				*d++ = *s++;
+			for (x = 0; x < rx * nc; x++) {	/* Copy effective pixels */
 				*d++ = *s++;
 			}
-			s += (mx - rx) * 3;	/* Skip truncated pixels */
+			s += (mx - rx) * nc;	/* Skip truncated pixels */
 		}
 	}
 
-	/* Convert RGB888 to RGB565 if needed */
-	if (JD_FORMAT == 1) {
-		BYTE *s = (BYTE*)jd->workbuf;
-		WORD w, *d = (WORD*)s;
+	/* Convert RGB888 to the output format if needed */
+	if (jd->format == JD_FMT_RGB565_LE || jd->format == JD_FMT_RGB565_BE) {
+		BYTE *s = (BYTE*)jd->workbuf, *d = s;
+		WORD w;
+		UINT n = rx * ry;
+
+		if (jd->format == JD_FMT_RGB565_LE) {
+			do {
+				w = (s[0] & 0xF8) << 8;		/* RRRRR----------- */
+				w |= (s[1] & 0xFC) << 3;	/* -----GGGGGG----- */
+				w |= s[2] >> 3;				/* -----------BBBBB */
+				s += 3;
+				*d++ = (BYTE)w;				/* Low byte first */
+				*d++ = (BYTE)(w >> 8);
+			} while (--n);
+		} else {
+			do {
+				w = (s[0] & 0xF8) << 8;
+				w |= (s[1] & 0xFC) << 3;
+				w |= s[2] >> 3;
+				s += 3;
+				*d++ = (BYTE)(w >> 8);		/* High byte first */
+				*d++ = (BYTE)w;
+			} while (--n);
+		}
+	} else if (jd->format == JD_FMT_BGR888) {
+		BYTE *s = (BYTE*)jd->workbuf, c;
 		UINT n = rx * ry;
 
 		do {
-			w = (*s++ & 0xF8) << 8;		/* RRRRR----------- */
-			w |= (*s++ & 0xFC) << 3;	/* -----GGGGGG----- */
-			w |= *s++ >> 3;				/* -----------BBBBB */
-			*d++ = w;
+			c = s[0]; s[0] = s[2]; s[2] = c;	/* Swap R and B */
+			s += 3;
 		} while (--n);
 	}
 
-	/* Output the RGB rectangular */
+	/* Output the rectangular */
 	return outfunc(jd, jd->workbuf, &rect) ? JDR_OK : JDR_INTR; 
 }
 
@@ -719,24 +836,31 @@ JRESULT restart (
 {
 	UINT i, dc;
 	WORD d;
-	BYTE *dp;
+	const BYTE *dp;
 
 
-	/* Discard padding bits and get two bytes from the input stream */
-	dp = jd->dptr; dc = jd->dctr;
-	d = 0;
-	for (i = 0; i < 2; i++) {
-		if (!dc) {	/* No input data is available, re-fill input buffer */
-			dp = jd->inbuf;
-			dc = jd->infunc(jd, dp, JD_SZBUF);
-			if (!dc) return JDR_INP;
-		} else {
-			dp++;
+	/* Discard padding bits, whole bytes left in the bit buffer are no marker */
+	if (jd->dbit >= 8) return JDR_FMT1;	/* Err: expected RSTn marker is not detected (may be collapted data) */
+	jd->dbit = 0;
+
+	if (jd->marker) {	/* The bit buffer has read up to the marker */
+		d = 0xFF00 | jd->marker;
+		jd->marker = 0;
+	} else {			/* Get two bytes from the input stream */
+		dp = jd->dptr; dc = jd->dctr;
+		d = 0;
+		for (i = 0; i < 2; i++) {
+			if (!dc) {	/* No input data is available, re-fill input buffer */
+				dc = refill(jd, &dp);
+				if (!dc) return JDR_INP;
+			} else {
+				dp++;
+			}
+			dc--;
+			d = (d << 8) | *dp;	/* Get a byte */
 		}
-		dc--;
-		d = (d << 8) | *dp;	/* Get a byte */
+		jd->dptr = dp; jd->dctr = dc;
 	}
-	jd->dptr = dp; jd->dctr = dc; jd->dmsk = 0;
 
 	/* Check the marker */
 	if ((d & 0xFFD8) != 0xFFD0 || (d & 7) != (rstn & 7))
@@ -751,6 +875,56 @@ JRESULT restart (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Skip a restart interval without decoding it                           */
+/*-----------------------------------------------------------------------*/
+
+static
+JRESULT skip_interval (
+	JDEC* jd,	/* Pointer to the decompressor object */
+	WORD rstn	/* Restart sequence number at the end of the interval */
+)
+{
+	UINT dc, f;
+	BYTE d;
+	const BYTE *dp;
+
+
+	jd->dbit = 0;	/* Nothing of the interval is decoded */
+	if (jd->marker) {	/* The bit buffer has read up to the marker */
+		d = jd->marker;
+		jd->marker = 0;
+	} else {	/* Search the RSTn marker, data 0xFF in the stream is followed by 0x00 */
+		dp = jd->dptr; dc = jd->dctr;
+		f = 0;
+		for (;;) {
+			if (!dc) {	/* No input data is available, re-fill input buffer */
+				dc = refill(jd, &dp);
+				if (!dc) return JDR_INP;
+			} else {
+				dp++;
+			}
+			dc--;
+			if (f && (*dp & 0xF8) == 0xD0) break;	/* RSTn marker found */
+			f = (*dp == 0xFF);
+		}
+		jd->dptr = dp; jd->dctr = dc;
+		d = *dp;
+	}
+
+	/* Check the marker */
+	if ((d & 0xF8) != 0xD0 || (d & 7) != (rstn & 7))
+		return JDR_FMT1;	/* Err: expected RSTn marker is not detected (may be collapted data) */
+
+	/* Reset DC offset */
+	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;
+
+	return JDR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Analyze the JPEG image and Initialize decompressor object             */
 /*-----------------------------------------------------------------------*/
@@ -758,8 +932,9 @@ JRESULT restart (
 #define	LDB_WORD(ptr)		(WORD)(((WORD)*((BYTE*)(ptr))<<8)|(WORD)*(BYTE*)((ptr)+1))
 
 
-JRESULT jd_prepare (
-	JDEC* jd,			/* Blank decompressor object */
+static
+JRESULT prepare (
+	JDEC* jd,			/* Blank decompressor object, memory input is set up */
 	UINT (*infunc)(JDEC*, BYTE*, UINT),	/* JPEG strem input function */
 	void* pool,			/* Working buffer for the decompression session */
 	UINT sz_pool,		/* Size of working buffer */
@@ -780,12 +955,17 @@ JRESULT jd_prepare (
 	jd->infunc = infunc;	/* Stream input function */
 	jd->device = dev;		/* I/O device identifier */
 	jd->nrst = 0;			/* No restart interval (default) */
+	jd->nmcu = 0;			/* Stream input starts at the first MCU */
+	jd->format = JD_FORMAT;	/* Output pixel format, the application can change it before jd_decomp() */
+	jd->width = 0;			/* No SOF0 yet, SOS checks it before the tables of the components */
+	jd->height = 0;
 
 	for (i = 0; i < 2; i++) {	/* Nulls pointers */
 		for (j = 0; j < 2; j++) {
 			jd->huffbits[i][j] = 0;
 			jd->huffcode[i][j] = 0;
 			jd->huffdata[i][j] = 0;
+			jd->hufflut[i][j] = 0;
 		}
 	}
 	for (i = 0; i < 4; i++) jd->qttbl[i] = 0;
@@ -891,7 +1071,9 @@ JRESULT jd_prepare (
 			if (!jd->mcubuf) return JDR_MEM1;			/* Err: not enough memory */
 
 			/* Pre-load the JPEG data to extract it from the bit stream */
-			jd->dptr = seg; jd->dctr = 0; jd->dmsk = 0;	/* Prepare to read bit stream */
+			jd->dptr = seg; jd->dctr = 0;				/* Prepare to read bit stream */
+			jd->wreg = 0; jd->dbit = 0; jd->marker = 0;
+			if (jd->mem) return JDR_OK;					/* Memory input is read in place from the first refill */
 			if (ofs %= JD_SZBUF) {						/* Align read offset to JD_SZBUF */
 				jd->dctr = jd->infunc(jd, seg + ofs, JD_SZBUF - (UINT)ofs);
 				jd->dptr = seg + ofs - 1;
@@ -925,6 +1107,63 @@ JRESULT jd_prepare (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Analyze the JPEG image and Initialize decompressor object             */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_prepare (
+	JDEC* jd,			/* Blank decompressor object */
+	UINT (*infunc)(JDEC*, BYTE*, UINT),	/* JPEG strem input function */
+	void* pool,			/* Working buffer for the decompression session */
+	UINT sz_pool,		/* Size of working buffer */
+	void* dev			/* I/O device identifier for the session */
+)
+{
+	jd->mem = 0;		/* Input through infunc */
+	jd->szmem = 0;
+	return prepare(jd, infunc, pool, sz_pool, dev);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read the headers from a JPEG image in memory                          */
+/*-----------------------------------------------------------------------*/
+
+static
+UINT mem_input (	/* Number of bytes read or skipped */
+	JDEC* jd,		/* Pointer to the decompressor object */
+	BYTE* buff,		/* Pointer to the read buffer (0:skip) */
+	UINT nd			/* Number of bytes to read or skip */
+)
+{
+	if (nd > jd->szmem) nd = jd->szmem;
+	if (buff) memcpy(buff, jd->mem, nd);
+	jd->mem += nd; jd->szmem -= nd;
+	return nd;
+}
+
+
+JRESULT jd_prepare_mem (
+	JDEC* jd,			/* Blank decompressor object */
+	const BYTE* data,	/* The whole JPEG image, it is not written */
+	UINT ndata,			/* Size of the JPEG image */
+	void* pool,			/* Working buffer for the decompression session */
+	UINT sz_pool,		/* Size of working buffer */
+	void* dev			/* I/O device identifier for the session */
+)
+{
+	if (!data) return JDR_PAR;
+
+	jd->mem = data;		/* The headers are copied, the bit stream is read in place */
+	jd->szmem = ndata;
+	return prepare(jd, mem_input, pool, sz_pool, dev);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Start to decompress the JPEG picture                                  */
 /*-----------------------------------------------------------------------*/
@@ -935,36 +1174,146 @@ JRESULT jd_decomp (
 	BYTE scale								/* Output de-scaling factor (0 to 3) */
 )
 {
-	UINT x, y, mx, my;
+	return jd_decomp_rect(jd, outfunc, scale, 0);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress only the MCUs that cover a rectangle of the picture        */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_decomp_rect (
+	JDEC* jd,								/* Initialized decompression object */
+	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* RGB output function */
+	BYTE scale,								/* Output de-scaling factor (0 to 3) */
+	const JRECT* rect						/* Area in the de-scaled picture to output (0:all) */
+)
+{
+	UINT n, i, nx, ny, mx, my, cl, cr, ct, cb, last;
 	WORD rst, rsc;
 	JRESULT rc;
 
 
 	if (scale > (JD_USE_SCALE ? 3 : 0)) return JDR_PAR;
+	if (jd->format > JD_FMT_Y8) return JDR_PAR;
 	jd->scale = scale;
 
 	mx = jd->msx * 8; my = jd->msy * 8;			/* Size of the MCU (pixel) */
+	nx = (jd->width + mx - 1) / mx;				/* Number of MCUs in a row and in a column */
+	ny = (jd->height + my - 1) / my;
+
+	cl = ct = 0; cr = nx - 1; cb = ny - 1;		/* MCU columns and rows to output */
+	if (rect) {
+		if (rect->left > rect->right || rect->top > rect->bottom) return JDR_PAR;
+		cl = ((UINT)rect->left << scale) / mx; cr = ((UINT)rect->right << scale) / mx;
+		ct = ((UINT)rect->top << scale) / my; cb = ((UINT)rect->bottom << scale) / my;
+		if (cr >= nx || cb >= ny) return JDR_PAR;	/* Err: rectangle is out of the picture */
+	}
+	last = cb * nx + cr;						/* Nothing is decoded after this MCU */
 
 	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;	/* Initialize DC values */
 	rst = rsc = 0;
 
 	rc = JDR_OK;
-	for (y = 0; y < jd->height; y += my) {		/* Vertical loop of MCUs */
-		for (x = 0; x < jd->width; x += mx) {	/* Horizontal loop of MCUs */
-			if (jd->nrst && rst++ == jd->nrst) {	/* Process restart interval if enabled */
-				rc = restart(jd, rsc++);
+	for (n = 0; n <= last; n++) {				/* MCUs in raster order */
+		if (jd->nrst && rst++ == jd->nrst) {	/* Process restart interval if enabled */
+			rc = restart(jd, rsc++);
+			if (rc != JDR_OK) return rc;
+			rst = 1;
+		}
+		if (rect && jd->nrst && rst == 1) {		/* Skip the interval if none of its MCUs is output */
+			for (i = n; i < n + jd->nrst && i <= last; i++) {
+				if (i / nx >= ct && i % nx >= cl && i % nx <= cr) break;
+			}
+			if (i == n + jd->nrst) {
+				rc = skip_interval(jd, rsc++);
 				if (rc != JDR_OK) return rc;
-				rst = 1;
+				n += jd->nrst - 1;
+				rst = 0;
+				continue;
 			}
-			rc = mcu_load(jd);					/* Load an MCU (decompress huffman coded stream and apply IDCT) */
-			if (rc != JDR_OK) return rc;
-			rc = mcu_output(jd, outfunc, x, y);	/* Output the MCU (color space conversion, scaling and output) */
+		}
+		i = n / nx >= ct && n % nx >= cl && n % nx <= cr;	/* Is the MCU output? */
+		rc = mcu_load(jd, !i);					/* Load an MCU (decompress huffman coded stream and apply IDCT) */
+		if (rc != JDR_OK) return rc;
+		if (i) {
+			rc = mcu_output(jd, outfunc, n % nx * mx, n / nx * my);	/* Output the MCU (color space conversion, scaling and output) */
 			if (rc != JDR_OK) return rc;
 		}
 	}
 
 	return rc;
 }
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress the MCUs of an image in memory that is still being written */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_decomp_stream (	/* JDR_OK:all MCUs are output, JDR_INP:the next MCU needs more data */
+	JDEC* jd,								/* Object initialized by jd_prepare_mem() */
+	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* RGB output function */
+	BYTE scale,								/* Output de-scaling factor (0 to 3), the same every call */
+	UINT ndata								/* Number of bytes written after the data of the last call */
+)
+{
+	UINT nx, ny, mx, my, dctr, szmem;
+	const BYTE *dptr, *mem;
+	DWORD wreg;
+	BYTE dbit, marker;
+	SHORT dcv[3];
+	WORD rst, rsc;
+	JRESULT rc;
+
+
+	if (!jd->mem) return JDR_PAR;				/* Err: the input is not in memory */
+	if (scale > (JD_USE_SCALE ? 3 : 0)) return JDR_PAR;
+	if (jd->format > JD_FMT_Y8) return JDR_PAR;
+	jd->scale = scale;
+	jd->szmem += ndata;							/* The new data follows the rest in place */
+
+	mx = jd->msx * 8; my = jd->msy * 8;			/* Size of the MCU (pixel) */
+	nx = (jd->width + mx - 1) / mx;				/* Number of MCUs in a row and in a column */
+	ny = (jd->height + my - 1) / my;
+
+	if (!jd->nmcu) {							/* First call: initialize DC values */
+		jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;
+		jd->rst = jd->rsc = 0;
+	}
+
+	while (jd->nmcu < nx * ny) {				/* MCUs in raster order */
+		dctr = jd->dctr; dptr = jd->dptr;		/* Save the input state, the MCU is decompressed again if its data ends */
+		mem = jd->mem; szmem = jd->szmem;
+		wreg = jd->wreg; dbit = jd->dbit; marker = jd->marker;
+		dcv[0] = jd->dcv[0]; dcv[1] = jd->dcv[1]; dcv[2] = jd->dcv[2];
+		rst = jd->rst; rsc = jd->rsc;
+
+		rc = JDR_OK;
+		if (jd->nrst && jd->rst++ == jd->nrst) {	/* Process restart interval if enabled */
+			rc = restart(jd, jd->rsc++);
+			jd->rst = 1;
+		}
+		if (rc == JDR_OK) rc = mcu_load(jd, 0);	/* Load an MCU (decompress huffman coded stream and apply IDCT) */
+		if (rc == JDR_INP) {					/* The data ends in this MCU: back to its start until more is written */
+			jd->dctr = dctr; jd->dptr = dptr;
+			jd->mem = mem; jd->szmem = szmem;
+			jd->wreg = wreg; jd->dbit = dbit; jd->marker = marker;
+			jd->dcv[0] = dcv[0]; jd->dcv[1] = dcv[1]; jd->dcv[2] = dcv[2];
+			jd->rst = rst; jd->rsc = rsc;
+			return JDR_INP;
+		}
+		if (rc != JDR_OK) return rc;
+		rc = mcu_output(jd, outfunc, jd->nmcu % nx * mx, jd->nmcu / nx * my);	/* Output the MCU (color space conversion, scaling and output) */
+		if (rc != JDR_OK) return rc;
+		jd->nmcu++;
+	}
+
+	return JDR_OK;
+}
 #endif//SUPPORT_JPEG
 
 
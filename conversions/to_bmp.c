@@ -28,6 +28,8 @@
 #include "esp32s2/spiram.h"
 #elif CONFIG_IDF_TARGET_ESP32S3
 #include "esp32s3/spiram.h"
+#elif CONFIG_IDF_TARGET_LINUX
+// host build, no PSRAM
 #else 
 #error Target CONFIG_IDF_TARGET is not supported
 #endif
@@ -66,7 +68,7 @@ typedef struct {
         uint16_t width;
         uint16_t height;
         uint16_t data_offset;
-        const uint8_t *input;
+        uint8_t bpp;//bytes per pixel of the output format
         uint8_t *output;
 } rgb_jpg_decoder;
 
@@ -75,7 +77,7 @@ static void *_malloc(size_t size)
     return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
 }
 
-//output buffer and image width
+//output buffer and image width, the decoder writes the blocks in the output format
 static bool _rgb_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
 {
     rgb_jpg_decoder * jpeg = (rgb_jpg_decoder *)arg;
@@ -86,7 +88,7 @@ static bool _rgb_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t
             jpeg->height = h;
             //if output is null, this is BMP
             if(!jpeg->output){
-                jpeg->output = (uint8_t *)_malloc((w*h*3)+jpeg->data_offset);
+                jpeg->output = (uint8_t *)_malloc((w*h*jpeg->bpp)+jpeg->data_offset);
                 if(!jpeg->output){
                     return false;
                 }
@@ -97,96 +99,28 @@ static bool _rgb_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t
         return true;
     }
 
-    size_t jw = jpeg->width*3;
-    size_t t = y * jw;
-    size_t b = t + (h * jw);
-    size_t l = x * 3;
-    uint8_t *out = jpeg->output+jpeg->data_offset;
-    uint8_t *o = out;
-    size_t iy, ix;
-
-    w = w * 3;
-
-    for(iy=t; iy<b; iy+=jw) {
-        o = out+iy+l;
-        for(ix=0; ix<w; ix+= 3) {
-            o[ix] = data[ix+2];
-            o[ix+1] = data[ix+1];
-            o[ix+2] = data[ix];
-        }
-        data+=w;
-    }
-    return true;
-}
-
-static bool _rgb565_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
-{
-    rgb_jpg_decoder * jpeg = (rgb_jpg_decoder *)arg;
-    if(!data){
-        if(x == 0 && y == 0){
-            //write start
-            jpeg->width = w;
-            jpeg->height = h;
-            //if output is null, this is BMP
-            if(!jpeg->output){
-                jpeg->output = (uint8_t *)_malloc((w*h*3)+jpeg->data_offset);
-                if(!jpeg->output){
-                    return false;
-                }
-            }
-        } else {
-            //write end
-        }
-        return true;
-    }
+    size_t jw = jpeg->width*jpeg->bpp;
+    size_t bw = w*jpeg->bpp;
+    uint8_t *o = jpeg->output+jpeg->data_offset+(y*jw)+(x*jpeg->bpp);
 
-    size_t jw = jpeg->width*3;
-    size_t jw2 = jpeg->width*2;
-    size_t t = y * jw;
-    size_t t2 = y * jw2;
-    size_t b = t + (h * jw);
-    size_t l = x * 2;
-    uint8_t *out = jpeg->output+jpeg->data_offset;
-    uint8_t *o = out;
-    size_t iy, iy2, ix, ix2;
-
-    w = w * 3;
-
-    for(iy=t, iy2=t2; iy<b; iy+=jw, iy2+=jw2) {
-        o = out+iy2+l;
-        for(ix2=ix=0; ix<w; ix+= 3, ix2 +=2) {
-            uint16_t r = data[ix];
-            uint16_t g = data[ix+1];
-            uint16_t b = data[ix+2];
-            uint16_t c = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
-            o[ix2+1] = c>>8;
-            o[ix2] = c&0xff;
-        }
-        data+=w;
+    for(uint16_t iy=0; iy<h; iy++) {
+        memcpy(o, data, bw);
+        o+=jw;
+        data+=bw;
     }
     return true;
 }
 
-//input buffer
-static uint32_t _jpg_read(void * arg, size_t index, uint8_t *buf, size_t len)
-{
-    rgb_jpg_decoder * jpeg = (rgb_jpg_decoder *)arg;
-    if(buf) {
-        memcpy(buf, jpeg->input + index, len);
-    }
-    return len;
-}
-
 static bool jpg2rgb888(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale)
 {
     rgb_jpg_decoder jpeg;
     jpeg.width = 0;
     jpeg.height = 0;
-    jpeg.input = src;
     jpeg.output = out;
     jpeg.data_offset = 0;
+    jpeg.bpp = 3;
 
-    if(esp_jpg_decode(src_len, scale, _jpg_read, _rgb_write, (void*)&jpeg) != ESP_OK){
+    if(esp_jpg_decode_mem_format(src, src_len, scale, JPG_FORMAT_BGR888, _rgb_write, (void*)&jpeg) != ESP_OK){
         return false;
     }
     return true;
@@ -197,27 +131,198 @@ bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t s
     rgb_jpg_decoder jpeg;
     jpeg.width = 0;
     jpeg.height = 0;
-    jpeg.input = src;
     jpeg.output = out;
     jpeg.data_offset = 0;
+    jpeg.bpp = 2;
 
-    if(esp_jpg_decode(src_len, scale, _jpg_read, _rgb565_write, (void*)&jpeg) != ESP_OK){
+    if(esp_jpg_decode_mem_format(src, src_len, scale, JPG_FORMAT_RGB565_LE, _rgb_write, (void*)&jpeg) != ESP_OK){
         return false;
     }
     return true;
 }
 
+// Area-weighted box filter from the scaled decode to the output size, fused with the pixel format.
+// Every decoded pixel adds to the one or two output columns and rows it overlaps, weighted in Q12
+// per axis. The MCUs come left to right in rows of up to 16 lines, so only the output rows those
+// can reach are accumulated, in a ring. They are written out once the decode is past their last line.
+#define RESIZE_WEIGHT_BITS 12
+#define RESIZE_RING_ROWS (16 + 2)
+
+typedef struct {
+    uint16_t out;//first output pixel it overlaps
+    uint16_t weight[2];//to that one and the next
+} resize_tap_t;
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    pixformat_t format;
+    const uint8_t *input;
+    uint8_t *output;
+    uint16_t src_width;
+    uint16_t src_height;
+    uint16_t done_rows;//output rows written
+    uint16_t band_top;//first line of the MCU row being decoded
+    resize_tap_t *cols;
+    resize_tap_t *rows;
+    uint32_t *acc;//RESIZE_RING_ROWS rows of width + 1 pixels, R G B
+} jpg_resizer_t;
+
+// position t in output pixels of 1 << RESIZE_WEIGHT_BITS, the pieces of one add up to exactly that
+static inline uint32_t resize_at(uint32_t t, uint16_t src)
+{
+    return ((t / src) << RESIZE_WEIGHT_BITS) + ((t % src) << RESIZE_WEIGHT_BITS) / src;
+}
+
+// src pixel s covers [s * dst, (s + 1) * dst) and output pixel o [o * src, (o + 1) * src)
+static void resize_taps(resize_tap_t *taps, uint16_t src, uint16_t dst)
+{
+    for (uint32_t s = 0; s < src; s++) {
+        uint32_t start = s * dst, end = start + dst;
+        uint32_t o = start / src, edge = (o + 1) * src;
+        taps[s].out = o;
+        taps[s].weight[0] = resize_at(end < edge ? end : edge, src) - resize_at(start, src);
+        taps[s].weight[1] = end > edge ? resize_at(end, src) - resize_at(edge, src) : 0;
+    }
+}
+
+static void resize_emit_row(jpg_resizer_t *r, uint16_t y)
+{
+    uint32_t *acc = r->acc + (size_t)(y % RESIZE_RING_ROWS) * (r->width + 1) * 3;
+    const uint32_t round = 1U << (2 * RESIZE_WEIGHT_BITS - 1);
+    uint8_t *o = r->output;
+    if (r->format == PIXFORMAT_RGB565) {
+        o += (size_t)y * r->width * 2;
+    } else if (r->format == PIXFORMAT_GRAYSCALE) {
+        o += (size_t)y * r->width;
+    } else {
+        o += (size_t)y * r->width * 3;
+    }
+    for (uint16_t x = 0; x < r->width; x++, acc += 3) {
+        uint32_t red = (acc[0] + round) >> (2 * RESIZE_WEIGHT_BITS);
+        uint32_t green = (acc[1] + round) >> (2 * RESIZE_WEIGHT_BITS);
+        uint32_t blue = (acc[2] + round) >> (2 * RESIZE_WEIGHT_BITS);
+        acc[0] = acc[1] = acc[2] = 0;
+        if (r->format == PIXFORMAT_RGB565) {
+            uint16_t c = ((red & 0xF8) << 8) | ((green & 0xFC) << 3) | (blue >> 3);
+            *o++ = c & 0xff;
+            *o++ = c >> 8;
+        } else if (r->format == PIXFORMAT_GRAYSCALE) {
+            *o++ = (red * 77 + green * 150 + blue * 29 + 128) >> 8;
+        } else {
+            *o++ = blue;
+            *o++ = green;
+            *o++ = red;
+        }
+    }
+    // the padding pixel only ever gets zero weights
+    acc[0] = acc[1] = acc[2] = 0;
+}
+
+// writes the output rows that end within the first src_rows decoded lines
+static void resize_emit(jpg_resizer_t *r, uint32_t src_rows)
+{
+    while (r->done_rows < r->height && (uint32_t)(r->done_rows + 1) * r->src_height <= src_rows * r->height) {
+        resize_emit_row(r, r->done_rows++);
+    }
+}
+
+static size_t _resize_read(void * arg, size_t index, uint8_t *buf, size_t len)
+{
+    jpg_resizer_t * r = (jpg_resizer_t *)arg;
+    if(buf) {
+        memcpy(buf, r->input + index, len);
+    }
+    return len;
+}
+
+static bool _resize_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    jpg_resizer_t * r = (jpg_resizer_t *)arg;
+    if(!data){
+        if(x == 0 && y == 0){
+            //write start, w x h is the decode after the DCT scaling
+            //the accumulators follow the taps, word aligned
+            size_t taps_size = ((w + h) * sizeof(resize_tap_t) + 3) & ~(size_t)3;
+            size_t acc_size = (size_t)RESIZE_RING_ROWS * (r->width + 1) * 3 * sizeof(uint32_t);
+            r->src_width = w;
+            r->src_height = h;
+            r->cols = (resize_tap_t *)_malloc(taps_size + acc_size);
+            if(!r->cols){
+                return false;
+            }
+            r->rows = r->cols + w;
+            r->acc = (uint32_t *)((uint8_t *)r->cols + taps_size);
+            memset(r->acc, 0, acc_size);
+            resize_taps(r->cols, w, r->width);
+            resize_taps(r->rows, h, r->height);
+        } else {
+            //write end
+            resize_emit(r, r->src_height);
+        }
+        return true;
+    }
+
+    if (y > r->band_top) {
+        // the MCU row above is complete
+        resize_emit(r, y);
+        r->band_top = y;
+    }
+    size_t stride = (r->width + 1) * 3;
+    for (uint16_t iy = 0; iy < h; iy++) {
+        const resize_tap_t *row = &r->rows[y + iy];
+        uint32_t *acc0 = r->acc + (row->out % RESIZE_RING_ROWS) * stride;
+        uint32_t *acc1 = r->acc + ((row->out + 1) % RESIZE_RING_ROWS) * stride;
+        for (uint16_t ix = 0; ix < w; ix++, data += 3) {
+            const resize_tap_t *col = &r->cols[x + ix];
+            uint32_t *a = acc0 + col->out * 3;
+            for (int c = 0; c < 3; c++) {
+                uint32_t v = data[c] * row->weight[0];
+                a[c] += v * col->weight[0];
+                a[c + 3] += v * col->weight[1];
+            }
+            if (row->weight[1]) {
+                a = acc1 + col->out * 3;
+                for (int c = 0; c < 3; c++) {
+                    uint32_t v = data[c] * row->weight[1];
+                    a[c] += v * col->weight[0];
+                    a[c + 3] += v * col->weight[1];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool jpg2fmt_scaled(const uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t * out)
+{
+    if (format != PIXFORMAT_RGB565 && format != PIXFORMAT_RGB888 && format != PIXFORMAT_GRAYSCALE) {
+        ESP_LOGE(TAG, "Unsupported output format %d", format);
+        return false;
+    }
+    jpg_resizer_t resizer = {
+        .width = width,
+        .height = height,
+        .format = format,
+        .input = src,
+        .output = out,
+    };
+    esp_err_t err = esp_jpg_decode_to_size(src_len, width, height, _resize_read, _resize_write, (void*)&resizer);
+    free(resizer.cols);
+    return err == ESP_OK;
+}
+
 bool jpg2bmp(const uint8_t *src, size_t src_len, uint8_t ** out, size_t * out_len)
 {
 
     rgb_jpg_decoder jpeg;
     jpeg.width = 0;
     jpeg.height = 0;
-    jpeg.input = src;
     jpeg.output = NULL;
     jpeg.data_offset = BMP_HEADER_LEN;
+    jpeg.bpp = 3;
 
-    if(esp_jpg_decode(src_len, JPG_SCALE_NONE, _jpg_read, _rgb_write, (void*)&jpeg) != ESP_OK){
+    if(esp_jpg_decode_mem_format(src, src_len, JPG_SCALE_NONE, JPG_FORMAT_BGR888, _rgb_write, (void*)&jpeg) != ESP_OK){
         return false;
     }
 
@@ -247,55 +352,170 @@ bool jpg2bmp(const uint8_t *src, size_t src_len, uint8_t ** out, size_t * out_le
     return true;
 }
 
+// Batched kernels for the raw formats, they write B, G, R like the per pixel loops they replace.
+// Four pixels take 32-bit loads and three 32-bit stores, the ESP32s and the hosts are little endian.
+// Where the compiler has vector extensions over SSE2 or NEON the loops first take 16 pixels per
+// step, as four groups of four in the lanes of 32-bit vectors, the same packing as the scalar steps.
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_shufflevector) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define CONV_SIMD 1
+#endif
+#endif
+
+// one RGB565 pixel as loaded, high byte first in the low byte, to B, G, R in the low three bytes
+#define RGB565_BGR(w) ((((w) >> 5) & 0xF8) | ((((w) & 0x07) << 13) | (((w) >> 3) & 0x1C00)) | (((w) & 0xF8) << 16))
+
+static inline uint32_t load32(const uint8_t *src)
+{
+    uint32_t w;
+    memcpy(&w, src, sizeof(w));
+    return w;
+}
+
+// p0..p3 hold B, G, R in their low three bytes
+static inline void store_bgr4(uint8_t *dst, uint32_t p0, uint32_t p1, uint32_t p2, uint32_t p3)
+{
+    uint32_t w[3] = { p0 | (p1 << 24), (p1 >> 8) | (p2 << 16), (p2 >> 16) | (p3 << 8) };
+    memcpy(dst, w, sizeof(w));
+}
+
+static inline void store_bgr(uint8_t *dst, uint32_t p)
+{
+    dst[0] = p;
+    dst[1] = p >> 8;
+    dst[2] = p >> 16;
+}
+
+static inline uint32_t yuv_bgr(int y, int r, int g, int b)
+{
+    return yuv_clamp(y + b) | (yuv_clamp(y + g) << 8) | (yuv_clamp(y + r) << 16);
+}
+
+// the two pixels of Y0 U Y1 V as loaded
+static inline void yuv_pair_bgr(uint32_t w, uint32_t *p0, uint32_t *p1)
+{
+    int y0 = w & 0xFF, u = (w >> 8) & 0xFF, y1 = (w >> 16) & 0xFF, v = w >> 24;
+    int r = YUV_VR(v), g = YUV_UG(u) + YUV_VG(v), b = YUV_UB(u);
+    *p0 = yuv_bgr(YUV_Y(y0), r, g, b);
+    *p1 = yuv_bgr(YUV_Y(y1), r, g, b);
+}
+
+#if CONV_SIMD
+typedef uint32_t u32x4_t __attribute__((vector_size(16)));
+typedef int32_t i32x4_t __attribute__((vector_size(16)));
+
+// lane k of p0..p3 holds pixel 4k..4k+3, like the arguments of store_bgr4()
+static inline void simd_store_bgr16(uint8_t *dst, u32x4_t p0, u32x4_t p1, u32x4_t p2, u32x4_t p3)
+{
+    u32x4_t w0 = p0 | (p1 << 24), w1 = (p1 >> 8) | (p2 << 16), w2 = (p2 >> 16) | (p3 << 8);
+    // the words of group k follow each other: w0[k], w1[k], w2[k]
+    u32x4_t w01 = __builtin_shufflevector(w0, w1, 0, 4, 1, 5);
+    u32x4_t w23 = __builtin_shufflevector(w0, w1, 2, 6, 3, 7);
+    u32x4_t out[3] = {
+        __builtin_shufflevector(w01, w2, 0, 1, 4, 2),
+        __builtin_shufflevector(__builtin_shufflevector(w01, w23, 3, 3, 4, 5), w2, 0, 5, 2, 3),
+        __builtin_shufflevector(w23, w2, 6, 2, 3, 7),
+    };
+    memcpy(dst, out, sizeof(out));
+}
+
+static inline u32x4_t simd_clamp(i32x4_t v)
+{
+    // the comparisons give all ones where true, the low byte of -1 is 255
+    return (u32x4_t)((v & (v > 0)) | (v > 255)) & 0xFF;
+}
+
+static inline u32x4_t simd_yuv_bgr(i32x4_t y, i32x4_t r, i32x4_t g, i32x4_t b)
+{
+    return simd_clamp(y + b) | (simd_clamp(y + g) << 8) | (simd_clamp(y + r) << 16);
+}
+
+// four pairs of Y0 U Y1 V as loaded
+static inline void simd_yuv_pair_bgr(u32x4_t w, u32x4_t *p0, u32x4_t *p1)
+{
+    i32x4_t y0 = (i32x4_t)(w & 0xFF), u = (i32x4_t)((w >> 8) & 0xFF), y1 = (i32x4_t)((w >> 16) & 0xFF), v = (i32x4_t)(w >> 24);
+    i32x4_t r = YUV_VR(v), g = YUV_UG(u) + YUV_VG(v), b = YUV_UB(u);
+    *p0 = simd_yuv_bgr(YUV_Y(y0), r, g, b);
+    *p1 = simd_yuv_bgr(YUV_Y(y1), r, g, b);
+}
+#endif
+
+static void rgb565_to_bgr888(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    size_t i = 0;
+#if CONV_SIMD
+    for (; i + 16 <= pixels; i += 16, src += 32, dst += 48) {
+        u32x4_t s[2];
+        memcpy(s, src, sizeof(s));
+        // the even words start the groups of four
+        u32x4_t even = __builtin_shufflevector(s[0], s[1], 0, 2, 4, 6);
+        u32x4_t odd = __builtin_shufflevector(s[0], s[1], 1, 3, 5, 7);
+        simd_store_bgr16(dst, RGB565_BGR(even), RGB565_BGR(even >> 16), RGB565_BGR(odd), RGB565_BGR(odd >> 16));
+    }
+#endif
+    for (; i + 4 <= pixels; i += 4, src += 8, dst += 12) {
+        uint32_t w0 = load32(src), w1 = load32(src + 4);
+        store_bgr4(dst, RGB565_BGR(w0), RGB565_BGR(w0 >> 16), RGB565_BGR(w1), RGB565_BGR(w1 >> 16));
+    }
+    for (; i < pixels; i++, src += 2, dst += 3) {
+        store_bgr(dst, RGB565_BGR(src[0] | (src[1] << 8)));
+    }
+}
+
+static void gray_to_bgr888(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    size_t i = 0;
+#if CONV_SIMD
+    for (; i + 16 <= pixels; i += 16, src += 16, dst += 48) {
+        u32x4_t w;
+        memcpy(&w, src, sizeof(w));
+        simd_store_bgr16(dst, (w & 0xFF) * 0x010101, ((w >> 8) & 0xFF) * 0x010101, ((w >> 16) & 0xFF) * 0x010101, (w >> 24) * 0x010101);
+    }
+#endif
+    for (; i + 4 <= pixels; i += 4, src += 4, dst += 12) {
+        uint32_t w = load32(src);
+        store_bgr4(dst, (w & 0xFF) * 0x010101, ((w >> 8) & 0xFF) * 0x010101, ((w >> 16) & 0xFF) * 0x010101, (w >> 24) * 0x010101);
+    }
+    for (; i < pixels; i++, dst += 3) {
+        store_bgr(dst, *src++ * 0x010101);
+    }
+}
+
+// an odd last pixel is left out, it has no chroma
+static void yuv422_to_bgr888(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    size_t i = 0;
+    pixels &= ~(size_t)1;
+#if CONV_SIMD
+    for (; i + 16 <= pixels; i += 16, src += 32, dst += 48) {
+        u32x4_t s[2], p0, p1, p2, p3;
+        memcpy(s, src, sizeof(s));
+        simd_yuv_pair_bgr(__builtin_shufflevector(s[0], s[1], 0, 2, 4, 6), &p0, &p1);
+        simd_yuv_pair_bgr(__builtin_shufflevector(s[0], s[1], 1, 3, 5, 7), &p2, &p3);
+        simd_store_bgr16(dst, p0, p1, p2, p3);
+    }
+#endif
+    for (; i + 4 <= pixels; i += 4, src += 8, dst += 12) {
+        uint32_t p0, p1, p2, p3;
+        yuv_pair_bgr(load32(src), &p0, &p1);
+        yuv_pair_bgr(load32(src + 4), &p2, &p3);
+        store_bgr4(dst, p0, p1, p2, p3);
+    }
+    yuv422_to_rgb888_row(src, dst, pixels - i);
+}
+
 bool fmt2rgb888(const uint8_t *src_buf, size_t src_len, pixformat_t format, uint8_t * rgb_buf)
 {
-    int pix_count = 0;
     if(format == PIXFORMAT_JPEG) {
         return jpg2rgb888(src_buf, src_len, rgb_buf, JPG_SCALE_NONE);
     } else if(format == PIXFORMAT_RGB888) {
         memcpy(rgb_buf, src_buf, src_len);
     } else if(format == PIXFORMAT_RGB565) {
-        int i;
-        uint8_t hb, lb;
-        pix_count = src_len / 2;
-        for(i=0; i<pix_count; i++) {
-            hb = *src_buf++;
-            lb = *src_buf++;
-            *rgb_buf++ = (lb & 0x1F) << 3;
-            *rgb_buf++ = (hb & 0x07) << 5 | (lb & 0xE0) >> 3;
-            *rgb_buf++ = hb & 0xF8;
-        }
+        rgb565_to_bgr888(src_buf, rgb_buf, src_len / 2);
     } else if(format == PIXFORMAT_GRAYSCALE) {
-        int i;
-        uint8_t b;
-        pix_count = src_len;
-        for(i=0; i<pix_count; i++) {
-            b = *src_buf++;
-            *rgb_buf++ = b;
-            *rgb_buf++ = b;
-            *rgb_buf++ = b;
-        }
+        gray_to_bgr888(src_buf, rgb_buf, src_len);
     } else if(format == PIXFORMAT_YUV422) {
-        pix_count = src_len / 2;
-        int i, maxi = pix_count / 2;
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        for(i=0; i<maxi; i++) {
-            y0 = *src_buf++;
-            u = *src_buf++;
-            y1 = *src_buf++;
-            v = *src_buf++;
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            *rgb_buf++ = b;
-            *rgb_buf++ = g;
-            *rgb_buf++ = r;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            *rgb_buf++ = b;
-            *rgb_buf++ = g;
-            *rgb_buf++ = r;
-        }
+        yuv422_to_bgr888(src_buf, rgb_buf, src_len / 2);
     }
     return true;
 }
@@ -343,44 +563,11 @@ bool fmt2bmp(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
     if(format == PIXFORMAT_RGB888) {
         memcpy(rgb_buf, src_buf, pix_count*3);
     } else if(format == PIXFORMAT_RGB565) {
-        int i;
-        uint8_t hb, lb;
-        for(i=0; i<pix_count; i++) {
-            hb = *src_buf++;
-            lb = *src_buf++;
-            *rgb_buf++ = (lb & 0x1F) << 3;
-            *rgb_buf++ = (hb & 0x07) << 5 | (lb & 0xE0) >> 3;
-            *rgb_buf++ = hb & 0xF8;
-        }
+        rgb565_to_bgr888(src_buf, rgb_buf, pix_count);
     } else if(format == PIXFORMAT_GRAYSCALE) {
-        int i;
-        uint8_t b;
-        for(i=0; i<pix_count; i++) {
-            b = *src_buf++;
-            *rgb_buf++ = b;
-            *rgb_buf++ = b;
-            *rgb_buf++ = b;
-        }
+        gray_to_bgr888(src_buf, rgb_buf, pix_count);
     } else if(format == PIXFORMAT_YUV422) {
-        int i, maxi = pix_count / 2;
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        for(i=0; i<maxi; i++) {
-            y0 = *src_buf++;
-            u = *src_buf++;
-            y1 = *src_buf++;
-            v = *src_buf++;
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            *rgb_buf++ = b;
-            *rgb_buf++ = g;
-            *rgb_buf++ = r;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            *rgb_buf++ = b;
-            *rgb_buf++ = g;
-            *rgb_buf++ = r;
-        }
+        yuv422_to_bgr888(src_buf, rgb_buf, pix_count);
     }
     *out = out_buf;
     *out_len = out_size;
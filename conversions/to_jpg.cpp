@@ -13,13 +13,17 @@
 // limitations under the License.
 #include <stddef.h>
 #include <string.h>
+#include <new>
 #include "esp_attr.h"
 #include "soc/efuse_reg.h"
 #include "esp_heap_caps.h"
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "jpge.h"
-#include "yuv.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 
 #include "esp_system.h"
 #if ESP_IDF_VERSION_MAJOR >= 4 // IDF 4+
@@ -29,6 +33,8 @@
 #include "esp32s2/spiram.h"
 #elif CONFIG_IDF_TARGET_ESP32S3
 #include "esp32s3/spiram.h"
+#elif CONFIG_IDF_TARGET_LINUX
+// host build, no PSRAM
 #else 
 #error Target CONFIG_IDF_TARGET is not supported
 #endif
@@ -53,60 +59,52 @@ static void *_malloc(size_t size)
     return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
 }
 
-static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uint8_t * dst, size_t width, size_t in_channels, size_t line)
+static void *_realloc(void *ptr, size_t size)
 {
-    int i=0, o=0, l=0;
-    if(format == PIXFORMAT_GRAYSCALE) {
-        memcpy(dst, src + line * width, width);
-    } else if(format == PIXFORMAT_RGB888) {
-        l = width * 3;
-        src += l * line;
-        for(i=0; i<l; i+=3) {
-            dst[o++] = src[i+2];
-            dst[o++] = src[i+1];
-            dst[o++] = src[i];
-        }
-    } else if(format == PIXFORMAT_RGB565) {
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=2) {
-            dst[o++] = src[i] & 0xF8;
-            dst[o++] = (src[i] & 0x07) << 5 | (src[i+1] & 0xE0) >> 3;
-            dst[o++] = (src[i+1] & 0x1F) << 3;
-        }
-    } else if(format == PIXFORMAT_YUV422) {
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=4) {
-            y0 = src[i];
-            u = src[i+1];
-            y1 = src[i+2];
-            v = src[i+3];
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-        }
+    void * res = realloc(ptr, size);
+    if(res) {
+        return res;
     }
+    return heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
 }
 
-bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+//bytes the encoder collects before writing them out, callbacks usually send them on as they come
+#ifdef CONFIG_CAMERA_JPG_CB_FLUSH_SIZE
+#define JPG_CB_FLUSH_SIZE CONFIG_CAMERA_JPG_CB_FLUSH_SIZE
+#else
+#define JPG_CB_FLUSH_SIZE 512
+#endif
+#ifdef CONFIG_CAMERA_JPG_MEM_FLUSH_SIZE
+#define JPG_MEM_FLUSH_SIZE CONFIG_CAMERA_JPG_MEM_FLUSH_SIZE
+#else
+#define JPG_MEM_FLUSH_SIZE 2048
+#endif
+
+static int jpg_channels(pixformat_t format)
 {
-    int num_channels = 3;
-    jpge::subsampling_t subsampling = jpge::H2V2;
+    if(format == PIXFORMAT_GRAYSCALE) {
+        return 1;
+    } else if(format == PIXFORMAT_YUV422 || format == PIXFORMAT_RGB565) {
+        //the encoder takes YUYV as it is, at the 4:2:2 of the sensor, and unpacks RGB565 itself
+        return 2;
+    }
+    return 3;
+}
 
+static jpge::subsampling_t jpg_subsampling(pixformat_t format)
+{
     if(format == PIXFORMAT_GRAYSCALE) {
-        num_channels = 1;
-        subsampling = jpge::Y_ONLY;
+        return jpge::Y_ONLY;
+    } else if(format == PIXFORMAT_YUV422) {
+        return jpge::H2V1;
     }
+    return jpge::H2V2;
+}
+
+static bool encoder_setup(jpge::jpeg_encoder *encoder, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::uint flush_size, jpge::uint restart_interval)
+{
+    int num_channels = jpg_channels(format);
+    jpge::subsampling_t subsampling = jpg_subsampling(format);
 
     if(!quality) {
         quality = 1;
@@ -117,38 +115,60 @@ bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t fo
     jpge::params comp_params = jpge::params();
     comp_params.m_subsampling = subsampling;
     comp_params.m_quality = quality;
+    comp_params.m_flush_size = flush_size;
+    comp_params.m_restart_interval = restart_interval;
+    //the encoder reads the frames in place, RGB888 frames are B, G, R and RGB565 big endian
+    comp_params.m_bgr = (format == PIXFORMAT_RGB888);
+    comp_params.m_rgb565 = (format == PIXFORMAT_RGB565);
 
-    jpge::jpeg_encoder dst_image;
-
-    if (!dst_image.init(dst_stream, width, height, num_channels, comp_params)) {
+    if (!encoder->setup(width, height, num_channels, comp_params)) {
         ESP_LOGE(TAG, "JPG encoder init failed");
         return false;
     }
+    return true;
+}
 
-    uint8_t* line = (uint8_t*)_malloc(width * num_channels);
-    if(!line) {
-        ESP_LOGE(TAG, "Scan line malloc failed");
-        return false;
-    }
+//encodes the lines from first to before end of the frame and finishes the image or segment
+static bool encode_lines(jpge::jpeg_encoder *encoder, const uint8_t *src, uint16_t width, uint16_t first, uint16_t end, pixformat_t format)
+{
+    int num_channels = jpg_channels(format);
 
-    for (int i = 0; i < height; i++) {
-        convert_line_format(src, format, line, width, num_channels, i);
-        if (!dst_image.process_scanline(line)) {
+    for (int i = first; i < end; i++) {
+        if (!encoder->process_scanline(src + i * width * num_channels)) {
             ESP_LOGE(TAG, "JPG process line %u failed", i);
-            free(line);
             return false;
         }
     }
-    free(line);
 
-    if (!dst_image.process_scanline(NULL)) {
+    if (!encoder->process_scanline(NULL)) {
         ESP_LOGE(TAG, "JPG image finish failed");
         return false;
     }
-    dst_image.deinit();
     return true;
 }
 
+static bool encode_frame(jpge::jpeg_encoder *encoder, const uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, jpge::output_stream *dst_stream)
+{
+    if (!encoder->start(dst_stream)) {
+        ESP_LOGE(TAG, "JPG encoder start failed");
+        return false;
+    }
+    return encode_lines(encoder, src, width, 0, height, format);
+}
+
+bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream, jpge::uint flush_size)
+{
+    jpge::jpeg_encoder dst_image;
+
+    if (!encoder_setup(&dst_image, width, height, format, quality, flush_size, 0)) {
+        return false;
+    }
+
+    bool ret = encode_frame(&dst_image, src, width, height, format, dst_stream);
+    dst_image.deinit();
+    return ret;
+}
+
 class callback_stream : public jpge::output_stream {
 protected:
     jpg_out_cb ocb;
@@ -163,7 +183,7 @@ public:
         index += ocb(oarg, index, data, len);
         return true;
     }
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
@@ -172,7 +192,7 @@ public:
 bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg)
 {
     callback_stream dst_stream(cb, arg);
-    return convert_image(src, width, height, format, quality, &dst_stream);
+    return convert_image(src, width, height, format, quality, &dst_stream, JPG_CB_FLUSH_SIZE);
 }
 
 bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
@@ -182,13 +202,14 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
 
 
 
+//writes to a buffer of fixed size, what does not fit is only counted
 class memory_stream : public jpge::output_stream {
 protected:
     uint8_t *out_buf;
     size_t max_len, index;
 
 public:
-    memory_stream(void *pBuf, uint buf_size) : out_buf(static_cast<uint8_t*>(pBuf)), max_len(buf_size), index(0) { }
+    memory_stream(void *pBuf, size_t buf_size) : out_buf(static_cast<uint8_t*>(pBuf)), max_len(buf_size), index(0) { }
 
     virtual ~memory_stream() { }
 
@@ -198,48 +219,375 @@ public:
             //end of image
             return true;
         }
-        if ((size_t)len > (max_len - index)) {
-            //ESP_LOGW(TAG, "JPG output overflow: %d bytes (%d,%d,%d)", len - (max_len - index), len, index, max_len);
-            len = max_len - index;
+        if (index < max_len) {
+            size_t copy = ((size_t)len > (max_len - index)) ? (max_len - index) : len;
+            memcpy(out_buf + index, pBuf, copy);
         }
-        if (len) {
-            memcpy(out_buf + index, pBuf, len);
-            index += len;
+        index += len;
+        return true;
+    }
+
+    //the size of the whole image, larger than the buffer if it did not fit
+    virtual jpge::uint get_size() const
+    {
+        return index;
+    }
+};
+
+//writes to a heap buffer that grows as needed and is trimmed to the image at the end
+class growing_stream : public jpge::output_stream {
+protected:
+    uint8_t *out_buf;
+    size_t max_len, index;
+
+public:
+    growing_stream(size_t initial_size) : out_buf(NULL), max_len(initial_size), index(0) { }
+
+    virtual ~growing_stream()
+    {
+        free(out_buf);
+    }
+
+    virtual bool put_buf(const void* pBuf, int len)
+    {
+        if (!pBuf) {
+            //end of image, give back what was not used
+            uint8_t *buf = index ? (uint8_t *)realloc(out_buf, index) : NULL;
+            if (buf) {
+                out_buf = buf;
+            }
+            return true;
+        }
+        if (!out_buf || (size_t)len > (max_len - index)) {
+            size_t new_len = out_buf ? max_len + max_len / 2 : max_len;
+            if (new_len < index + len) {
+                new_len = index + len;
+            }
+            uint8_t *buf = (uint8_t *)_realloc(out_buf, new_len);
+            if (!buf) {
+                ESP_LOGE(TAG, "JPG buffer realloc to %u failed", (unsigned)new_len);
+                return false;
+            }
+            out_buf = buf;
+            max_len = new_len;
         }
+        memcpy(out_buf + index, pBuf, len);
+        index += len;
         return true;
     }
 
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
+
+    const uint8_t *data() const
+    {
+        return out_buf;
+    }
+
+    //allocates the initial size up front
+    bool reserve()
+    {
+        if (!out_buf) {
+            out_buf = (uint8_t *)_malloc(max_len);
+        }
+        return out_buf != NULL;
+    }
+
+    //starts over, keeping the buffer
+    void rewind()
+    {
+        index = 0;
+    }
+
+    //hands the buffer over to the caller
+    uint8_t *release()
+    {
+        uint8_t *buf = out_buf;
+        out_buf = NULL;
+        return buf;
+    }
 };
 
 bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
 {
-    //todo: allocate proper buffer for holding JPEG data
-    //this should be enough for CIF frame size
-    int jpg_buf_len = 128*1024;
+    //a quarter byte per pixel holds most frames up to high quality, the headers take about 600 bytes
+    growing_stream dst_stream((size_t)width * height / 4 + 1024);
 
-
-    uint8_t * jpg_buf = (uint8_t *)_malloc(jpg_buf_len);
-    if(jpg_buf == NULL) {
-        ESP_LOGE(TAG, "JPG buffer malloc failed");
+    if(!convert_image(src, width, height, format, quality, &dst_stream, JPG_MEM_FLUSH_SIZE)) {
         return false;
     }
-    memory_stream dst_stream(jpg_buf, jpg_buf_len);
 
-    if(!convert_image(src, width, height, format, quality, &dst_stream)) {
-        free(jpg_buf);
+    *out_len = dst_stream.get_size();
+    *out = dst_stream.release();
+    return true;
+}
+
+bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+}
+
+bool fmt2jpg_buf(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t * out, size_t out_size, size_t * out_len)
+{
+    memory_stream dst_stream(out, out_size);
+
+    if(!convert_image(src, width, height, format, quality, &dst_stream, JPG_MEM_FLUSH_SIZE)) {
         return false;
     }
 
-    *out = jpg_buf;
     *out_len = dst_stream.get_size();
+    if(*out_len > out_size) {
+        ESP_LOGW(TAG, "JPG output needs %u bytes, the buffer has %u", (unsigned)*out_len, (unsigned)out_size);
+        return false;
+    }
     return true;
 }
 
-bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
+bool frame2jpg_buf(camera_fb_t * fb, uint8_t quality, uint8_t * out, size_t out_size, size_t * out_len)
 {
-    return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+    return fmt2jpg_buf(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_size, out_len);
+}
+
+#define JPG_STRIP_TASK_STACK 4096
+
+//a strip of whole MCU rows, one restart interval, encoded by its own task
+struct jpg_strip_s {
+    jpg_encoder_ctx_t ctx;
+    jpge::jpeg_encoder encoder;
+    growing_stream out;
+    uint16_t first_line;
+    uint16_t end_line;
+    bool ok;
+    QueueHandle_t start;//the frame to encode, NULL to end the task
+    QueueHandle_t done;
+    TaskHandle_t task;
+
+    jpg_strip_s(size_t out_size) : out(out_size) { }
+};
+
+struct jpg_encoder_ctx_s {
+    jpge::jpeg_encoder encoder;
+    uint16_t width;
+    uint16_t height;
+    pixformat_t format;
+    uint16_t end_line;//of the first strip, encoded by the calling task
+    uint8_t strip_cnt;//strips after the first one
+    jpg_strip_s *strips;
+};
+
+static void jpg_strip_task(void *arg)
+{
+    jpg_strip_s *strip = (jpg_strip_s *)arg;
+    jpg_encoder_ctx_t ctx = strip->ctx;
+    const uint8_t *src = NULL;
+
+    while (xQueueReceive(strip->start, &src, portMAX_DELAY) == pdTRUE && src) {
+        strip->out.rewind();
+        strip->ok = strip->encoder.start(&strip->out, jpge::NEXT_SEGMENT)
+                    && encode_lines(&strip->encoder, src, ctx->width, strip->first_line, strip->end_line, ctx->format);
+        xQueueSend(strip->done, &strip->ok, portMAX_DELAY);
+    }
+    strip->ok = false;
+    xQueueSend(strip->done, &strip->ok, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+static void jpg_strip_free(jpg_strip_s *strip)
+{
+    if (strip->task) {
+        const uint8_t *stop = NULL;
+        bool ok;
+        xQueueSend(strip->start, &stop, portMAX_DELAY);
+        xQueueReceive(strip->done, &ok, portMAX_DELAY);
+    }
+    if (strip->start) {
+        vQueueDelete(strip->start);
+    }
+    if (strip->done) {
+        vQueueDelete(strip->done);
+    }
+    strip->~jpg_strip_s();
+}
+
+static bool jpg_strip_init(jpg_encoder_ctx_t ctx, jpg_strip_s *strip, uint8_t quality, jpge::uint restart_interval)
+{
+    strip->ctx = ctx;
+    if (!encoder_setup(&strip->encoder, ctx->width, ctx->height, ctx->format, quality, JPG_MEM_FLUSH_SIZE, restart_interval)) {
+        return false;
+    }
+    if (!strip->out.reserve()) {
+        ESP_LOGE(TAG, "JPG strip buffer malloc failed");
+        return false;
+    }
+    strip->start = xQueueCreate(1, sizeof(const uint8_t *));
+    strip->done = xQueueCreate(1, sizeof(bool));
+    if (!strip->start || !strip->done) {
+        ESP_LOGE(TAG, "JPG strip queue create failed");
+        return false;
+    }
+    //on any core, at the priority of the task that encodes the first strip
+    if (xTaskCreate(jpg_strip_task, "jpg_strip", JPG_STRIP_TASK_STACK, strip, uxTaskPriorityGet(NULL), &strip->task) != pdPASS) {
+        ESP_LOGE(TAG, "JPG strip task create failed");
+        strip->task = NULL;
+        return false;
+    }
+    return true;
+}
+
+jpg_encoder_ctx_t jpg_encoder_create_parallel(uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t strips)
+{
+    if(format != PIXFORMAT_RGB565 && format != PIXFORMAT_RGB888 && format != PIXFORMAT_YUV422 && format != PIXFORMAT_GRAYSCALE) {
+        ESP_LOGE(TAG, "JPG encoder does not take format %d", format);
+        return NULL;
+    }
+    if(!width || !height || !strips) {
+        return NULL;
+    }
+
+    //the strips are the same number of MCU rows, except for the last one
+    jpge::subsampling_t subsampling = jpg_subsampling(format);
+    int mcu_width = (subsampling == jpge::Y_ONLY) ? 8 : 16;
+    int mcu_height = (subsampling == jpge::H2V2) ? 16 : 8;
+    int mcu_rows = (height + mcu_height - 1) / mcu_height;
+    int rows_per_strip = (mcu_rows + strips - 1) / strips;
+    strips = (mcu_rows + rows_per_strip - 1) / rows_per_strip;
+    jpge::uint restart_interval = 0;
+    if(strips > 1) {
+        restart_interval = rows_per_strip * ((width + mcu_width - 1) / mcu_width);
+        if(restart_interval > 0xFFFF) {
+            ESP_LOGE(TAG, "JPG strips of %u MCUs are too long", (unsigned)restart_interval);
+            return NULL;
+        }
+    }
+
+    void *mem = _malloc(sizeof(struct jpg_encoder_ctx_s));
+    if(!mem) {
+        ESP_LOGE(TAG, "JPG encoder malloc failed");
+        return NULL;
+    }
+    jpg_encoder_ctx_t ctx = new (mem) jpg_encoder_ctx_s();
+    ctx->width = width;
+    ctx->height = height;
+    ctx->format = format;
+    ctx->end_line = (strips > 1) ? rows_per_strip * mcu_height : height;
+    ctx->strip_cnt = 0;
+    ctx->strips = NULL;
+
+    if(!encoder_setup(&ctx->encoder, width, height, format, quality, JPG_MEM_FLUSH_SIZE, restart_interval)) {
+        jpg_encoder_delete(ctx);
+        return NULL;
+    }
+    if(strips > 1) {
+        ctx->strips = (jpg_strip_s *)_malloc((strips - 1) * sizeof(jpg_strip_s));
+        if(!ctx->strips) {
+            ESP_LOGE(TAG, "JPG strips malloc failed");
+            jpg_encoder_delete(ctx);
+            return NULL;
+        }
+        for(int i = 1; i < strips; i++) {
+            //the buffers start at a quarter byte per pixel, like fmt2jpg
+            jpg_strip_s *strip = new (&ctx->strips[i - 1]) jpg_strip_s((size_t)width * rows_per_strip * mcu_height / 4);
+            ctx->strip_cnt++;
+            strip->start = NULL;
+            strip->done = NULL;
+            strip->task = NULL;
+            strip->first_line = i * rows_per_strip * mcu_height;
+            strip->end_line = (i + 1) * rows_per_strip * mcu_height;
+            if(strip->end_line > height) {
+                strip->end_line = height;
+            }
+            if(!jpg_strip_init(ctx, strip, quality, restart_interval)) {
+                jpg_encoder_delete(ctx);
+                return NULL;
+            }
+        }
+    }
+    return ctx;
+}
+
+jpg_encoder_ctx_t jpg_encoder_create(uint16_t width, uint16_t height, pixformat_t format, uint8_t quality)
+{
+    return jpg_encoder_create_parallel(width, height, format, quality, 1);
+}
+
+void jpg_encoder_delete(jpg_encoder_ctx_t ctx)
+{
+    if(ctx) {
+        for(int i = 0; i < ctx->strip_cnt; i++) {
+            jpg_strip_free(&ctx->strips[i]);
+        }
+        free(ctx->strips);
+        ctx->~jpg_encoder_ctx_s();
+        free(ctx);
+    }
+}
+
+static bool encoder_check_src(jpg_encoder_ctx_t ctx, size_t src_len)
+{
+    size_t bpp = (ctx->format == PIXFORMAT_RGB888) ? 3 : (ctx->format == PIXFORMAT_GRAYSCALE) ? 1 : 2;
+    if(src_len < (size_t)ctx->width * ctx->height * bpp) {
+        ESP_LOGE(TAG, "JPG source has %u bytes, %u x %u needs %u", (unsigned)src_len, ctx->width, ctx->height, (unsigned)((size_t)ctx->width * ctx->height * bpp));
+        return false;
+    }
+    return true;
+}
+
+//the strip tasks encode while the calling task does the first strip, their output follows in order
+static bool encoder_run(jpg_encoder_ctx_t ctx, const uint8_t *src, jpge::output_stream *dst_stream)
+{
+    if(!ctx->strip_cnt) {
+        return encode_frame(&ctx->encoder, src, ctx->width, ctx->height, ctx->format, dst_stream);
+    }
+
+    for(int i = 0; i < ctx->strip_cnt; i++) {
+        xQueueSend(ctx->strips[i].start, &src, portMAX_DELAY);
+    }
+    bool ok = ctx->encoder.start(dst_stream, jpge::FIRST_SEGMENT)
+              && encode_lines(&ctx->encoder, src, ctx->width, 0, ctx->end_line, ctx->format);
+    //all strips are waited for, they use src until they are done
+    for(int i = 0; i < ctx->strip_cnt; i++) {
+        jpg_strip_s *strip = &ctx->strips[i];
+        bool strip_ok = false;
+        xQueueReceive(strip->done, &strip_ok, portMAX_DELAY);
+        if(ok && strip_ok) {
+            const uint8_t rst[2] = { 0xFF, (uint8_t)(0xD0 + (i & 7)) };
+            ok = dst_stream->put_buf(rst, sizeof(rst)) && dst_stream->put_buf(strip->out.data(), strip->out.get_size());
+        } else {
+            ok = false;
+        }
+    }
+    if(!ok) {
+        ESP_LOGE(TAG, "JPG strip encoding failed");
+        return false;
+    }
+    const uint8_t eoi[2] = { 0xFF, 0xD9 };
+    return dst_stream->put_buf(eoi, sizeof(eoi)) && dst_stream->put_buf(NULL, 0);
+}
+
+bool jpg_encoder_encode_cb(jpg_encoder_ctx_t ctx, const uint8_t *src, size_t src_len, jpg_out_cb cb, void * arg)
+{
+    if(!encoder_check_src(ctx, src_len)) {
+        return false;
+    }
+    callback_stream dst_stream(cb, arg);
+    return encoder_run(ctx, src, &dst_stream);
+}
+
+bool jpg_encoder_encode_buf(jpg_encoder_ctx_t ctx, const uint8_t *src, size_t src_len, uint8_t * out, size_t out_size, size_t * out_len)
+{
+    if(!encoder_check_src(ctx, src_len)) {
+        return false;
+    }
+    memory_stream dst_stream(out, out_size);
+    if(!encoder_run(ctx, src, &dst_stream)) {
+        return false;
+    }
+    *out_len = dst_stream.get_size();
+    if(*out_len > out_size) {
+        ESP_LOGW(TAG, "JPG output needs %u bytes, the buffer has %u", (unsigned)*out_len, (unsigned)out_size);
+        return false;
+    }
+    return true;
 }
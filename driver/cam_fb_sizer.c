@@ -0,0 +1,143 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "cam_fb_sizer.h"
+
+static size_t cam_fb_sizer_round(cam_fb_sizer_t *sizer, size_t size)
+{
+    size = (size + CAM_FB_SIZER_GRANULE - 1) & ~(size_t)(CAM_FB_SIZER_GRANULE - 1);
+    if (size < sizer->min_size) {
+        size = sizer->min_size;
+    }
+    if (size > sizer->max_size) {
+        size = sizer->max_size;
+    }
+    return size;
+}
+
+static void cam_fb_sizer_update_target(cam_fb_sizer_t *sizer, cam_fb_profile_t *p)
+{
+    uint32_t sorted[CAM_FB_SIZER_WINDOW];
+    uint8_t n = p->count;
+    // insertion sort, the window is tiny
+    for (uint8_t i = 0; i < n; i++) {
+        uint32_t v = p->lengths[i];
+        int j = i - 1;
+        while (j >= 0 && sorted[j] > v) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+    uint32_t p95 = sorted[(n * 95) / 100];
+    uint32_t recent_max = sorted[n - 1];
+    size_t target = (size_t)p95 + p95 / 4;
+    if (target < recent_max) {
+        target = recent_max;
+    }
+    p->target = cam_fb_sizer_round(sizer, target);
+}
+
+static cam_fb_profile_t *cam_fb_sizer_profile(cam_fb_sizer_t *sizer)
+{
+    uint32_t key = atomic_load_explicit(&sizer->key, memory_order_relaxed);
+    if (sizer->current && sizer->current->key == key) {
+        return sizer->current;
+    }
+    cam_fb_profile_t *oldest = &sizer->profiles[0];
+    for (int i = 0; i < CAM_FB_SIZER_PROFILES; i++) {
+        cam_fb_profile_t *p = &sizer->profiles[i];
+        if (p->last_used && p->key == key) {
+            sizer->current = p;
+            return p;
+        }
+        if (p->last_used < oldest->last_used) {
+            oldest = p;
+        }
+    }
+    memset(oldest, 0, sizeof(*oldest));
+    oldest->key = key;
+    oldest->last_used = ++sizer->clock;
+    sizer->current = oldest;
+    return oldest;
+}
+
+void cam_fb_sizer_init(cam_fb_sizer_t *sizer, size_t initial_size, size_t min_size, size_t max_size, size_t budget)
+{
+    memset(sizer, 0, sizeof(*sizer));
+    sizer->min_size = min_size;
+    sizer->max_size = max_size < min_size ? min_size : max_size;
+    sizer->budget = budget;
+    sizer->initial_size = cam_fb_sizer_round(sizer, initial_size);
+    atomic_init(&sizer->key, 0);
+}
+
+void cam_fb_sizer_set_profile(cam_fb_sizer_t *sizer, uint32_t key)
+{
+    atomic_store_explicit(&sizer->key, key, memory_order_relaxed);
+}
+
+static void cam_fb_sizer_record(cam_fb_sizer_t *sizer, size_t len, bool complete)
+{
+    cam_fb_profile_t *p = cam_fb_sizer_profile(sizer);
+    p->last_used = ++sizer->clock;
+    p->lengths[p->next] = len;
+    p->next = (p->next + 1) % CAM_FB_SIZER_WINDOW;
+    if (p->count < CAM_FB_SIZER_WINDOW) {
+        p->count++;
+    }
+    if (complete && len > p->high_water) {
+        p->high_water = len;
+    }
+    cam_fb_sizer_update_target(sizer, p);
+}
+
+void cam_fb_sizer_add(cam_fb_sizer_t *sizer, size_t len)
+{
+    cam_fb_sizer_record(sizer, len, true);
+}
+
+void cam_fb_sizer_overflow(cam_fb_sizer_t *sizer, size_t capacity)
+{
+    // the real length is unknown, count it as twice what did not fit
+    cam_fb_sizer_record(sizer, capacity * 2, false);
+}
+
+size_t cam_fb_sizer_target(cam_fb_sizer_t *sizer)
+{
+    cam_fb_profile_t *p = cam_fb_sizer_profile(sizer);
+    return p->target ? p->target : sizer->initial_size;
+}
+
+size_t cam_fb_sizer_high_water(cam_fb_sizer_t *sizer)
+{
+    return cam_fb_sizer_profile(sizer)->high_water;
+}
+
+size_t cam_fb_sizer_resize(cam_fb_sizer_t *sizer, size_t current, size_t total)
+{
+    size_t target = cam_fb_sizer_target(sizer);
+    if (current < target) {
+        size_t available = total < sizer->budget ? sizer->budget - total : 0;
+        if (target - current > available) {
+            target = (current + available) & ~(size_t)(CAM_FB_SIZER_GRANULE - 1);
+        }
+        return target > current ? target : current;
+    }
+    if (current > target + target / 2) {
+        return target;
+    }
+    return current;
+}
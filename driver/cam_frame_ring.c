@@ -0,0 +1,148 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include "cam_frame_ring.h"
+
+static bool cam_frame_ring_set_state(cam_frame_ring_t *ring, int pos, cam_frame_state_t from, cam_frame_state_t to)
+{
+    uint8_t expected = from;
+    return atomic_compare_exchange_strong_explicit(&ring->state[pos], &expected, to, memory_order_acq_rel, memory_order_acquire);
+}
+
+// advance the tail by one and return the frame that was there, -1 when empty
+static int cam_frame_ring_take_tail(cam_frame_ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    while (1) {
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == head) {
+            return -1;
+        }
+        // the producer never writes this slot while tail still points at it
+        int pos = atomic_load_explicit(&ring->index[tail & ring->mask], memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&ring->tail, &tail, tail + 1, memory_order_acq_rel, memory_order_acquire)) {
+            return pos;
+        }
+    }
+}
+
+bool cam_frame_ring_init(cam_frame_ring_t *ring, uint32_t frame_cnt, uint32_t limit)
+{
+    if (frame_cnt == 0 || frame_cnt > UINT8_MAX || limit == 0 || limit > frame_cnt) {
+        return false;
+    }
+    uint32_t size = 1;
+    while (size < frame_cnt) {
+        size <<= 1;
+    }
+    ring->index = (_Atomic uint8_t *)calloc(size, sizeof(_Atomic uint8_t));
+    ring->state = (_Atomic uint8_t *)calloc(frame_cnt, sizeof(_Atomic uint8_t));
+    ring->refs = (_Atomic uint8_t *)calloc(frame_cnt, sizeof(_Atomic uint8_t));
+    if (ring->index == NULL || ring->state == NULL || ring->refs == NULL) {
+        cam_frame_ring_deinit(ring);
+        return false;
+    }
+    ring->mask = size - 1;
+    ring->limit = limit;
+    ring->frame_cnt = frame_cnt;
+    for (uint32_t x = 0; x < frame_cnt; x++) {
+        atomic_init(&ring->state[x], CAM_FRAME_FREE);
+        atomic_init(&ring->refs[x], 0);
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return true;
+}
+
+void cam_frame_ring_deinit(cam_frame_ring_t *ring)
+{
+    free((void *)ring->index);
+    free((void *)ring->state);
+    free((void *)ring->refs);
+    ring->index = NULL;
+    ring->state = NULL;
+    ring->refs = NULL;
+}
+
+int cam_frame_ring_acquire(cam_frame_ring_t *ring, int pos)
+{
+    if (cam_frame_ring_state(ring, pos) == CAM_FRAME_FILLING) {
+        // still ours, the previous capture into it was abandoned
+        return pos;
+    }
+    for (uint32_t x = 0; x < ring->frame_cnt; x++) {
+        int p = (pos + x) % ring->frame_cnt;
+        if (cam_frame_ring_set_state(ring, p, CAM_FRAME_FREE, CAM_FRAME_FILLING)) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+bool cam_frame_ring_push(cam_frame_ring_t *ring, int pos, int *dropped)
+{
+    *dropped = -1;
+    if (!cam_frame_ring_set_state(ring, pos, CAM_FRAME_FILLING, CAM_FRAME_READY)) {
+        return false;
+    }
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while ((head - atomic_load_explicit(&ring->tail, memory_order_acquire)) >= ring->limit) {
+        int oldest = cam_frame_ring_take_tail(ring);
+        if (oldest >= 0) {
+            // nobody else can reach it once it is off the ring
+            atomic_store_explicit(&ring->state[oldest], CAM_FRAME_FREE, memory_order_release);
+            *dropped = oldest;
+        }
+    }
+    atomic_store_explicit(&ring->index[head & ring->mask], pos, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+int cam_frame_ring_pop(cam_frame_ring_t *ring)
+{
+    int pos = cam_frame_ring_take_tail(ring);
+    if (pos >= 0) {
+        atomic_store_explicit(&ring->refs[pos], 1, memory_order_relaxed);
+        atomic_store_explicit(&ring->state[pos], CAM_FRAME_HELD, memory_order_release);
+    }
+    return pos;
+}
+
+bool cam_frame_ring_ref(cam_frame_ring_t *ring, int pos)
+{
+    uint8_t refs = atomic_load_explicit(&ring->refs[pos], memory_order_acquire);
+    do {
+        // a frame nobody holds may already be filling again
+        if (refs == 0 || refs == UINT8_MAX) {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&ring->refs[pos], &refs, refs + 1, memory_order_acq_rel, memory_order_acquire));
+    return true;
+}
+
+bool cam_frame_ring_give(cam_frame_ring_t *ring, int pos)
+{
+    uint8_t refs = atomic_load_explicit(&ring->refs[pos], memory_order_acquire);
+    do {
+        if (refs == 0) {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&ring->refs[pos], &refs, refs - 1, memory_order_acq_rel, memory_order_acquire));
+    if (refs == 1) {
+        return cam_frame_ring_set_state(ring, pos, CAM_FRAME_HELD, CAM_FRAME_FREE);
+    }
+    return true;
+}
@@ -22,8 +22,13 @@ static const char *TAG = "cam_hal";
 
 static cam_obj_t *cam_obj = NULL;
 
+// statistics have a single writer, the readers load them while it runs
+#define CAM_STAT_SET(stat, value)   __atomic_store_n(&(stat), (value), __ATOMIC_RELAXED)
+#define CAM_STAT_INC(stat)          CAM_STAT_SET(stat, (stat) + 1)
+#define CAM_STAT_GET(stat)          __atomic_load_n(&(stat), __ATOMIC_RELAXED)
+
 static const uint32_t JPEG_SOI_MARKER = 0xFFD8FF;  // written in little-endian for esp32
-static const uint16_t JPEG_EOI_MARKER = 0xD9FF;  // written in little-endian for esp32
+static const size_t JPEG_EOI_MARKER_LEN = 2;
 
 static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
 {
@@ -34,47 +39,151 @@ static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
     return 0;
 }
 
-static int cam_verify_jpeg_eoi(const uint8_t *inbuf, uint32_t length)
+/*
+ * Offset of the first EOI marker (FF D9) starting in [start, end - 1), -1 if there is none.
+ * Entropy coded data never contains FF D9, so the first one ends the frame.
+ * Whole words are skipped while none of their bytes is 0xFF.
+ */
+static int cam_find_jpeg_eoi(const uint8_t *inbuf, size_t start, size_t end)
 {
-    int offset = -1;
-    uint8_t *dptr = (uint8_t *)inbuf + length - 2;
-    while (dptr > inbuf) {
-        uint16_t sig = *((uint16_t *)dptr);
-        if (JPEG_EOI_MARKER == sig) {
-            offset = dptr - inbuf;
-            return offset;
+    if (end < 2 || start >= end - 1) {
+        return -1;
+    }
+    const uint8_t *dptr = inbuf + start;
+    const uint8_t *last = inbuf + end - 1;
+    while (dptr < last && ((uintptr_t)dptr & 3)) {
+        if (dptr[0] == 0xFF && dptr[1] == 0xD9) {
+            return dptr - inbuf;
+        }
+        dptr++;
+    }
+    // the word and the byte after it must be in range
+    while ((dptr + 4) <= last) {
+        uint32_t v = *((const uint32_t *)dptr);
+        if (((~v - 0x01010101) & v & 0x80808080) != 0) {
+            for (int i = 0; i < 4; i++) {
+                if (dptr[i] == 0xFF && dptr[i + 1] == 0xD9) {
+                    return dptr + i - inbuf;
+                }
+            }
+        }
+        dptr += 4;
+    }
+    while (dptr < last) {
+        if (dptr[0] == 0xFF && dptr[1] == 0xD9) {
+            return dptr - inbuf;
         }
-        dptr--;
+        dptr++;
     }
     return -1;
 }
 
-static bool cam_get_next_frame(int * frame_pos)
+// scan the bytes [from, to) that just arrived, plus the one before them in case the marker was split
+static void cam_scan_jpeg_eoi(const camera_fb_t *fb, size_t from, size_t to, int *eoi)
 {
-    if(!cam_obj->frames[*frame_pos].en){
-        for (int x = 0; x < cam_obj->frame_cnt; x++) {
-            if (cam_obj->frames[x].en) {
-                *frame_pos = x;
-                return true;
-            }
+    if (*eoi < 0) {
+        *eoi = cam_find_jpeg_eoi(fb->buf, from ? from - 1 : 0, to);
+    }
+}
+
+static int cam_get_frame_pos(camera_fb_t *dma_buffer)
+{
+    // fb is the first member of cam_frame_t
+    cam_frame_t *frame = (cam_frame_t *)dma_buffer;
+    if (frame < cam_obj->frames || frame >= &cam_obj->frames[cam_obj->frame_cnt]) {
+        return -1;
+    }
+    return frame - cam_obj->frames;
+}
+
+static void cam_resize_frame(int frame_pos)
+{
+    cam_frame_t *frame = &cam_obj->frames[frame_pos];
+    size_t size = cam_fb_sizer_resize(&cam_obj->fb_sizer, frame->fb_size, cam_obj->fb_stats.fb_size_total);
+    if (size == frame->fb_size) {
+        return;
+    }
+    // the old contents are not needed, allocate before freeing so a failure keeps the old buffer
+    uint8_t *buf = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (buf == NULL) {
+        CAM_STAT_INC(cam_obj->fb_stats.resize_failures);
+        return;
+    }
+    free(frame->fb.buf);
+    ESP_LOGD(TAG, "Frame[%d]: %u -> %u", frame_pos, frame->fb_size, size);
+    CAM_STAT_SET(cam_obj->fb_stats.fb_size_total, cam_obj->fb_stats.fb_size_total - frame->fb_size + size);
+    CAM_STAT_INC(cam_obj->fb_stats.resizes);
+    frame->fb.buf = buf;
+    frame->fb_size = size;
+}
+
+// the frame in frame_pos ran out of room, counted once however many chunks of it are left
+static void cam_frame_overflow(int frame_pos, bool *overflowed)
+{
+    if (*overflowed) {
+        return;
+    }
+    *overflowed = true;
+    ESP_LOGD(TAG, "FB-OVF");
+    CAM_STAT_INC(cam_obj->stats.fb_overflow);
+    CAM_STAT_INC(cam_obj->fb_stats.overflows);
+    if (cam_obj->adaptive_fb) {
+        cam_fb_sizer_overflow(&cam_obj->fb_sizer, cam_obj->frames[frame_pos].fb_size);
+        CAM_STAT_SET(cam_obj->fb_stats.fb_size_target, cam_fb_sizer_target(&cam_obj->fb_sizer));
+    }
+}
+
+// a DMA chunk of the frame was received, bytes of it went into the frame buffer
+static void cam_frame_chunk(camera_fb_t *fb, size_t bytes)
+{
+    int64_t us = esp_timer_get_time();
+    if (fb->meta.dma_chunks == 0) {
+        fb->meta.first_dma_us = us;
+    }
+    fb->meta.last_dma_us = us;
+    fb->meta.dma_chunks++;
+    fb->meta.bytes_copied += bytes;
+}
+
+// tell the JPEG chunk callback how far the frame being captured into fb has come, len ends at the EOI once there is one
+static void cam_jpeg_chunk(const camera_fb_t *fb, size_t len, int eoi, camera_jpeg_chunk_state_t state)
+{
+    if (cam_obj->jpeg_chunk_cb) {
+        if (eoi >= 0) {
+            len = eoi + JPEG_EOI_MARKER_LEN;
         }
-    } else {
-        return true;
+        camera_jpeg_chunk_t chunk = {
+            .buf = fb->buf,
+            .len = len,
+            .sequence = cam_obj->frame_sequence + 1,
+            .state = state,
+        };
+        cam_obj->jpeg_chunk_cb(&chunk, cam_obj->jpeg_chunk_cb_arg);
     }
-    return false;
 }
 
 static bool cam_start_frame(int * frame_pos)
 {
-    if (cam_get_next_frame(frame_pos)) {
-        if(ll_cam_start(cam_obj, *frame_pos)){
-            // Vsync the frame manually
-            ll_cam_do_vsync(cam_obj);
-            uint64_t us = (uint64_t)esp_timer_get_time();
-            cam_obj->frames[*frame_pos].fb.timestamp.tv_sec = us / 1000000UL;
-            cam_obj->frames[*frame_pos].fb.timestamp.tv_usec = us % 1000000UL;
-            return true;
+    int pos = cam_frame_ring_acquire(&cam_obj->frame_ring, *frame_pos);
+    if (pos < 0) {
+        CAM_STAT_INC(cam_obj->stats.no_free_fb);
+        return false;
+    }
+    *frame_pos = pos;
+    if(ll_cam_start(cam_obj, *frame_pos)){
+        // Vsync the frame manually
+        ll_cam_do_vsync(cam_obj);
+        uint64_t us = (uint64_t)esp_timer_get_time();
+        camera_fb_t *fb = &cam_obj->frames[*frame_pos].fb;
+        fb->timestamp.tv_sec = us / 1000000UL;
+        fb->timestamp.tv_usec = us % 1000000UL;
+        memset(&fb->meta, 0, sizeof(fb->meta));
+        fb->meta.vsync_us = us;
+        if (cam_obj->adaptive_fb) {
+            // the DMA fills the internal buffer meanwhile, the frame buffer is only needed at the first EOF
+            cam_resize_frame(*frame_pos);
         }
+        return true;
     }
     return false;
 }
@@ -84,7 +193,8 @@ void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType
     if (xQueueSendFromISR(cam->event_queue, (void *)&cam_event, HPTaskAwoken) != pdTRUE) {
         ll_cam_stop(cam);
         cam->state = CAM_STATE_IDLE;
-        ESP_EARLY_LOGE(TAG, "EV-OVF");
+        CAM_STAT_INC(cam->stats.event_overflow);
+        ESP_EARLY_LOGD(TAG, "EV-OVF");
     }
 }
 
@@ -92,6 +202,8 @@ void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType
 static void cam_task(void *arg)
 {
     int cnt = 0;
+    int eoi = -1;
+    bool overflowed = false;
     int frame_pos = 0;
     cam_obj->state = CAM_STATE_IDLE;
     cam_event_t cam_event = 0;
@@ -111,6 +223,8 @@ static void cam_task(void *arg)
                         cam_obj->state = CAM_STATE_READ_BUF;
                     }
                     cnt = 0;
+                    eoi = -1;
+                    overflowed = false;
                 }
             }
             break;
@@ -120,22 +234,57 @@ static void cam_task(void *arg)
                 
                 if (cam_event == CAM_IN_SUC_EOF_EVENT) {
                     if(!cam_obj->psram_mode){
-                        if (cam_obj->recv_size < (frame_buffer_event->len + (cam_obj->dma_half_buffer_size / cam_obj->dma_bytes_per_item))) {
-                            ESP_LOGW(TAG, "FB-OVF");
+                        if (cam_obj->jpeg_mode && eoi >= 0) {
+                            // the frame is complete, the rest is padding until VSYNC
+                            cam_frame_chunk(frame_buffer_event, 0);
+                            cam_jpeg_chunk(frame_buffer_event, frame_buffer_event->len, eoi, CAMERA_JPEG_CHUNK_DATA);
+                            cnt++;
+                            DBG_PIN_SET(0);
+                            continue;
+                        }
+                        if (cam_obj->frames[frame_pos].fb_size < (frame_buffer_event->len + (cam_obj->dma_half_buffer_size / cam_obj->dma_bytes_per_item))) {
+                            cam_frame_overflow(frame_pos, &overflowed);
                             ll_cam_stop(cam_obj);
                             DBG_PIN_SET(0);
                             continue;
                         }
+                        size_t from = frame_buffer_event->len;
                         frame_buffer_event->len += ll_cam_memcpy(
                             &frame_buffer_event->buf[frame_buffer_event->len], 
                             &cam_obj->dma_buffer[(cnt % cam_obj->dma_half_buffer_cnt) * cam_obj->dma_half_buffer_size], 
                             cam_obj->dma_half_buffer_size);
+                        cam_frame_chunk(frame_buffer_event, frame_buffer_event->len - from);
+                        if (cam_obj->jpeg_mode) {
+                            cam_scan_jpeg_eoi(frame_buffer_event, from, frame_buffer_event->len, &eoi);
+                            cam_jpeg_chunk(frame_buffer_event, frame_buffer_event->len, eoi, CAMERA_JPEG_CHUNK_DATA);
+                        }
+                    } else {
+                        cam_frame_chunk(frame_buffer_event, 0);
+                        if (cam_obj->jpeg_mode) {
+                            cam_scan_jpeg_eoi(frame_buffer_event, cnt * cam_obj->dma_half_buffer_size, (cnt + 1) * cam_obj->dma_half_buffer_size, &eoi);
+                            if (eoi < 0 && (cnt + 1) >= cam_obj->dma_half_buffer_cnt) {
+                                // the descriptor chain is circular, the next chunk would overwrite the start of the frame
+                                cam_frame_overflow(frame_pos, &overflowed);
+                                ll_cam_stop(cam_obj);
+                                cam_obj->state = CAM_STATE_IDLE;
+                                cam_jpeg_chunk(frame_buffer_event, cnt * cam_obj->dma_half_buffer_size, eoi, CAMERA_JPEG_CHUNK_DROPPED);
+                                DBG_PIN_SET(0);
+                                continue;
+                            }
+                            if (eoi >= 0) {
+                                // stop the DMA before it wraps around onto the frame
+                                ll_cam_stop(cam_obj);
+                            }
+                            cam_jpeg_chunk(frame_buffer_event, (cnt + 1) * cam_obj->dma_half_buffer_size, eoi, CAMERA_JPEG_CHUNK_DATA);
+                        }
                     }
                     //Check for JPEG SOI in the first buffer. stop if not found
                     if (cam_obj->jpeg_mode && cnt == 0 && cam_verify_jpeg_soi(frame_buffer_event->buf, frame_buffer_event->len) != 0) {
                         ll_cam_stop(cam_obj);
                         cam_obj->state = CAM_STATE_IDLE;
-                        ESP_LOGW(TAG, "NO-SOI");
+                        CAM_STAT_INC(cam_obj->stats.no_soi);
+                        ESP_LOGD(TAG, "NO-SOI");
+                        cam_jpeg_chunk(frame_buffer_event, 0, -1, CAMERA_JPEG_CHUNK_DROPPED);
                     }
                     cnt++;
 
@@ -144,52 +293,65 @@ static void cam_task(void *arg)
                     ll_cam_stop(cam_obj);
 
                     if (cnt || !cam_obj->jpeg_mode || cam_obj->psram_mode) {
-                        if (cam_obj->jpeg_mode) {
+                        if (cam_obj->jpeg_mode && eoi < 0) {
+                            // the last chunk is only partially filled
                             if (!cam_obj->psram_mode) {
-                                if (cam_obj->recv_size < (frame_buffer_event->len + (cam_obj->dma_half_buffer_size / cam_obj->dma_bytes_per_item))) {
-                                    ESP_LOGW(TAG, "FB-OVF");
-                                    cnt--;
+                                if (cam_obj->frames[frame_pos].fb_size < (frame_buffer_event->len + (cam_obj->dma_half_buffer_size / cam_obj->dma_bytes_per_item))) {
+                                    cam_frame_overflow(frame_pos, &overflowed);
                                 } else {
+                                    size_t from = frame_buffer_event->len;
                                     frame_buffer_event->len += ll_cam_memcpy(
                                         &frame_buffer_event->buf[frame_buffer_event->len], 
                                         &cam_obj->dma_buffer[(cnt % cam_obj->dma_half_buffer_cnt) * cam_obj->dma_half_buffer_size], 
                                         cam_obj->dma_half_buffer_size);
+                                    cam_frame_chunk(frame_buffer_event, frame_buffer_event->len - from);
+                                    cam_scan_jpeg_eoi(frame_buffer_event, from, frame_buffer_event->len, &eoi);
+                                    cam_jpeg_chunk(frame_buffer_event, frame_buffer_event->len, eoi, CAMERA_JPEG_CHUNK_DATA);
                                 }
+                            } else {
+                                cam_frame_chunk(frame_buffer_event, 0);
+                                cam_scan_jpeg_eoi(frame_buffer_event, cnt * cam_obj->dma_half_buffer_size, (cnt + 1) * cam_obj->dma_half_buffer_size, &eoi);
+                                cam_jpeg_chunk(frame_buffer_event, (cnt + 1) * cam_obj->dma_half_buffer_size, eoi, CAMERA_JPEG_CHUNK_DATA);
                             }
-                            cnt++;
                         }
 
-                        cam_obj->frames[frame_pos].en = 0;
+                        bool frame_ok = true;
 
-                        if (cam_obj->psram_mode) {
-                            if (cam_obj->jpeg_mode) {
-                                frame_buffer_event->len = cnt * cam_obj->dma_half_buffer_size;
+                        if (cam_obj->jpeg_mode) {
+                            if (eoi >= 0) {
+                                // data after the end marker can be discarded
+                                frame_buffer_event->len = eoi + JPEG_EOI_MARKER_LEN;
+                                if (cam_obj->adaptive_fb) {
+                                    cam_fb_sizer_add(&cam_obj->fb_sizer, frame_buffer_event->len);
+                                    CAM_STAT_SET(cam_obj->fb_stats.fb_size_target, cam_fb_sizer_target(&cam_obj->fb_sizer));
+                                    CAM_STAT_SET(cam_obj->fb_stats.jpeg_high_water, cam_fb_sizer_high_water(&cam_obj->fb_sizer));
+                                }
                             } else {
-                                frame_buffer_event->len = cam_obj->recv_size;
-                            }
-                        } else if (!cam_obj->jpeg_mode) {
-                            if (frame_buffer_event->len != cam_obj->recv_size) {
-                                cam_obj->frames[frame_pos].en = 1;
-                                ESP_LOGE(TAG, "FB-SIZE: %u != %u", frame_buffer_event->len, cam_obj->recv_size);
+                                frame_ok = false;
+                                CAM_STAT_INC(cam_obj->stats.no_eoi);
+                                ESP_LOGD(TAG, "NO-EOI");
                             }
+                        } else if (cam_obj->psram_mode) {
+                            frame_buffer_event->len = cam_obj->recv_size;
+                        } else if (frame_buffer_event->len != cam_obj->recv_size) {
+                            frame_ok = false;
+                            CAM_STAT_INC(cam_obj->stats.size_mismatch);
+                            ESP_LOGD(TAG, "FB-SIZE: %u != %u", frame_buffer_event->len, cam_obj->recv_size);
                         }
-                        //send frame
-                        if(!cam_obj->frames[frame_pos].en && xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
-                            //pop frame buffer from the queue
-                            camera_fb_t * fb2 = NULL;
-                            if(xQueueReceive(cam_obj->frame_buffer_queue, &fb2, 0) == pdTRUE) {
-                                //push the new frame to the end of the queue
-                                if (xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
-                                    cam_obj->frames[frame_pos].en = 1;
-                                    ESP_LOGE(TAG, "FBQ-SND");
-                                }
-                                //free the popped buffer
-                                cam_give(fb2);
-                            } else {
-                                //queue is full and we could not pop a frame from it
-                                cam_obj->frames[frame_pos].en = 1;
-                                ESP_LOGE(TAG, "FBQ-RCV");
+                        if (cam_obj->jpeg_mode) {
+                            cam_jpeg_chunk(frame_buffer_event, frame_buffer_event->len, eoi, frame_ok ? CAMERA_JPEG_CHUNK_DONE : CAMERA_JPEG_CHUNK_DROPPED);
+                        }
+                        //send frame, a rejected one stays ours and gets captured into again
+                        if (frame_ok) {
+                            int dropped = -1;
+                            frame_buffer_event->sequence = ++cam_obj->frame_sequence;
+                            cam_obj->frames[frame_pos].queued_us = esp_timer_get_time();
+                            cam_frame_ring_push(&cam_obj->frame_ring, frame_pos, &dropped);
+                            CAM_STAT_INC(cam_obj->stats.frames_captured);
+                            if (dropped >= 0) {
+                                CAM_STAT_INC(cam_obj->stats.frames_dropped);
                             }
+                            xSemaphoreGive(cam_obj->frame_ready);
                         }
                     }
 
@@ -199,6 +361,8 @@ static void cam_task(void *arg)
                         cam_obj->frames[frame_pos].fb.len = 0;
                     }
                     cnt = 0;
+                    eoi = -1;
+                    overflowed = false;
                 }
             }
             break;
@@ -207,6 +371,75 @@ static void cam_task(void *arg)
     }
 }
 
+//Strips always go through the internal DMA buffer, there is no frame to point the DMA at
+static bool cam_start_strips(void)
+{
+    if (!ll_cam_start(cam_obj, 0)) {
+        return false;
+    }
+    ll_cam_do_vsync(cam_obj);
+    cam_obj->frame_sequence++;
+    return true;
+}
+
+//Hand the lines in the DMA buffer to the strip callback, no frame buffers involved
+static void cam_strip_task(void *arg)
+{
+    int cnt = 0;
+    cam_event_t cam_event = 0;
+    camera_strip_t strip = {
+        .width = cam_obj->width,
+        .height = cam_obj->height,
+        .format = cam_obj->pix_format,
+    };
+    size_t line_size = cam_obj->width * cam_obj->fb_bytes_per_pixel;
+    cam_obj->state = CAM_STATE_IDLE;
+
+    xQueueReset(cam_obj->event_queue);
+
+    while (1) {
+        xQueueReceive(cam_obj->event_queue, (void *)&cam_event, portMAX_DELAY);
+        DBG_PIN_SET(1);
+        if (cam_event == CAM_VSYNC_EVENT) {
+            if (cam_obj->state == CAM_STATE_READ_BUF) {
+                ll_cam_stop(cam_obj);
+                if (strip.y == cam_obj->height) {
+                    CAM_STAT_INC(cam_obj->stats.frames_captured);
+                } else {
+                    CAM_STAT_INC(cam_obj->stats.size_mismatch);
+                    ESP_LOGD(TAG, "FB-SIZE: %u != %u lines", strip.y, cam_obj->height);
+                }
+            }
+            cam_obj->state = cam_start_strips() ? CAM_STATE_READ_BUF : CAM_STATE_IDLE;
+            strip.sequence = cam_obj->frame_sequence;
+            strip.y = 0;
+            cnt = 0;
+        } else if (cam_obj->state == CAM_STATE_READ_BUF) {
+            uint8_t *in = &cam_obj->dma_buffer[(cnt % cam_obj->dma_half_buffer_cnt) * cam_obj->dma_half_buffer_size];
+            if (cam_obj->strip_buf) {
+                strip.len = ll_cam_memcpy(cam_obj->strip_buf, in, cam_obj->dma_half_buffer_size);
+                strip.buf = cam_obj->strip_buf;
+            } else {
+                strip.len = cam_obj->dma_half_buffer_size;
+                strip.buf = in;
+            }
+            strip.lines = strip.len / line_size;
+            if (strip.y + strip.lines > cam_obj->height) {
+                // more lines than the frame has, wait for the next VSYNC
+                ll_cam_stop(cam_obj);
+                cam_obj->state = CAM_STATE_IDLE;
+                CAM_STAT_INC(cam_obj->stats.size_mismatch);
+                ESP_LOGD(TAG, "FB-SIZE: more than %u lines", cam_obj->height);
+            } else {
+                cam_obj->strip_cb(&strip, cam_obj->strip_cb_arg);
+                strip.y += strip.lines;
+                cnt++;
+            }
+        }
+        DBG_PIN_SET(0);
+    }
+}
+
 static lldesc_t * allocate_dma_descriptors(uint32_t count, uint16_t size, uint8_t * buffer)
 {
     lldesc_t *dma = (lldesc_t *)heap_caps_malloc(count * sizeof(lldesc_t), MALLOC_CAP_DMA);
@@ -230,6 +463,16 @@ static esp_err_t cam_dma_config()
 {
     ll_cam_dma_sizes(cam_obj);
 
+    if (cam_obj->psram_mode) {
+        // zero-copy needs the DMA to write bytes exactly as they should land in the frame buffer
+        uint8_t align = ll_cam_get_dma_align(cam_obj);
+        if (cam_obj->dma_bytes_per_item != 1 || (align && (cam_obj->dma_node_buffer_size % align) != 0)) {
+            ESP_LOGW(TAG, "Zero-copy DMA not possible (item: %u, node: %u, align: %u), using copy mode", cam_obj->dma_bytes_per_item, cam_obj->dma_node_buffer_size, align);
+            cam_obj->psram_mode = false;
+            ll_cam_dma_sizes(cam_obj);
+        }
+    }
+
     cam_obj->dma_node_cnt = (cam_obj->dma_buffer_size) / cam_obj->dma_node_buffer_size; // Number of DMA nodes
     cam_obj->frame_copy_cnt = cam_obj->recv_size / cam_obj->dma_half_buffer_size; // Number of interrupted copies, ping-pong copy
 
@@ -238,6 +481,23 @@ static esp_err_t cam_dma_config()
     cam_obj->dma_buffer = NULL;
     cam_obj->dma = NULL;
 
+    if (!cam_obj->psram_mode) {
+        cam_obj->dma_buffer = (uint8_t *)heap_caps_malloc(cam_obj->dma_buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
+        CAM_CHECK(cam_obj->dma_buffer != NULL, "dma_buffer malloc failed", ESP_FAIL);
+
+        cam_obj->dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->dma_buffer);
+        CAM_CHECK(cam_obj->dma != NULL, "dma malloc failed", ESP_FAIL);
+    }
+
+    if (cam_obj->strip_cb) {
+        // strips are handed out from the DMA buffer, unless the DMA items need converting first
+        if (cam_obj->dma_bytes_per_item != 1) {
+            cam_obj->strip_buf = (uint8_t *)heap_caps_malloc(cam_obj->dma_half_buffer_size / cam_obj->dma_bytes_per_item, MALLOC_CAP_INTERNAL);
+            CAM_CHECK(cam_obj->strip_buf != NULL, "strip_buf malloc failed", ESP_FAIL);
+        }
+        return ESP_OK;
+    }
+
     cam_obj->frames = (cam_frame_t *)heap_caps_malloc(cam_obj->frame_cnt * sizeof(cam_frame_t), MALLOC_CAP_DEFAULT);
     CAM_CHECK(cam_obj->frames != NULL, "frames malloc failed", ESP_FAIL);
 
@@ -245,12 +505,28 @@ static esp_err_t cam_dma_config()
     if (cam_obj->psram_mode) {
         dma_align = ll_cam_get_dma_align(cam_obj);
     }
+
+    size_t fb_size = cam_obj->recv_size;
+    if (cam_obj->adaptive_fb && cam_obj->psram_mode) {
+        ESP_LOGW(TAG, "Adaptive frame buffers need copy mode DMA, using %u bytes per frame", cam_obj->recv_size);
+        cam_obj->adaptive_fb = false;
+    }
+    if (cam_obj->adaptive_fb) {
+        // a frame buffer has to hold at least two DMA chunks, each one gets its share of the budget
+        size_t min_size = 2 * cam_obj->dma_half_buffer_size / cam_obj->dma_bytes_per_item;
+        size_t max_size = cam_obj->fb_budget / cam_obj->frame_cnt;
+        cam_fb_sizer_init(&cam_obj->fb_sizer, cam_obj->recv_size, min_size, max_size, cam_obj->fb_budget);
+        fb_size = cam_fb_sizer_target(&cam_obj->fb_sizer);
+        cam_obj->fb_stats.fb_size_target = fb_size;
+    }
+
     for (int x = 0; x < cam_obj->frame_cnt; x++) {
         cam_obj->frames[x].dma = NULL;
         cam_obj->frames[x].fb_offset = 0;
-        cam_obj->frames[x].en = 0;
-        cam_obj->frames[x].fb.buf = (uint8_t *)heap_caps_malloc(cam_obj->recv_size * sizeof(uint8_t) + dma_align, MALLOC_CAP_SPIRAM);
+        cam_obj->frames[x].fb_size = fb_size;
+        cam_obj->frames[x].fb.buf = (uint8_t *)heap_caps_malloc(fb_size * sizeof(uint8_t) + dma_align, MALLOC_CAP_SPIRAM);
         CAM_CHECK(cam_obj->frames[x].fb.buf != NULL, "frame buffer malloc failed", ESP_FAIL);
+        cam_obj->fb_stats.fb_size_total += fb_size;
         if (cam_obj->psram_mode) {
             //align PSRAM buffer. TODO: save the offset so proper address can be freed later
             cam_obj->frames[x].fb_offset = dma_align - ((uint32_t)cam_obj->frames[x].fb.buf & (dma_align - 1));
@@ -259,15 +535,6 @@ static esp_err_t cam_dma_config()
             cam_obj->frames[x].dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->frames[x].fb.buf);
             CAM_CHECK(cam_obj->frames[x].dma != NULL, "frame dma malloc failed", ESP_FAIL);
         }
-        cam_obj->frames[x].en = 1;
-    }
-
-    if (!cam_obj->psram_mode) {
-        cam_obj->dma_buffer = (uint8_t *)heap_caps_malloc(cam_obj->dma_buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
-        CAM_CHECK(cam_obj->dma_buffer != NULL, "dma_buffer malloc failed", ESP_FAIL);
-
-        cam_obj->dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->dma_buffer);
-        CAM_CHECK(cam_obj->dma != NULL, "dma malloc failed", ESP_FAIL);
     }
 
     return ESP_OK;
@@ -307,6 +574,8 @@ err:
 esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint8_t sensor_pid)
 {
     CAM_CHECK(NULL != config, "config pointer is invalid", ESP_ERR_INVALID_ARG);
+    CAM_CHECK(config->strip_cb == NULL || config->pixel_format != PIXFORMAT_JPEG, "JPEG frames can not be streamed in strips", ESP_ERR_NOT_SUPPORTED);
+    CAM_CHECK(config->jpeg_chunk_cb == NULL || config->pixel_format == PIXFORMAT_JPEG, "only JPEG frames have chunks", ESP_ERR_NOT_SUPPORTED);
     esp_err_t ret = ESP_OK;
 
     ret = ll_cam_set_sample_mode(cam_obj, (pixformat_t)config->pixel_format, config->xclk_freq_hz, sensor_pid);
@@ -314,10 +583,24 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
     cam_obj->jpeg_mode = config->pixel_format == PIXFORMAT_JPEG;
 #if CONFIG_IDF_TARGET_ESP32
     cam_obj->psram_mode = false;
+    if (config->dma_mode == CAMERA_DMA_ZERO_COPY) {
+        ESP_LOGW(TAG, "Zero-copy DMA is not supported on ESP32, using copy mode");
+    }
 #else
-    cam_obj->psram_mode = (config->xclk_freq_hz == 16000000);
+    cam_obj->psram_mode = (config->xclk_freq_hz == 16000000) || (config->dma_mode == CAMERA_DMA_ZERO_COPY);
 #endif
+    cam_obj->strip_cb = config->strip_cb;
+    cam_obj->strip_cb_arg = config->strip_cb_arg;
+    cam_obj->jpeg_chunk_cb = config->jpeg_chunk_cb;
+    cam_obj->jpeg_chunk_cb_arg = config->jpeg_chunk_cb_arg;
+    cam_obj->pix_format = config->pixel_format;
     cam_obj->frame_cnt = config->fb_count;
+    if (cam_obj->strip_cb) {
+        // the strips never leave internal RAM
+        cam_obj->psram_mode = false;
+        cam_obj->frame_cnt = 0;
+    }
+    cam_obj->frame_sequence = 0;
     cam_obj->width = resolution[frame_size].width;
     cam_obj->height = resolution[frame_size].height;
 
@@ -326,6 +609,10 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
     } else {
         cam_obj->recv_size = cam_obj->width * cam_obj->height * 2;
     }
+    cam_obj->adaptive_fb = cam_obj->jpeg_mode && config->jpeg_fb_budget;
+    cam_obj->fb_budget = config->jpeg_fb_budget;
+    memset(&cam_obj->fb_stats, 0, sizeof(cam_obj->fb_stats));
+    memset(&cam_obj->stats, 0, sizeof(cam_obj->stats));
     
     ret = cam_dma_config();
     CAM_CHECK_GOTO(ret == ESP_OK, "cam_dma_config failed", err);
@@ -333,23 +620,29 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
     cam_obj->event_queue = xQueueCreate(cam_obj->dma_half_buffer_cnt - 1, sizeof(cam_event_t));
     CAM_CHECK_GOTO(cam_obj->event_queue != NULL, "event_queue create failed", err);
 
-    size_t frame_buffer_queue_len = cam_obj->frame_cnt;
-    if (config->grab_mode == CAMERA_GRAB_LATEST && cam_obj->frame_cnt > 1) {
-        frame_buffer_queue_len = cam_obj->frame_cnt - 1;
+    if (!cam_obj->strip_cb) {
+        size_t frame_buffer_queue_len = cam_obj->frame_cnt;
+        if (config->grab_mode == CAMERA_GRAB_LATEST && cam_obj->frame_cnt > 1) {
+            frame_buffer_queue_len = cam_obj->frame_cnt - 1;
+        }
+        CAM_CHECK_GOTO(cam_frame_ring_init(&cam_obj->frame_ring, cam_obj->frame_cnt, frame_buffer_queue_len), "frame_ring init failed", err);
+
+        cam_obj->frame_ready = xSemaphoreCreateBinary();
+        CAM_CHECK_GOTO(cam_obj->frame_ready != NULL, "frame_ready create failed", err);
     }
-    cam_obj->frame_buffer_queue = xQueueCreate(frame_buffer_queue_len, sizeof(camera_fb_t*));
-    CAM_CHECK_GOTO(cam_obj->frame_buffer_queue != NULL, "frame_buffer_queue create failed", err);
 
     ret = ll_cam_init_isr(cam_obj);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam intr alloc failed", err);
 
-    
+    // the strip and JPEG chunk callbacks run on the task's stack
+    TaskFunction_t task = cam_obj->strip_cb ? cam_strip_task : cam_task;
+    uint32_t stack_size = (cam_obj->strip_cb || cam_obj->jpeg_chunk_cb) ? 4096 : 2048;
 #if CONFIG_CAMERA_CORE0
-    xTaskCreatePinnedToCore(cam_task, "cam_task", 2048, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 0);
+    xTaskCreatePinnedToCore(task, "cam_task", stack_size, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 0);
 #elif CONFIG_CAMERA_CORE1
-    xTaskCreatePinnedToCore(cam_task, "cam_task", 2048, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 1);
+    xTaskCreatePinnedToCore(task, "cam_task", stack_size, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 1);
 #else
-    xTaskCreate(cam_task, "cam_task", 2048, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle);
+    xTaskCreate(task, "cam_task", stack_size, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle);
 #endif
 
     ESP_LOGI(TAG, "cam config ok");
@@ -366,23 +659,28 @@ esp_err_t cam_deinit(void)
         return ESP_FAIL;
     }
 
-    cam_stop();
-    gpio_isr_handler_remove(cam_obj->vsync_pin);
     if (cam_obj->task_handle) {
+        // the task restarts the DMA for every VSYNC still queued, it has to go first
         vTaskDelete(cam_obj->task_handle);
     }
+    cam_stop();
+    gpio_isr_handler_remove(cam_obj->vsync_pin);
     if (cam_obj->event_queue) {
         vQueueDelete(cam_obj->event_queue);
     }
-    if (cam_obj->frame_buffer_queue) {
-        vQueueDelete(cam_obj->frame_buffer_queue);
+    if (cam_obj->frame_ready) {
+        vSemaphoreDelete(cam_obj->frame_ready);
     }
+    cam_frame_ring_deinit(&cam_obj->frame_ring);
     if (cam_obj->dma) {
         free(cam_obj->dma);
     }
     if (cam_obj->dma_buffer) {
         free(cam_obj->dma_buffer);
     }
+    if (cam_obj->strip_buf) {
+        free(cam_obj->strip_buf);
+    }
     if (cam_obj->frames) {
         for (int x = 0; x < cam_obj->frame_cnt; x++) {
             free(cam_obj->frames[x].fb.buf - cam_obj->frames[x].fb_offset);
@@ -415,36 +713,72 @@ void cam_start(void)
 
 camera_fb_t *cam_take(TickType_t timeout)
 {
-    camera_fb_t *dma_buffer = NULL;
+    if (cam_obj->strip_cb) {
+        ESP_LOGW(TAG, "Frames are streamed to the strip callback");
+        return NULL;
+    }
     TickType_t start = xTaskGetTickCount();
-    xQueueReceive(cam_obj->frame_buffer_queue, (void *)&dma_buffer, timeout);
-    if (dma_buffer) {
-        if(cam_obj->jpeg_mode){
-            // find the end marker for JPEG. Data after that can be discarded
-            int offset_e = cam_verify_jpeg_eoi(dma_buffer->buf, dma_buffer->len);
-            if (offset_e >= 0) {
-                // adjust buffer length
-                dma_buffer->len = offset_e + sizeof(JPEG_EOI_MARKER);
-                return dma_buffer;
-            } else {
-                ESP_LOGW(TAG, "NO-EOI");
-                cam_give(dma_buffer);
-                return cam_take(timeout - (xTaskGetTickCount() - start));//recurse!!!!
-            }
+    int pos = cam_frame_ring_pop(&cam_obj->frame_ring);
+    while (pos < 0) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= timeout || xSemaphoreTake(cam_obj->frame_ready, timeout - waited) != pdTRUE) {
+            break;
         }
-        return dma_buffer;
-    } else {
-        ESP_LOGI(TAG, "Failed to get the frame on time!");
+        pos = cam_frame_ring_pop(&cam_obj->frame_ring);
+    }
+    if (pos >= 0) {
+        // JPEG frames are queued only once their end marker was found, trimmed to it
+        cam_frame_t *frame = &cam_obj->frames[pos];
+        frame->fb.meta.queue_wait_us = esp_timer_get_time() - frame->queued_us;
+        atomic_fetch_add_explicit(&cam_obj->frames_taken, 1, memory_order_relaxed);
+        return &frame->fb;
     }
+    atomic_fetch_add_explicit(&cam_obj->fb_get_timeouts, 1, memory_order_relaxed);
+    ESP_LOGI(TAG, "Failed to get the frame on time!");
     return NULL;
 }
 
+bool cam_ref(camera_fb_t *dma_buffer)
+{
+    int pos = cam_get_frame_pos(dma_buffer);
+    return pos >= 0 && cam_frame_ring_ref(&cam_obj->frame_ring, pos);
+}
+
 void cam_give(camera_fb_t *dma_buffer)
 {
-    for (int x = 0; x < cam_obj->frame_cnt; x++) {
-        if (&cam_obj->frames[x].fb == dma_buffer) {
-            cam_obj->frames[x].en = 1;
-            break;
-        }
+    int pos = cam_get_frame_pos(dma_buffer);
+    if (pos >= 0) {
+        cam_frame_ring_give(&cam_obj->frame_ring, pos);
+    }
+}
+
+void cam_set_jpeg_profile(framesize_t frame_size, uint8_t quality)
+{
+    if (cam_obj->adaptive_fb) {
+        cam_fb_sizer_set_profile(&cam_obj->fb_sizer, ((uint32_t)frame_size << 8) | quality);
     }
 }
+
+void cam_get_stats(camera_stats_t *stats)
+{
+    stats->frames_captured = CAM_STAT_GET(cam_obj->stats.frames_captured);
+    stats->frames_taken = atomic_load_explicit(&cam_obj->frames_taken, memory_order_relaxed);
+    stats->frames_dropped = CAM_STAT_GET(cam_obj->stats.frames_dropped);
+    stats->fb_get_timeouts = atomic_load_explicit(&cam_obj->fb_get_timeouts, memory_order_relaxed);
+    stats->no_free_fb = CAM_STAT_GET(cam_obj->stats.no_free_fb);
+    stats->fb_overflow = CAM_STAT_GET(cam_obj->stats.fb_overflow);
+    stats->no_soi = CAM_STAT_GET(cam_obj->stats.no_soi);
+    stats->no_eoi = CAM_STAT_GET(cam_obj->stats.no_eoi);
+    stats->size_mismatch = CAM_STAT_GET(cam_obj->stats.size_mismatch);
+    stats->event_overflow = CAM_STAT_GET(cam_obj->stats.event_overflow);
+}
+
+void cam_get_fb_alloc_stats(camera_fb_alloc_stats_t *stats)
+{
+    stats->fb_size_total = CAM_STAT_GET(cam_obj->fb_stats.fb_size_total);
+    stats->fb_size_target = CAM_STAT_GET(cam_obj->fb_stats.fb_size_target);
+    stats->jpeg_high_water = CAM_STAT_GET(cam_obj->fb_stats.jpeg_high_water);
+    stats->overflows = CAM_STAT_GET(cam_obj->fb_stats.overflows);
+    stats->resizes = CAM_STAT_GET(cam_obj->fb_stats.resizes);
+    stats->resize_failures = CAM_STAT_GET(cam_obj->fb_stats.resize_failures);
+}
@@ -315,6 +315,9 @@ camera_fb_t *esp_camera_fb_get()
     if (s_state == NULL) {
         return NULL;
     }
+    if (s_state->sensor.pixformat == PIXFORMAT_JPEG) {
+        cam_set_jpeg_profile(s_state->sensor.status.framesize, s_state->sensor.status.quality);
+    }
     camera_fb_t *fb = cam_take(FB_GET_TIMEOUT);
     //set the frame properties
     if (fb) {
@@ -333,6 +336,46 @@ void esp_camera_fb_return(camera_fb_t *fb)
     cam_give(fb);
 }
 
+esp_err_t esp_camera_fb_ref(camera_fb_t *fb)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (fb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return cam_ref(fb) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+void esp_camera_fb_unref(camera_fb_t *fb)
+{
+    esp_camera_fb_return(fb);
+}
+
+esp_err_t esp_camera_get_stats(camera_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cam_get_stats(stats);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_get_fb_alloc_stats(camera_fb_alloc_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cam_get_fb_alloc_stats(stats);
+    return ESP_OK;
+}
+
 sensor_t *esp_camera_sensor_get()
 {
     if (s_state == NULL) {
@@ -39,7 +39,8 @@
         .frame_size     = FRAMESIZE_SVGA,
         .jpeg_quality   = 10,
         .fb_count       = 2,
-        .grab_mode      = CAMERA_GRAB_WHEN_EMPTY
+        .grab_mode      = CAMERA_GRAB_WHEN_EMPTY,
+        .dma_mode       = CAMERA_DMA_COPY
     };
 
     esp_err_t camera_example_init(){
@@ -83,6 +84,64 @@ typedef enum {
     CAMERA_GRAB_LATEST              /*!< Except when 1 frame buffer is used, queue will always contain the last 'fb_count' frames */
 } camera_grab_mode_t;
 
+/**
+ * @brief How captured data gets from the DMA into the frame buffers
+ */
+typedef enum {
+    CAMERA_DMA_COPY,                /*!< DMA fills an internal ping-pong buffer that is copied into the frame buffer */
+    CAMERA_DMA_ZERO_COPY            /*!< DMA descriptors point straight at the frame buffer. ESP32-S2/S3 only, falls back to CAMERA_DMA_COPY elsewhere */
+} camera_dma_mode_t;
+
+/**
+ * @brief Full lines of a frame, handed out by the strip streaming mode
+ */
+typedef struct {
+    const uint8_t * buf;        /*!< Pixel data of the lines, only valid during the callback */
+    size_t len;                 /*!< Length of the strip in bytes */
+    size_t width;               /*!< Width of the frame in pixels */
+    size_t height;              /*!< Height of the frame in pixels */
+    size_t y;                   /*!< First line of the strip */
+    size_t lines;               /*!< Number of lines in the strip */
+    pixformat_t format;         /*!< Format of the pixel data */
+    uint32_t sequence;          /*!< Number of the frame, counted like camera_fb_t.sequence */
+} camera_strip_t;
+
+/**
+ * @brief Receives the strips of every frame, top to bottom
+ *
+ * Runs in the camera task. It has to return before the DMA comes around to the strip again,
+ * a DMA buffer holds only a few strips.
+ */
+typedef void (*camera_strip_cb_t)(const camera_strip_t *strip, void *arg);
+
+/**
+ * @brief How far the JPEG frame being captured has come
+ */
+typedef enum {
+    CAMERA_JPEG_CHUNK_DATA,         /*!< A DMA chunk of the frame arrived, len has grown */
+    CAMERA_JPEG_CHUNK_DONE,         /*!< The frame is complete, len is final and the frame is queued for esp_camera_fb_get() next */
+    CAMERA_JPEG_CHUNK_DROPPED,      /*!< The frame was dropped (overflow, no SOI or no EOI), its buffer is captured into again */
+} camera_jpeg_chunk_state_t;
+
+/**
+ * @brief The JPEG frame in a frame buffer while it is being captured
+ */
+typedef struct {
+    const uint8_t * buf;                /*!< Frame buffer the frame is captured into */
+    size_t len;                         /*!< Bytes of the frame in buf so far */
+    uint32_t sequence;                  /*!< Number the frame gets as camera_fb_t.sequence if it is complete */
+    camera_jpeg_chunk_state_t state;
+} camera_jpeg_chunk_t;
+
+/**
+ * @brief Receives the progress of every JPEG frame, to decode it while the rest is still captured, see esp_jpg_stream_write()
+ *
+ * Runs in the camera task after each DMA chunk. The first len bytes of buf do not change and buf is not
+ * captured into again before the call with CAMERA_JPEG_CHUNK_DONE or CAMERA_JPEG_CHUNK_DROPPED has returned.
+ * The callback holds up the next chunks, hand len to a task on the other core for more than a few MCUs of work.
+ */
+typedef void (*camera_jpeg_chunk_cb_t)(const camera_jpeg_chunk_t *chunk, void *arg);
+
 /**
  * @brief Configuration structure for camera initialization
  */
@@ -115,8 +174,26 @@ typedef struct {
     int jpeg_quality;               /*!< Quality of JPEG output. 0-63 lower means higher quality  */
     size_t fb_count;                /*!< Number of frame buffers to be allocated. If more than one, then each frame will be acquired (double speed)  */
     camera_grab_mode_t grab_mode;   /*!< When buffers should be filled */
+    camera_dma_mode_t dma_mode;     /*!< How data gets from the DMA into the frame buffers */
+    size_t jpeg_fb_budget;          /*!< JPEG only: bytes all frame buffers together may use. Non-zero sizes the frame buffers from the lengths of the captured frames instead of width*height/5. Not used with CAMERA_DMA_ZERO_COPY */
+    camera_strip_cb_t strip_cb;     /*!< Not for JPEG: stream every frame to this callback in strips of full lines, straight from the internal DMA buffer. No frame buffers are allocated and esp_camera_fb_get() returns NULL */
+    void * strip_cb_arg;            /*!< Argument passed to strip_cb */
+    camera_jpeg_chunk_cb_t jpeg_chunk_cb;   /*!< JPEG only: called with the frame in progress after every DMA chunk, to decode it during the capture */
+    void * jpeg_chunk_cb_arg;       /*!< Argument passed to jpeg_chunk_cb */
 } camera_config_t;
 
+/**
+ * @brief Capture timing of a frame buffer. Times are esp_timer_get_time() microseconds
+ */
+typedef struct {
+    int64_t vsync_us;           /*!< VSYNC that started the frame */
+    int64_t first_dma_us;       /*!< First DMA chunk of the frame received */
+    int64_t last_dma_us;        /*!< Last DMA chunk of the frame received */
+    uint32_t dma_chunks;        /*!< DMA chunks (half buffers) the frame arrived in */
+    uint32_t bytes_copied;      /*!< Bytes copied from the DMA buffer into the frame buffer, 0 with CAMERA_DMA_ZERO_COPY */
+    uint32_t queue_wait_us;     /*!< Time the frame waited in the queue before esp_camera_fb_get() returned it */
+} camera_fb_meta_t;
+
 /**
  * @brief Data structure of camera frame buffer
  */
@@ -127,8 +204,38 @@ typedef struct {
     size_t height;              /*!< Height of the buffer in pixels */
     pixformat_t format;         /*!< Format of the pixel data */
     struct timeval timestamp;   /*!< Timestamp since boot of the first DMA buffer of the frame */
+    uint32_t sequence;          /*!< Number of the frame since the camera was configured, starting at 1. Gaps mean dropped frames */
+    camera_fb_meta_t meta;      /*!< Capture timing of the frame */
 } camera_fb_t;
 
+/**
+ * @brief Frame buffer allocation statistics
+ */
+typedef struct {
+    size_t fb_size_total;       /*!< Bytes currently allocated to the frame buffers */
+    size_t fb_size_target;      /*!< Frame buffer size wanted for the current frame size and quality */
+    size_t jpeg_high_water;     /*!< Largest JPEG frame seen at the current frame size and quality */
+    uint32_t overflows;         /*!< Frames dropped because they did not fit into their frame buffer */
+    uint32_t resizes;           /*!< Frame buffers reallocated by adaptive JPEG sizing */
+    uint32_t resize_failures;   /*!< Reallocations that failed, the frame buffer kept its size */
+} camera_fb_alloc_stats_t;
+
+/**
+ * @brief Capture event counters since the camera was initialized
+ */
+typedef struct {
+    uint32_t frames_captured;   /*!< Frames queued for the application, or streamed completely to strip_cb */
+    uint32_t frames_taken;      /*!< Frames returned by esp_camera_fb_get() */
+    uint32_t frames_dropped;    /*!< Queued frames replaced by newer ones before they were taken */
+    uint32_t fb_get_timeouts;   /*!< Calls to esp_camera_fb_get() that returned NULL */
+    uint32_t no_free_fb;        /*!< Frames not captured because every frame buffer was in use */
+    uint32_t fb_overflow;       /*!< Frames dropped because they did not fit into the frame buffer (FB-OVF) */
+    uint32_t no_soi;            /*!< JPEG frames dropped because they did not start with SOI (NO-SOI) */
+    uint32_t no_eoi;            /*!< JPEG frames dropped because no EOI was found (NO-EOI) */
+    uint32_t size_mismatch;     /*!< Raw frames dropped because of a wrong length (FB-SIZE), or streamed with lines missing */
+    uint32_t event_overflow;    /*!< Capture restarts because the DMA event queue was full (EV-OVF) */
+} camera_stats_t;
+
 #define ESP_ERR_CAMERA_BASE 0x20000
 #define ESP_ERR_CAMERA_NOT_DETECTED             (ESP_ERR_CAMERA_BASE + 1)
 #define ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE (ESP_ERR_CAMERA_BASE + 2)
@@ -176,6 +283,52 @@ camera_fb_t* esp_camera_fb_get();
  */
 void esp_camera_fb_return(camera_fb_t * fb);
 
+/**
+ * @brief Add a holder to a frame buffer, so it can be shared with another task.
+ *
+ * The frame buffer goes back to the driver once every holder has released it
+ * with esp_camera_fb_unref() or esp_camera_fb_return().
+ *
+ * @param fb    Pointer to a frame buffer obtained with esp_camera_fb_get()
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver isn't running, fb is not held or has already been returned
+ *      - ESP_ERR_INVALID_ARG if fb is NULL
+ */
+esp_err_t esp_camera_fb_ref(camera_fb_t * fb);
+
+/**
+ * @brief Release one holder of a frame buffer. Same as esp_camera_fb_return().
+ *
+ * @param fb    Pointer to the frame buffer
+ */
+void esp_camera_fb_unref(camera_fb_t * fb);
+
+/**
+ * @brief Get the capture event counters
+ *
+ * @param stats Filled with the current values
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_get_stats(camera_stats_t *stats);
+
+/**
+ * @brief Get the frame buffer allocation statistics
+ *
+ * @param stats Filled with the current values
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_get_fb_alloc_stats(camera_fb_alloc_stats_t *stats);
+
 /**
  * @brief Get a pointer to the image sensor control structure
  *
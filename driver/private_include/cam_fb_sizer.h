@@ -0,0 +1,91 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAM_FB_SIZER_PROFILES   4       // framesize/quality combinations remembered
+#define CAM_FB_SIZER_WINDOW     32      // recent frame lengths kept per profile
+#define CAM_FB_SIZER_GRANULE    1024    // buffer sizes are rounded up to this
+
+/**
+ * @brief JPEG lengths observed at one framesize/quality combination
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t last_used;
+    uint32_t high_water;                    // largest frame since the profile was created
+    uint32_t target;                        // buffer size wanted for the next frames, 0 = no data yet
+    uint32_t lengths[CAM_FB_SIZER_WINDOW];
+    uint8_t count;
+    uint8_t next;
+} cam_fb_profile_t;
+
+/**
+ * @brief Picks JPEG frame buffer sizes from the lengths of the previous frames
+ *
+ * The target is the 95th percentile of the recent lengths plus a quarter of headroom,
+ * but never below the largest recent frame. Frames are grown to the target as soon as
+ * possible and only shrunk once they are half as big again as needed, so the buffers
+ * are not reallocated on every small change of the scene.
+ * Everything but cam_fb_sizer_set_profile() must be called from the capture task.
+ */
+typedef struct {
+    cam_fb_profile_t profiles[CAM_FB_SIZER_PROFILES];
+    cam_fb_profile_t *current;
+    _Atomic uint32_t key;                   // profile of the frames being captured
+    uint32_t clock;
+    size_t initial_size;                    // used until a profile has seen a frame
+    size_t min_size;
+    size_t max_size;                        // per frame
+    size_t budget;                          // all frames together
+} cam_fb_sizer_t;
+
+void cam_fb_sizer_init(cam_fb_sizer_t *sizer, size_t initial_size, size_t min_size, size_t max_size, size_t budget);
+
+// may be called from any task, takes effect with the next finished frame
+void cam_fb_sizer_set_profile(cam_fb_sizer_t *sizer, uint32_t key);
+
+// a complete frame of len bytes was captured
+void cam_fb_sizer_add(cam_fb_sizer_t *sizer, size_t len);
+
+// a frame did not fit into a buffer of capacity bytes
+void cam_fb_sizer_overflow(cam_fb_sizer_t *sizer, size_t capacity);
+
+// size wanted for frames of the current profile
+size_t cam_fb_sizer_target(cam_fb_sizer_t *sizer);
+
+// high water mark of the current profile
+size_t cam_fb_sizer_high_water(cam_fb_sizer_t *sizer);
+
+/**
+ * @brief New capacity for a frame buffer of current bytes
+ *
+ * @param total  bytes allocated to all frame buffers together, current included
+ *
+ * @return current when the buffer should stay as it is
+ */
+size_t cam_fb_sizer_resize(cam_fb_sizer_t *sizer, size_t current, size_t total);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Ownership of a frame slot
+ *
+ * FREE -> FILLING (capture task) -> READY (queued) -> HELD (application) -> FREE
+ * A READY frame may also go straight back to FREE when it is dropped as the oldest one.
+ * A HELD frame can have several holders, it becomes FREE when the last one gives it back.
+ */
+typedef enum {
+    CAM_FRAME_FREE = 0,
+    CAM_FRAME_FILLING,
+    CAM_FRAME_READY,
+    CAM_FRAME_HELD,
+} cam_frame_state_t;
+
+/**
+ * @brief Lock-free queue of captured frame indexes
+ *
+ * Frames are pushed by a single producer (cam_task) and popped by the
+ * application. Popping and dropping the oldest entry both advance the tail
+ * with a compare-and-swap, so the producer can evict while a consumer takes.
+ * head and tail are free running, slot = counter & mask.
+ */
+typedef struct {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint32_t mask;
+    uint32_t limit;             // frames that can be queued at once
+    uint32_t frame_cnt;
+    _Atomic uint8_t *index;     // mask + 1 entries
+    _Atomic uint8_t *state;     // frame_cnt entries of cam_frame_state_t
+    _Atomic uint8_t *refs;      // frame_cnt entries, holders of a HELD frame
+} cam_frame_ring_t;
+
+bool cam_frame_ring_init(cam_frame_ring_t *ring, uint32_t frame_cnt, uint32_t limit);
+void cam_frame_ring_deinit(cam_frame_ring_t *ring);
+
+// producer: claim a frame to capture into, preferring pos. Returns -1 if all frames are taken
+int cam_frame_ring_acquire(cam_frame_ring_t *ring, int pos);
+// producer: queue a FILLING frame. When full the oldest frame is dropped and returned in dropped (else -1)
+bool cam_frame_ring_push(cam_frame_ring_t *ring, int pos, int *dropped);
+
+// consumer: take the oldest READY frame, -1 if there is none
+int cam_frame_ring_pop(cam_frame_ring_t *ring);
+// consumer: add a holder to a HELD frame
+bool cam_frame_ring_ref(cam_frame_ring_t *ring, int pos);
+// consumer: drop a holder, the last one hands the frame back to the producer
+bool cam_frame_ring_give(cam_frame_ring_t *ring, int pos);
+
+static inline cam_frame_state_t cam_frame_ring_state(cam_frame_ring_t *ring, int pos)
+{
+    return (cam_frame_state_t)atomic_load_explicit(&ring->state[pos], memory_order_acquire);
+}
+
+static inline uint32_t cam_frame_ring_count(cam_frame_ring_t *ring)
+{
+    // tail first, it can only move up to the head loaded after it
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return atomic_load_explicit(&ring->head, memory_order_acquire) - tail;
+}
+
+#ifdef __cplusplus
+}
+#endif
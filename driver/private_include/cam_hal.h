@@ -53,8 +53,16 @@ void cam_start(void);
 
 camera_fb_t *cam_take(TickType_t timeout);
 
+bool cam_ref(camera_fb_t *dma_buffer);
+
 void cam_give(camera_fb_t *dma_buffer);
 
+void cam_set_jpeg_profile(framesize_t frame_size, uint8_t quality);
+
+void cam_get_stats(camera_stats_t *stats);
+
+void cam_get_fb_alloc_stats(camera_fb_alloc_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,152 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_attr.h"
+#include "ll_cam_dma_filter.h"
+
+/*
+ * The kernels read whole DMA elements and merge the samples in registers,
+ * so the frame buffer (usually PSRAM) only sees aligned 32-bit stores.
+ * Bytes before the first / after the last aligned word of dst are stored one by one.
+ * Both the ESP32 and the hosts the tests run on are little-endian.
+ */
+
+#define FILTER_INLINE static inline __attribute__((always_inline))
+
+#define S1(e) ((uint8_t)((e) >> 16))
+#define S2(e) ((uint8_t)(e))
+
+// sample1 of four elements -> one word
+FILTER_INLINE uint32_t pack_s1(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    return ((a >> 16) & 0x000000FF) | ((b >> 8) & 0x0000FF00) | (c & 0x00FF0000) | ((d << 8) & 0xFF000000);
+}
+
+// sample1, sample2 of two elements -> one word
+FILTER_INLINE uint32_t pack_s1s2(uint32_t a, uint32_t b)
+{
+    return ((a >> 16) & 0x000000FF) | ((a << 8) & 0x0000FF00) | (b & 0x00FF0000) | (b << 24);
+}
+
+// dst[i] = sample1 of el[i * stride], for i in [0, count)
+FILTER_INLINE void filter_sample1(uint8_t *dst, const uint32_t *el, size_t count, const size_t stride)
+{
+    size_t i = 0;
+    for (; i < count && ((uintptr_t)(dst + i) & 3); ++i, el += stride) {
+        dst[i] = S1(el[0]);
+    }
+    uint32_t *dw = (uint32_t *)(dst + i);
+    for (; (i + 8) <= count; i += 8, el += 8 * stride) {
+        dw[0] = pack_s1(el[0], el[stride], el[2 * stride], el[3 * stride]);
+        dw[1] = pack_s1(el[4 * stride], el[5 * stride], el[6 * stride], el[7 * stride]);
+        dw += 2;
+    }
+    if ((i + 4) <= count) {
+        dw[0] = pack_s1(el[0], el[stride], el[2 * stride], el[3 * stride]);
+        el += 4 * stride;
+        i += 4;
+    }
+    for (; i < count; ++i, el += stride) {
+        dst[i] = S1(el[0]);
+    }
+}
+
+size_t IRAM_ATTR ll_cam_dma_filter_jpeg(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    filter_sample1(dst, el, elements & ~(size_t)3, 1);
+    return elements;
+}
+
+size_t IRAM_ATTR ll_cam_dma_filter_grayscale(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    filter_sample1(dst, el, elements & ~(size_t)3, 1);
+    return elements;
+}
+
+size_t IRAM_ATTR ll_cam_dma_filter_grayscale_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 8;
+    filter_sample1(dst, el, end * 4, 2);
+    // the final sample of a line in SM_0A0B_0B0C sampling mode needs special handling
+    if ((elements & 0x7) != 0) {
+        el += end * 8;
+        dst += end * 4;
+        dst[0] = S1(el[0]);
+        dst[1] = S1(el[2]);
+        elements += 1;
+    }
+    return elements * 2;
+}
+
+size_t IRAM_ATTR ll_cam_dma_filter_yuyv(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    size_t count = elements & ~(size_t)3;
+    size_t i = 0;
+    if ((uintptr_t)dst & 1) {
+        // odd destination, no element pair ever lines up with a word
+        for (; i < count; ++i) {
+            dst[0] = S1(el[i]);//y
+            dst[1] = S2(el[i]);//u/v
+            dst += 2;
+        }
+        return elements * 2;
+    }
+    if (count && ((uintptr_t)dst & 2)) {
+        dst[0] = S1(el[0]);
+        dst[1] = S2(el[0]);
+        dst += 2;
+        i = 1;
+    }
+    uint32_t *dw = (uint32_t *)dst;
+    for (; (i + 4) <= count; i += 4) {
+        dw[0] = pack_s1s2(el[i], el[i + 1]);//y0 u y1 v
+        dw[1] = pack_s1s2(el[i + 2], el[i + 3]);
+        dw += 2;
+    }
+    dst = (uint8_t *)dw;
+    for (; i < count; ++i) {
+        dst[0] = S1(el[i]);
+        dst[1] = S2(el[i]);
+        dst += 2;
+    }
+    return elements * 2;
+}
+
+size_t IRAM_ATTR ll_cam_dma_filter_yuyv_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 8;
+    filter_sample1(dst, el, end * 8, 1);
+    if ((elements & 0x7) != 0) {
+        el += end * 8;
+        dst += end * 8;
+        dst[0] = S1(el[0]);//y0
+        dst[1] = S1(el[1]);//u
+        dst[2] = S1(el[2]);//y1
+        dst[3] = S2(el[2]);//v
+        elements += 4;
+    }
+    return elements;
+}
@@ -0,0 +1,41 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ESP32 I2S camera mode writes every sample into a 32-bit DMA element:
+ * sample1 lives in bits 16..23, sample2 in bits 0..7.
+ * The filters below extract the samples into the frame buffer.
+ * src must be 32-bit aligned, dst may have any alignment.
+ * They return the number of bytes the frame buffer grew by.
+ */
+typedef size_t (*dma_filter_t)(uint8_t* dst, const uint8_t* src, size_t len);
+
+size_t ll_cam_dma_filter_jpeg(uint8_t* dst, const uint8_t* src, size_t len);
+size_t ll_cam_dma_filter_grayscale(uint8_t* dst, const uint8_t* src, size_t len);
+size_t ll_cam_dma_filter_grayscale_highspeed(uint8_t* dst, const uint8_t* src, size_t len);
+size_t ll_cam_dma_filter_yuyv(uint8_t* dst, const uint8_t* src, size_t len);
+size_t ll_cam_dma_filter_yuyv_highspeed(uint8_t* dst, const uint8_t* src, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,388 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Simulated camera peripheral for host builds. A thread stands in for the sensor,
+// the DMA and the interrupts: it replays recorded frames into the DMA descriptors
+// and raises the events the LCD_CAM/GDMA interrupts of the ESP32-S3 would.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "ll_cam.h"
+#include "ll_cam_sim.h"
+#include "cam_hal.h"
+
+static const char *TAG = "sim ll_cam";
+
+struct intr_handle_data_t {
+    pthread_t thread;
+    _Atomic bool quit;
+    cam_obj_t *cam;
+};
+
+static struct {
+    pthread_mutex_t lock;//recursive, ll_cam_send_event() stops the DMA when the event queue is full
+    ll_cam_sim_config_t config;
+    bool vsync_en;
+    bool dma_en;
+    bool eof_en;
+    lldesc_t *dma;
+    size_t node;//next descriptor to fill
+    size_t eof_bytes;//bytes received since the last EOF
+} sim;
+
+static pthread_once_t sim_once = PTHREAD_ONCE_INIT;
+
+static void ll_cam_sim_init_lock(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sim.lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static void ll_cam_sim_lock(void)
+{
+    pthread_once(&sim_once, ll_cam_sim_init_lock);
+    pthread_mutex_lock(&sim.lock);
+}
+
+static void ll_cam_sim_unlock(void)
+{
+    pthread_mutex_unlock(&sim.lock);
+}
+
+void ll_cam_sim_set_stream(const ll_cam_sim_config_t *config)
+{
+    ll_cam_sim_lock();
+    sim.config = *config;
+    ll_cam_sim_unlock();
+}
+
+// advance the deadline by ns and sleep until it passed
+static void ll_cam_sim_wait(struct timespec *deadline, uint64_t ns)
+{
+    if (ns == 0) {
+        return;
+    }
+    ns += deadline->tv_nsec;
+    deadline->tv_sec += ns / 1000000000ULL;
+    deadline->tv_nsec = ns % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) != 0) {
+    }
+}
+
+static bool ll_cam_sim_task_idle(cam_obj_t *cam)
+{
+    return uxQueueHostReceiversWaiting(cam->event_queue) > 0;
+}
+
+// the interrupt, raised only while it is enabled. In lockstep it waits until cam_task is idle, before and after
+static void ll_cam_sim_raise(intr_handle_t handle, cam_event_t event)
+{
+    cam_obj_t *cam = handle->cam;
+    bool raised = false;
+    while (!handle->quit) {
+        ll_cam_sim_lock();
+        // once raised, wait for cam_task unless the camera was stopped: its queue and task may be gone
+        bool enabled = (event == CAM_VSYNC_EVENT || raised) ? sim.vsync_en : sim.eof_en;
+        if (!enabled) {
+            ll_cam_sim_unlock();
+            return;
+        }
+        if (sim.config.pclk_hz || ll_cam_sim_task_idle(cam)) {
+            if (raised) {
+                ll_cam_sim_unlock();
+                return;
+            }
+            BaseType_t HPTaskAwoken = pdFALSE;
+            ll_cam_send_event(cam, event, &HPTaskAwoken);
+            raised = true;
+            if (sim.config.pclk_hz) {
+                ll_cam_sim_unlock();
+                return;
+            }
+        }
+        ll_cam_sim_unlock();
+        sched_yield();
+    }
+}
+
+// the DMA takes up to one descriptor of the stream, returns how many bytes the sensor sent meanwhile
+static size_t ll_cam_sim_dma(intr_handle_t handle, const uint8_t *data, size_t len)
+{
+    cam_obj_t *cam = handle->cam;
+    bool eof = false;
+
+    ll_cam_sim_lock();
+    if (!sim.dma_en) {
+        ll_cam_sim_unlock();
+        return len < cam->dma_node_buffer_size ? len : cam->dma_node_buffer_size;
+    }
+    lldesc_t *node = &sim.dma[sim.node % cam->dma_node_cnt];
+    size_t n = len < node->size ? len : node->size;
+    memcpy((uint8_t *)node->buf, data, n);
+    node->length = n;
+    sim.node++;
+    sim.eof_bytes += n;
+    if (sim.eof_bytes >= cam->dma_half_buffer_size) {
+        sim.eof_bytes -= cam->dma_half_buffer_size;
+        eof = true;
+    }
+    ll_cam_sim_unlock();
+
+    if (eof) {
+        ll_cam_sim_raise(handle, CAM_IN_SUC_EOF_EVENT);
+    }
+    return n;
+}
+
+static void *ll_cam_sim_main(void *arg)
+{
+    intr_handle_t handle = (intr_handle_t)arg;
+    const ll_cam_sim_config_t *config = &sim.config;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    for (size_t f = 0; !handle->quit; f++) {
+        const ll_cam_sim_frame_t *frame = &config->frames[f % config->frame_cnt];
+        ll_cam_sim_wait(&deadline, (uint64_t)config->vblank_us * 1000);
+        ll_cam_sim_raise(handle, CAM_VSYNC_EVENT);
+        ll_cam_sim_wait(&deadline, (uint64_t)config->vsync_us * 1000);
+        for (size_t pos = 0; pos < frame->len && !handle->quit;) {
+            size_t n = ll_cam_sim_dma(handle, frame->data + pos, frame->len - pos);
+            pos += n;
+            if (config->pclk_hz) {
+                ll_cam_sim_wait(&deadline, (uint64_t)n * 1000000000ULL / config->pclk_hz);
+            }
+        }
+        if (!config->pclk_hz) {
+            // nothing paces the stream while the interrupts are off
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// the simulated peripheral is the only interrupt source, freeing its interrupt stops it
+esp_err_t esp_intr_free(intr_handle_t handle)
+{
+    handle->quit = true;
+    pthread_join(handle->thread, NULL);
+    free(handle);
+    return ESP_OK;
+}
+
+bool ll_cam_stop(cam_obj_t *cam)
+{
+    ll_cam_sim_lock();
+    sim.dma_en = false;
+    sim.eof_en = false;
+    ll_cam_sim_unlock();
+    return true;
+}
+
+bool ll_cam_start(cam_obj_t *cam, int frame_pos)
+{
+    ll_cam_sim_lock();
+    if (!cam->psram_mode) {
+        sim.dma = cam->dma;
+    } else {
+        sim.dma = cam->frames[frame_pos].dma;
+    }
+    sim.node = 0;
+    sim.eof_bytes = 0;
+    sim.eof_en = cam->jpeg_mode || !cam->psram_mode;
+    sim.dma_en = true;
+    ll_cam_sim_unlock();
+    return true;
+}
+
+esp_err_t ll_cam_config(cam_obj_t *cam, const camera_config_t *config)
+{
+    if (sim.config.frames == NULL || sim.config.frame_cnt == 0) {
+        ESP_LOGE(TAG, "No stream to replay, call ll_cam_sim_set_stream() first");
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+void ll_cam_vsync_intr_enable(cam_obj_t *cam, bool en)
+{
+    ll_cam_sim_lock();
+    sim.vsync_en = en;
+    ll_cam_sim_unlock();
+}
+
+esp_err_t ll_cam_set_pin(cam_obj_t *cam, const camera_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t ll_cam_init_isr(cam_obj_t *cam)
+{
+    intr_handle_t handle = (intr_handle_t)calloc(1, sizeof(struct intr_handle_data_t));
+    if (handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    handle->cam = cam;
+    if (pthread_create(&handle->thread, NULL, ll_cam_sim_main, handle) != 0) {
+        free(handle);
+        return ESP_FAIL;
+    }
+    cam->cam_intr_handle = handle;
+    return ESP_OK;
+}
+
+void ll_cam_do_vsync(cam_obj_t *cam)
+{
+    // the replayed stream needs no resynchronization
+}
+
+uint8_t ll_cam_get_dma_align(cam_obj_t *cam)
+{
+    return 64;
+}
+
+// same DMA layout as the ESP32-S3
+static void ll_cam_calc_rgb_dma(cam_obj_t *cam){
+    size_t node_max = LCD_CAM_DMA_NODE_BUFFER_MAX_SIZE / cam->dma_bytes_per_item;
+    size_t line_width = cam->width * cam->in_bytes_per_pixel;
+    size_t node_size = node_max;
+    size_t nodes_per_line = 1;
+    size_t lines_per_node = 1;
+
+    // Calculate DMA Node Size so that it's divisable by or divisor of the line width
+    if(line_width >= node_max){
+        // One or more nodes will be requied for one line
+        for(size_t i = node_max; i > 0; i=i-1){
+            if ((line_width % i) == 0) {
+                node_size = i;
+                nodes_per_line = line_width / node_size;
+                break;
+            }
+        }
+    } else {
+        // One or more lines can fit into one node
+        for(size_t i = node_max; i > 0; i=i-1){
+            if ((i % line_width) == 0) {
+                node_size = i;
+                lines_per_node = node_size / line_width;
+                while((cam->height % lines_per_node) != 0){
+                    lines_per_node = lines_per_node - 1;
+                    node_size = lines_per_node * line_width;
+                }
+                break;
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "node_size: %4zu, nodes_per_line: %zu, lines_per_node: %zu",
+            node_size * cam->dma_bytes_per_item, nodes_per_line, lines_per_node);
+
+    cam->dma_node_buffer_size = node_size * cam->dma_bytes_per_item;
+
+    size_t dma_half_buffer_max = 16 * 1024 / cam->dma_bytes_per_item;
+    if (line_width > dma_half_buffer_max) {
+        ESP_LOGE(TAG, "Resolution too high");
+        return;
+    }
+
+    // Calculate minimum EOF size = max(mode_size, line_size)
+    size_t dma_half_buffer_min = node_size * nodes_per_line;
+
+    // Calculate max EOF size divisable by node size
+    size_t dma_half_buffer = (dma_half_buffer_max / dma_half_buffer_min) * dma_half_buffer_min;
+
+    // Adjust EOF size so that height will be divisable by the number of lines in each EOF
+    size_t lines_per_half_buffer = dma_half_buffer / line_width;
+    while((cam->height % lines_per_half_buffer) != 0){
+        dma_half_buffer = dma_half_buffer - dma_half_buffer_min;
+        lines_per_half_buffer = dma_half_buffer / line_width;
+    }
+
+    // Calculate DMA size
+    size_t dma_buffer_max = 2 * dma_half_buffer_max;
+    if (cam->psram_mode) {
+        dma_buffer_max = cam->recv_size / cam->dma_bytes_per_item;
+    }
+    size_t dma_buffer_size = dma_buffer_max;
+    if (!cam->psram_mode) {
+        dma_buffer_size =(dma_buffer_max / dma_half_buffer) * dma_half_buffer;
+    }
+
+    ESP_LOGI(TAG, "dma_half_buffer_min: %5zu, dma_half_buffer: %5zu, lines_per_half_buffer: %2zu, dma_buffer_size: %5zu",
+            dma_half_buffer_min * cam->dma_bytes_per_item, dma_half_buffer * cam->dma_bytes_per_item, lines_per_half_buffer, dma_buffer_size * cam->dma_bytes_per_item);
+
+    cam->dma_buffer_size = dma_buffer_size * cam->dma_bytes_per_item;
+    cam->dma_half_buffer_size = dma_half_buffer * cam->dma_bytes_per_item;
+    cam->dma_half_buffer_cnt = cam->dma_buffer_size / cam->dma_half_buffer_size;
+}
+
+void ll_cam_dma_sizes(cam_obj_t *cam)
+{
+    cam->dma_bytes_per_item = 1;
+    if (cam->jpeg_mode) {
+        if (cam->psram_mode) {
+            cam->dma_buffer_size = cam->recv_size;
+            cam->dma_half_buffer_size = 1024;
+            cam->dma_half_buffer_cnt = cam->dma_buffer_size / cam->dma_half_buffer_size;
+            cam->dma_node_buffer_size = cam->dma_half_buffer_size;
+        } else {
+            cam->dma_half_buffer_cnt = 16;
+            cam->dma_buffer_size = cam->dma_half_buffer_cnt * 1024;
+            cam->dma_half_buffer_size = cam->dma_buffer_size / cam->dma_half_buffer_cnt;
+            cam->dma_node_buffer_size = cam->dma_half_buffer_size;
+        }
+    } else {
+        ll_cam_calc_rgb_dma(cam);
+    }
+}
+
+size_t ll_cam_memcpy(uint8_t *out, const uint8_t *in, size_t len)
+{
+    memcpy(out, in, len);
+    return len;
+}
+
+esp_err_t ll_cam_set_sample_mode(cam_obj_t *cam, pixformat_t pix_format, uint32_t xclk_freq_hz, uint8_t sensor_pid)
+{
+    if (pix_format == PIXFORMAT_GRAYSCALE) {
+        if (sensor_pid == OV3660_PID || sensor_pid == OV5640_PID || sensor_pid == NT99141_PID) {
+            cam->in_bytes_per_pixel = 1;       // camera sends Y8
+        } else {
+            cam->in_bytes_per_pixel = 2;       // camera sends YU/YV
+        }
+        cam->fb_bytes_per_pixel = 1;       // frame buffer stores Y8
+    } else if (pix_format == PIXFORMAT_YUV422 || pix_format == PIXFORMAT_RGB565) {
+            cam->in_bytes_per_pixel = 2;       // camera sends YU/YV
+            cam->fb_bytes_per_pixel = 2;       // frame buffer stores YU/YV/RGB565
+    } else if (pix_format == PIXFORMAT_JPEG) {
+        if (sensor_pid != OV2640_PID && sensor_pid != OV3660_PID && sensor_pid != OV5640_PID  && sensor_pid != NT99141_PID) {
+            ESP_LOGE(TAG, "JPEG format is not supported on this sensor");
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        cam->in_bytes_per_pixel = 1;
+        cam->fb_bytes_per_pixel = 1;
+    } else {
+        ESP_LOGE(TAG, "Requested format is not supported");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
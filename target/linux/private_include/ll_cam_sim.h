@@ -0,0 +1,56 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Recorded sensor output of one frame, everything the sensor sends between two VSYNCs
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} ll_cam_sim_frame_t;
+
+/**
+ * @brief Byte stream replayed by the simulated camera peripheral
+ *
+ * The frames are replayed in a loop on an 8-bit bus, one byte per pixel clock.
+ * Every frame raises CAM_VSYNC_EVENT while the VSYNC interrupt is enabled, the DMA
+ * raises CAM_IN_SUC_EOF_EVENT each time it has filled dma_half_buffer_size bytes.
+ */
+typedef struct {
+    const ll_cam_sim_frame_t *frames;   /*!< Frames to replay, must stay valid while the camera runs */
+    size_t frame_cnt;                   /*!< Number of frames */
+    uint32_t pclk_hz;                   /*!< Pixel clock. 0 runs in lockstep with cam_task: every event waits until cam_task is idle and the stream resumes once it was handled */
+    uint32_t vsync_us;                  /*!< Time between VSYNC and the first byte of the frame */
+    uint32_t vblank_us;                 /*!< Time between the last byte of a frame and the next VSYNC */
+} ll_cam_sim_config_t;
+
+/**
+ * @brief Set the stream to replay, must be called before cam_init()
+ *
+ * @param config Stream configuration, copied
+ */
+void ll_cam_sim_set_stream(const ll_cam_sim_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
@@ -27,6 +27,8 @@
 #include "esp32s2/rom/lldesc.h"
 #elif CONFIG_IDF_TARGET_ESP32S3
 #include "esp32s3/rom/lldesc.h"
+#elif CONFIG_IDF_TARGET_LINUX
+#include "rom/lldesc.h"
 #endif
 #include "esp_log.h"
 #include "esp_camera.h"
@@ -35,6 +37,8 @@
 #include "freertos/queue.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "cam_frame_ring.h"
+#include "cam_fb_sizer.h"
 
 #define CAMERA_DBG_PIN_ENABLE 0
 #if CAMERA_DBG_PIN_ENABLE
@@ -73,7 +77,8 @@ typedef enum {
 
 typedef struct {
     camera_fb_t fb;
-    uint8_t en;
+    size_t fb_size;//capacity of fb.buf
+    int64_t queued_us;
     //for RGB/YUV modes
     lldesc_t *dma;
     size_t fb_offset;
@@ -95,7 +100,8 @@ typedef struct {
     cam_frame_t *frames;
 
     QueueHandle_t event_queue;
-    QueueHandle_t frame_buffer_queue;
+    cam_frame_ring_t frame_ring;
+    SemaphoreHandle_t frame_ready;//given every time a frame is queued
     TaskHandle_t task_handle;
     intr_handle_t cam_intr_handle;
 	
@@ -106,9 +112,27 @@ typedef struct {
     uint8_t vsync_pin;
     uint8_t vsync_invert;
     uint32_t frame_cnt;
+    uint32_t frame_sequence;//sequence number of the last queued frame
     uint32_t recv_size;
     bool swap_data;
-    bool psram_mode;
+    bool psram_mode;//DMA writes straight into the frame buffers
+    bool adaptive_fb;//JPEG frame buffers follow the observed frame lengths
+    size_t fb_budget;
+    cam_fb_sizer_t fb_sizer;
+    camera_fb_alloc_stats_t fb_stats;//updated by cam_task only
+    camera_stats_t stats;//every counter has a single writer, except the ones below
+    _Atomic uint32_t frames_taken;
+    _Atomic uint32_t fb_get_timeouts;
+
+    //for the strip streaming mode
+    camera_strip_cb_t strip_cb;
+    void *strip_cb_arg;
+    uint8_t *strip_buf;//DMA items converted to pixels, when they are wider than a byte
+    pixformat_t pix_format;
+
+    //for the JPEG frame in progress
+    camera_jpeg_chunk_cb_t jpeg_chunk_cb;
+    void *jpeg_chunk_cb_arg;
 
     //for RGB/YUV modes
     uint16_t width;
@@ -0,0 +1,102 @@
+// Streams a recorded frame through cam_hal on the simulated peripheral, for perf and the sanitizers:
+//   cam_sim_bench <frame file> [frames] [pclk_hz, 0 = lockstep] [copy|zero-copy] [jpeg|rgb565]
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "cam_hal.h"
+#include "ll_cam_sim.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <frame file> [frames] [pclk_hz] [copy|zero-copy] [jpeg|rgb565]\n", argv[0]);
+        return 1;
+    }
+    int frames = argc > 2 ? atoi(argv[2]) : 1000;
+    uint32_t pclk_hz = argc > 3 ? strtoul(argv[3], NULL, 0) : 0;
+    bool zero_copy = argc > 4 && strcmp(argv[4], "zero-copy") == 0;
+    bool rgb565 = argc > 5 && strcmp(argv[5], "rgb565") == 0;
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    ll_cam_sim_frame_t frame = { .len = ftell(f) };
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = (uint8_t *)malloc(frame.len);
+    if (fread(data, 1, frame.len, f) != frame.len) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    fclose(f);
+    frame.data = data;
+
+    // the smallest frame size that holds the recorded frame
+    framesize_t frame_size = FRAMESIZE_96X96;
+    while (frame_size < FRAMESIZE_INVALID - 1 &&
+            (rgb565 ? (size_t)resolution[frame_size].width * resolution[frame_size].height * 2 != frame.len
+                    : (size_t)resolution[frame_size].width * resolution[frame_size].height / 5 < frame.len)) {
+        frame_size++;
+    }
+
+    ll_cam_sim_config_t sim = {
+        .frames = &frame,
+        .frame_cnt = 1,
+        .pclk_hz = pclk_hz,
+        // blanking as long as a few lines of a real sensor
+        .vsync_us = pclk_hz ? 1000 : 0,
+        .vblank_us = pclk_hz ? 1000 : 0,
+    };
+    camera_config_t config = {
+        .pin_pwdn = -1,
+        .pin_reset = -1,
+        .xclk_freq_hz = 20000000,
+        .pixel_format = rgb565 ? PIXFORMAT_RGB565 : PIXFORMAT_JPEG,
+        .frame_size = frame_size,
+        .fb_count = 2,
+        .grab_mode = CAMERA_GRAB_LATEST,
+        .dma_mode = zero_copy ? CAMERA_DMA_ZERO_COPY : CAMERA_DMA_COPY,
+    };
+    ll_cam_sim_set_stream(&sim);
+    if (cam_init(&config) != ESP_OK || cam_config(&config, frame_size, OV2640_PID) != ESP_OK) {
+        return 1;
+    }
+
+    int64_t dma_us = 0;
+    int64_t wait_us = 0;
+    int taken = 0;
+    int64_t start = esp_timer_get_time();
+    cam_start();
+    for (int i = 0; i < frames; i++) {
+        camera_fb_t *fb = cam_take(pdMS_TO_TICKS(1000));
+        if (fb == NULL) {
+            continue;
+        }
+        dma_us += fb->meta.last_dma_us - fb->meta.first_dma_us;
+        wait_us += fb->meta.queue_wait_us;
+        taken++;
+        cam_give(fb);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    camera_stats_t stats;
+    cam_get_stats(&stats);
+    cam_deinit();
+    free(data);
+
+    printf("%s: %zu bytes, %d x %d, %s\n", argv[1], frame.len, resolution[frame_size].width, resolution[frame_size].height,
+           zero_copy ? "zero-copy" : "copy");
+    printf("taken: %d in %.3f s, %.1f fps\n", taken, elapsed / 1e6, taken ? taken * 1e6 / elapsed : 0.0);
+    if (taken) {
+        printf("dma: %.1f us/frame, queue wait: %.1f us/frame\n", (double)dma_us / taken, (double)wait_us / taken);
+    }
+    printf("captured: %u, dropped: %u, no fb: %u, FB-OVF: %u, NO-SOI: %u, NO-EOI: %u, FB-SIZE: %u, EV-OVF: %u\n",
+           stats.frames_captured, stats.frames_dropped, stats.no_free_fb, stats.fb_overflow,
+           stats.no_soi, stats.no_eoi, stats.size_mismatch, stats.event_overflow);
+    return 0;
+}
@@ -0,0 +1,343 @@
+// Times the conversions library on the host and prints the results as JSON, one case per line:
+//   conversions_bench [pictures dir] [iterations] [largest framesize_t]
+// Every framesize_t gets synthetic RGB565 and YUV422 frames, encoded with fmt2jpg and with a
+// reused jpg_encoder_ctx_t in 1, 2 and 4 strips. The JPEGs encoded from them and the ones in the pictures dir are
+// decoded, in full, to 96x96 and only their 96x96 center. Allocations are counted through the --wrap'ed malloc family, peak_alloc is the most
+// the conversion had allocated at once.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <malloc.h>
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static size_t alloc_now;
+static size_t alloc_peak;
+
+static void alloc_add(void *ptr)
+{
+    if (ptr) {
+        alloc_now += malloc_usable_size(ptr);
+        if (alloc_now > alloc_peak) {
+            alloc_peak = alloc_now;
+        }
+    }
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    alloc_add(ptr);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    void *ptr = __real_calloc(n, size);
+    alloc_add(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    size_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void *res = __real_realloc(ptr, size);
+    if (res) {
+        alloc_now -= old;
+        alloc_add(res);
+    }
+    return res;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr) {
+        alloc_now -= malloc_usable_size(ptr);
+    }
+    __real_free(ptr);
+}
+
+typedef struct {
+    const char *op;
+    const char *input;
+    int width;
+    int height;
+    const uint8_t *src;
+    size_t src_len;
+    pixformat_t format;
+    uint8_t *out;//for the conversions that write to a caller buffer
+    jpg_encoder_ctx_t encoder;
+} bench_case_t;
+
+typedef bool (*bench_fn_t)(const bench_case_t *c);
+
+static int iterations = 20;
+static bool failed;
+
+static bool run_fmt2jpg(const bench_case_t *c)
+{
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    bool ok = fmt2jpg((uint8_t *)c->src, c->src_len, c->width, c->height, c->format, 12, &jpg, &jpg_len);
+    free(jpg);
+    return ok;
+}
+
+static bool run_jpg_encoder(const bench_case_t *c)
+{
+    size_t jpg_len = 0;
+    return jpg_encoder_encode_buf(c->encoder, c->src, c->src_len, c->out, c->width * c->height * 3, &jpg_len);
+}
+
+static bool run_fmt2bmp(const bench_case_t *c)
+{
+    uint8_t *bmp = NULL;
+    size_t bmp_len = 0;
+    bool ok = fmt2bmp((uint8_t *)c->src, c->src_len, c->width, c->height, c->format, &bmp, &bmp_len);
+    free(bmp);
+    return ok;
+}
+
+static bool run_fmt2rgb888(const bench_case_t *c)
+{
+    return fmt2rgb888(c->src, c->src_len, c->format, c->out);
+}
+
+static bool run_jpg2rgb565(const bench_case_t *c)
+{
+    return jpg2rgb565(c->src, c->src_len, c->out, JPG_SCALE_NONE);
+}
+
+// the input of a small image model
+static bool run_jpg2fmt_scaled(const bench_case_t *c)
+{
+    return jpg2fmt_scaled(c->src, c->src_len, 96, 96, PIXFORMAT_RGB565, c->out);
+}
+
+static size_t jpg_read(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    if (buf) {
+        memcpy(buf, (const uint8_t *)arg + index, len);
+    }
+    return len;
+}
+
+static bool jpg_discard(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    return true;
+}
+
+// a crop the size of the scaled one, from the middle of the frame
+static bool run_jpg_decode_roi(const bench_case_t *c)
+{
+    return esp_jpg_decode_roi(c->src_len, JPG_SCALE_NONE, (c->width - 96) / 2, (c->height - 96) / 2, 96, 96,
+                              jpg_read, jpg_discard, (void *)c->src) == ESP_OK;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t d = *(const int64_t *)a - *(const int64_t *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+static void bench(bench_fn_t fn, const bench_case_t *c)
+{
+    int64_t *times = (int64_t *)malloc(iterations * sizeof(int64_t));
+    int64_t total = 0;
+    size_t base = alloc_now;
+    alloc_peak = alloc_now;
+    bool ok = true;
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = esp_timer_get_time();
+        ok = fn(c) && ok;
+        times[i] = esp_timer_get_time() - start;
+        total += times[i];
+    }
+    size_t peak = alloc_peak - base;
+    failed = failed || !ok;
+    qsort(times, iterations, sizeof(int64_t), compare_us);
+    printf("{\"op\": \"%s\", \"input\": \"%s\", \"width\": %d, \"height\": %d, \"bytes\": %zu, \"iterations\": %d, "
+           "\"ok\": %s, \"mb_s\": %.2f, \"p50_us\": %lld, \"p99_us\": %lld, \"peak_alloc\": %zu}\n",
+           c->op, c->input, c->width, c->height, c->src_len, iterations, ok ? "true" : "false",
+           total ? (double)c->src_len * iterations / total : 0.0,
+           (long long)times[iterations / 2], (long long)times[(iterations * 99) / 100], peak);
+    free(times);
+}
+
+// smooth gradients with some detail, about what a sensor sees
+static void fill_rgb565(uint8_t *buf, int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t r = x * 255 / width;
+            uint8_t g = y * 255 / height;
+            uint8_t b = (x ^ y) & 0xff;
+            uint16_t p = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+            // the sensor sends the high byte first
+            *buf++ = p >> 8;
+            *buf++ = p & 0xff;
+        }
+    }
+}
+
+static void fill_yuv422(uint8_t *buf, int width, int height)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += 2) {
+            *buf++ = (x + y) * 255 / (width + height);
+            *buf++ = 128 + (x * 64 / width) - 32;
+            *buf++ = (x + 1 + y) * 255 / (width + height);
+            *buf++ = 128 + ((x ^ y) & 0x3f) - 32;
+        }
+    }
+}
+
+// reads the size from the start of frame marker, skipping the thumbnails in APPn segments
+static bool jpeg_size(const uint8_t *jpg, size_t len, int *width, int *height)
+{
+    size_t i = 2;
+    while (i + 8 < len && jpg[i] == 0xff) {
+        uint8_t marker = jpg[i + 1];
+        if (marker >= 0xc0 && marker <= 0xc2) {
+            *height = (jpg[i + 5] << 8) | jpg[i + 6];
+            *width = (jpg[i + 7] << 8) | jpg[i + 8];
+            return true;
+        }
+        i += 2 + ((jpg[i + 2] << 8) | jpg[i + 3]);
+    }
+    return false;
+}
+
+static void bench_jpeg(const char *input, const uint8_t *jpg, size_t jpg_len)
+{
+    bench_case_t c = {
+        .input = input,
+        .src = jpg,
+        .src_len = jpg_len,
+        .format = PIXFORMAT_JPEG,
+    };
+    if (!jpeg_size(jpg, jpg_len, &c.width, &c.height)) {
+        fprintf(stderr, "%s: no SOF\n", input);
+        return;
+    }
+    c.out = (uint8_t *)malloc(c.width * c.height * 3);
+    c.op = "jpg2rgb565";
+    bench(run_jpg2rgb565, &c);
+    if (c.width >= 96 && c.height >= 96) {
+        c.op = "jpg2fmt_scaled_96";
+        bench(run_jpg2fmt_scaled, &c);
+        c.op = "jpg_decode_roi_96";
+        bench(run_jpg_decode_roi, &c);
+    }
+    c.op = "fmt2rgb888";
+    bench(run_fmt2rgb888, &c);
+    c.op = "fmt2bmp";
+    bench(run_fmt2bmp, &c);
+    free(c.out);
+}
+
+static void bench_frame(const char *input, pixformat_t format, int width, int height)
+{
+    bench_case_t c = {
+        .input = input,
+        .width = width,
+        .height = height,
+        .src_len = width * height * 2,
+        .format = format,
+    };
+    uint8_t *src = (uint8_t *)malloc(c.src_len);
+    if (format == PIXFORMAT_RGB565) {
+        fill_rgb565(src, width, height);
+    } else {
+        fill_yuv422(src, width, height);
+    }
+    c.src = src;
+    c.out = (uint8_t *)malloc(width * height * 3);
+    c.op = "fmt2jpg";
+    bench(run_fmt2jpg, &c);
+    // the strips encode on as many threads
+    static const char *encoder_ops[] = { "jpg_encoder", "jpg_encoder_2", "jpg_encoder_4" };
+    for (int i = 0; i < 3; i++) {
+        c.encoder = jpg_encoder_create_parallel(width, height, format, 12, 1 << i);
+        if (c.encoder) {
+            c.op = encoder_ops[i];
+            bench(run_jpg_encoder, &c);
+            jpg_encoder_delete(c.encoder);
+        }
+    }
+    c.op = "fmt2bmp";
+    bench(run_fmt2bmp, &c);
+    c.op = "fmt2rgb888";
+    bench(run_fmt2rgb888, &c);
+    free(c.out);
+
+    if (format == PIXFORMAT_RGB565) {
+        uint8_t *jpg = NULL;
+        size_t jpg_len = 0;
+        if (fmt2jpg(src, c.src_len, width, height, format, 12, &jpg, &jpg_len)) {
+            bench_jpeg("jpeg", jpg, jpg_len);
+        }
+        free(jpg);
+    }
+    free(src);
+}
+
+static void bench_pictures(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        fprintf(stderr, "cannot open %s\n", dir);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t name_len = strlen(entry->d_name);
+        if (name_len < 5 || strcmp(entry->d_name + name_len - 5, ".jpeg") != 0) {
+            continue;
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        FILE *f = fopen(path, "rb");
+        if (f == NULL) {
+            continue;
+        }
+        fseek(f, 0, SEEK_END);
+        size_t len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        uint8_t *jpg = (uint8_t *)malloc(len);
+        if (fread(jpg, 1, len, f) == len) {
+            bench_jpeg(entry->d_name, jpg, len);
+        }
+        fclose(f);
+        free(jpg);
+    }
+    closedir(d);
+}
+
+int main(int argc, char **argv)
+{
+    const char *pictures = argc > 1 ? argv[1] : NULL;
+    iterations = argc > 2 ? atoi(argv[2]) : 20;
+    framesize_t largest = argc > 3 ? (framesize_t)atoi(argv[3]) : FRAMESIZE_INVALID - 1;
+    if (iterations < 1 || largest >= FRAMESIZE_INVALID) {
+        fprintf(stderr, "usage: %s [pictures dir] [iterations] [largest framesize_t]\n", argv[0]);
+        return 1;
+    }
+
+    if (pictures) {
+        bench_pictures(pictures);
+    }
+    for (framesize_t size = 0; size <= largest; size++) {
+        bench_frame("rgb565", PIXFORMAT_RGB565, resolution[size].width, resolution[size].height);
+        bench_frame("yuv422", PIXFORMAT_YUV422, resolution[size].width, resolution[size].height);
+    }
+    return failed;
+}
@@ -0,0 +1,34 @@
+// Minimal assertion helpers for the host-side unit tests
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HOST_TEST_CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define HOST_TEST_RUN(fn) do { \
+        printf("%s\n", #fn); \
+        fn(); \
+    } while (0)
+
+// the whole file in a malloc() buffer
+static inline uint8_t *host_test_load_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    HOST_TEST_CHECK(f != NULL, "cannot open %s", path);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = (uint8_t *)malloc(*len);
+    HOST_TEST_CHECK(fread(data, 1, *len, f) == *len, "cannot read %s", path);
+    fclose(f);
+    return data;
+}
@@ -0,0 +1,11 @@
+// Host stand-in for the ESP-IDF header of the same name
+#pragma once
+
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+static inline esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
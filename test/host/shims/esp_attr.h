@@ -0,0 +1,6 @@
+// Host stand-in for the ESP-IDF header of the same name
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_ATTR
@@ -0,0 +1,13 @@
+// Host stand-in for the ESP-IDF header of the same name
+#pragma once
+
+#include "esp_err.h"
+
+#define ESP_INTR_FLAG_LOWMED    (1 << 1)
+#define ESP_INTR_FLAG_IRAM      (1 << 10)
+
+typedef void (*intr_handler_t)(void *arg);
+typedef struct intr_handle_data_t *intr_handle_t;
+
+// provided by the simulated peripheral, the only interrupt source on the host
+esp_err_t esp_intr_free(intr_handle_t handle);
@@ -0,0 +1,7 @@
+// Host stand-in for the ESP-IDF header of the same name
+#pragma once
+
+#include "esp_err.h"
+#include "esp_idf_version.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
@@ -0,0 +1,12 @@
+// Host stand-in for the FreeRTOS header of the same name, a semaphore is a queue of empty items
+#pragma once
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary()                    xQueueCreate(1, 0)
+#define vSemaphoreDelete(sem)                       vQueueDelete(sem)
+#define xSemaphoreTake(sem, ticks_to_wait)          xQueueReceive(sem, NULL, ticks_to_wait)
+#define xSemaphoreGive(sem)                         xQueueSend(sem, NULL, 0)
+#define xSemaphoreGiveFromISR(sem, woken)           xQueueSendFromISR(sem, NULL, woken)
@@ -0,0 +1,257 @@
+// Host implementation of the FreeRTOS queue and task calls used by the driver, on top of pthreads
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+struct QueueDefinition {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *items;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+    size_t receivers;//blocked in xQueueReceive()
+};
+
+struct tskTaskControlBlock {
+    pthread_t thread;
+    TaskFunction_t task;
+    void *arg;
+};
+
+static void deadline_after(TickType_t ticks, struct timespec *ts)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    uint64_t ns = (uint64_t)ts->tv_nsec + (uint64_t)ticks * portTICK_PERIOD_MS * 1000000ULL;
+    ts->tv_sec += ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
+static void queue_unlock(void *arg)
+{
+    pthread_mutex_unlock(&((QueueHandle_t)arg)->lock);
+}
+
+// waits with the queue locked, false once the ticks ran out
+static bool queue_wait(QueueHandle_t queue, pthread_cond_t *cond, TickType_t ticks_to_wait, const struct timespec *deadline)
+{
+    if (ticks_to_wait == 0) {
+        return false;
+    }
+    if (ticks_to_wait == portMAX_DELAY) {
+        pthread_cond_wait(cond, &queue->lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, &queue->lock, deadline) != ETIMEDOUT;
+}
+
+static void queue_receive_done(void *arg)
+{
+    QueueHandle_t queue = (QueueHandle_t)arg;
+    queue->receivers--;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = (QueueHandle_t)calloc(1, sizeof(struct QueueDefinition));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = (uint8_t *)malloc(length * item_size + 1);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->item_size = item_size;
+    queue->length = length;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, &attr);
+    pthread_cond_init(&queue->not_full, &attr);
+    pthread_condattr_destroy(&attr);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    deadline_after(ticks_to_wait, &deadline);
+    // a deleted task may be cancelled while waiting, it must not keep the queue locked
+    volatile BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    pthread_cleanup_push(queue_unlock, queue);
+    while (queue->count == queue->length) {
+        if (!queue_wait(queue, &queue->not_full, ticks_to_wait, &deadline)) {
+            break;
+        }
+    }
+    if (queue->count < queue->length) {
+        size_t tail = (queue->head + queue->count) % queue->length;
+        if (queue->item_size) {
+            memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+        }
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+        ret = pdTRUE;
+    }
+    pthread_cleanup_pop(1);
+    return ret;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken)
+{
+    BaseType_t ret = xQueueSend(queue, item, 0);
+    if (ret == pdTRUE && higher_priority_task_woken) {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    deadline_after(ticks_to_wait, &deadline);
+    volatile BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->receivers++;
+    pthread_cleanup_push(queue_receive_done, queue);
+    while (queue->count == 0) {
+        if (!queue_wait(queue, &queue->not_empty, ticks_to_wait, &deadline)) {
+            break;
+        }
+    }
+    if (queue->count) {
+        if (queue->item_size) {
+            memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        }
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+        ret = pdTRUE;
+    }
+    pthread_cleanup_pop(1);
+    return ret;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueHostReceiversWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t receivers = queue->count ? 0 : queue->receivers;
+    pthread_mutex_unlock(&queue->lock);
+    return receivers;
+}
+
+// the task running on this thread, NULL on threads not made by xTaskCreate()
+static __thread TaskHandle_t current_task;
+
+static void *task_main(void *arg)
+{
+    TaskHandle_t task = (TaskHandle_t)arg;
+    current_task = task;
+    task->task(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority, TaskHandle_t *created_task)
+{
+    TaskHandle_t handle = (TaskHandle_t)calloc(1, sizeof(struct tskTaskControlBlock));
+    if (handle == NULL) {
+        return pdFAIL;
+    }
+    handle->task = task;
+    handle->arg = arg;
+    // the stack depth is sized for the target, host calls (printf) need more
+    if (pthread_create(&handle->thread, NULL, task_main, handle) != 0) {
+        free(handle);
+        return pdFAIL;
+    }
+    if (created_task) {
+        *created_task = handle;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    return xTaskCreate(task, name, stack_depth, arg, priority, created_task);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || pthread_equal(task->thread, pthread_self())) {
+        free(current_task);
+        pthread_detach(pthread_self());
+        pthread_exit(NULL);
+    }
+    // driver tasks block in queue calls, which are cancellation points
+    pthread_cancel(task->thread);
+    pthread_join(task->thread, NULL);
+    free(task);
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return 1;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = ticks * portTICK_PERIOD_MS / 1000,
+        .tv_nsec = (long)(ticks * portTICK_PERIOD_MS % 1000) * 1000000L,
+    };
+    if (ticks == 0) {
+        sched_yield();
+        return;
+    }
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / portTICK_PERIOD_MS);
+}
@@ -0,0 +1,18 @@
+// Host stand-in for the ESP-IDF header of the same name
+#pragma once
+
+#include <stdint.h>
+
+typedef struct lldesc_s {
+    volatile uint32_t size  : 12,
+                      length: 12,
+                      offset: 5,
+                      sosf  : 1,
+                      eof   : 1,
+                      owner : 1;
+    volatile uint8_t *buf;
+    union {
+        volatile uint32_t empty;
+        struct lldesc_s *next;
+    };
+} lldesc_t;
@@ -0,0 +1,8 @@
+// Host stand-in for the generated sdkconfig.h, selects the simulated target
+#pragma once
+
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_IDF_TARGET_LINUX 1
+
+// not the Kconfig default, so test_to_jpg sees that the option is used
+#define CONFIG_CAMERA_JPG_CB_FLUSH_SIZE 1024
@@ -0,0 +1,2 @@
+// Host stand-in for the ESP-IDF header of the same name, nothing in it is used
+#pragma once
@@ -0,0 +1,456 @@
+// Runs cam_hal against the simulated camera peripheral
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "cam_hal.h"
+#include "ll_cam_sim.h"
+#include "esp_jpg_decode.h"
+
+#define TEST_PICTURE_CNT 2
+
+static const char *test_pictures[TEST_PICTURE_CNT] = {
+    CAMERA_TEST_PICTURES "/test_inside.jpeg",
+    CAMERA_TEST_PICTURES "/testimg.jpeg",
+};
+
+static ll_cam_sim_frame_t pictures[TEST_PICTURE_CNT];
+
+static void load_pictures(void)
+{
+    for (int i = 0; i < TEST_PICTURE_CNT; i++) {
+        pictures[i].data = host_test_load_file(test_pictures[i], &pictures[i].len);
+    }
+}
+
+static camera_config_t test_config(pixformat_t format, framesize_t frame_size)
+{
+    camera_config_t config = {
+        .pin_pwdn = -1,
+        .pin_reset = -1,
+        .xclk_freq_hz = 20000000,
+        .pixel_format = format,
+        .frame_size = frame_size,
+        .jpeg_quality = 12,
+        .fb_count = 2,
+        .grab_mode = CAMERA_GRAB_LATEST,
+    };
+    return config;
+}
+
+static void start_camera(const camera_config_t *config, const ll_cam_sim_frame_t *frames, size_t frame_cnt, uint32_t pclk_hz)
+{
+    ll_cam_sim_config_t sim = {
+        .frames = frames,
+        .frame_cnt = frame_cnt,
+        .pclk_hz = pclk_hz,
+        .vsync_us = 500,
+        .vblank_us = 500,
+    };
+    ll_cam_sim_set_stream(&sim);
+    HOST_TEST_CHECK(cam_init(config) == ESP_OK, "cam_init");
+    HOST_TEST_CHECK(cam_config(config, config->frame_size, OV2640_PID) == ESP_OK, "cam_config");
+    cam_start();
+}
+
+// takes cnt frames, each has to be one of the replayed ones
+static void take_frames(const ll_cam_sim_frame_t *frames, size_t frame_cnt, int cnt, bool eof_events)
+{
+    uint32_t sequence = 0;
+    for (int i = 0; i < cnt; i++) {
+        camera_fb_t *fb = cam_take(pdMS_TO_TICKS(1000));
+        HOST_TEST_CHECK(fb != NULL, "frame %d timed out", i);
+        bool match = false;
+        for (size_t f = 0; f < frame_cnt && !match; f++) {
+            match = fb->len == frames[f].len && memcmp(fb->buf, frames[f].data, fb->len) == 0;
+        }
+        HOST_TEST_CHECK(match, "frame %d: %zu bytes do not match the stream", i, fb->len);
+        HOST_TEST_CHECK(fb->sequence > sequence, "frame %d: sequence %u after %u", i, fb->sequence, sequence);
+        HOST_TEST_CHECK(!eof_events || fb->meta.dma_chunks > 0, "frame %d: no DMA chunks", i);
+        HOST_TEST_CHECK(fb->meta.last_dma_us >= fb->meta.first_dma_us, "frame %d: DMA times", i);
+        sequence = fb->sequence;
+        cam_give(fb);
+    }
+}
+
+static void check_clean_stats(uint32_t taken)
+{
+    camera_stats_t stats;
+    cam_get_stats(&stats);
+    HOST_TEST_CHECK(stats.frames_taken == taken, "taken %u", stats.frames_taken);
+    HOST_TEST_CHECK(stats.frames_captured >= taken, "captured %u", stats.frames_captured);
+    HOST_TEST_CHECK(stats.fb_overflow == 0, "fb_overflow %u", stats.fb_overflow);
+    HOST_TEST_CHECK(stats.no_soi == 0, "no_soi %u", stats.no_soi);
+    HOST_TEST_CHECK(stats.no_eoi == 0, "no_eoi %u", stats.no_eoi);
+    HOST_TEST_CHECK(stats.size_mismatch == 0, "size_mismatch %u", stats.size_mismatch);
+}
+
+static void test_jpeg_copy(void)
+{
+    camera_config_t config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    start_camera(&config, pictures, TEST_PICTURE_CNT, 0);
+    take_frames(pictures, TEST_PICTURE_CNT, 20, true);
+    check_clean_stats(20);
+    cam_deinit();
+}
+
+static void test_jpeg_zero_copy(void)
+{
+    camera_config_t config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    config.dma_mode = CAMERA_DMA_ZERO_COPY;
+    start_camera(&config, pictures, TEST_PICTURE_CNT, 0);
+    take_frames(pictures, TEST_PICTURE_CNT, 20, true);
+    check_clean_stats(20);
+    cam_deinit();
+}
+
+// the first picture grown to len bytes with a comment segment after its SOI
+static ll_cam_sim_frame_t pad_picture(size_t len)
+{
+    const size_t pad = len - pictures[0].len;
+    uint8_t *data = (uint8_t *)malloc(len);
+    memcpy(data, pictures[0].data, 2);
+    data[2] = 0xFF;
+    data[3] = 0xFE;
+    data[4] = (pad - 2) >> 8;
+    data[5] = (pad - 2) & 0xFF;
+    memset(data + 6, 0, pad - 4);
+    memcpy(data + 2 + pad, pictures[0].data + 2, pictures[0].len - 2);
+    ll_cam_sim_frame_t frame = { .data = data, .len = len };
+    return frame;
+}
+
+// a frame that ends exactly at the end of the frame buffer, with its EOI in the last DMA chunk
+static void test_jpeg_exact_fit(void)
+{
+    // JPEG frame buffers hold width * height / 5 bytes
+    ll_cam_sim_frame_t frame = pad_picture(640 * 480 / 5);
+
+    camera_config_t config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    start_camera(&config, &frame, 1, 0);
+    take_frames(&frame, 1, 5, true);
+    check_clean_stats(5);
+    cam_deinit();
+
+    config.dma_mode = CAMERA_DMA_ZERO_COPY;
+    start_camera(&config, &frame, 1, 0);
+    take_frames(&frame, 1, 5, true);
+    check_clean_stats(5);
+    cam_deinit();
+    free((void *)frame.data);
+}
+
+// waits for frames frames to be dropped, every one of them without an EOI
+static void wait_dropped(uint32_t frames, camera_stats_t *stats)
+{
+    for (int i = 0; i < 100; i++) {
+        cam_get_stats(stats);
+        if (stats->no_eoi >= frames) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    HOST_TEST_CHECK(stats->no_eoi >= frames, "%u frames dropped", stats->no_eoi);
+    HOST_TEST_CHECK(stats->frames_captured == 0, "captured %u", stats->frames_captured);
+}
+
+// frames too big for their buffer are counted once each, the one being captured may be counted already
+static void test_jpeg_overflow(void)
+{
+    ll_cam_sim_frame_t frame = pad_picture(640 * 480 / 5 + 8 * 1024);
+    camera_config_t config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    start_camera(&config, &frame, 1, 0);
+    camera_stats_t stats;
+    wait_dropped(5, &stats);
+    HOST_TEST_CHECK(stats.fb_overflow <= stats.no_eoi + 1, "%u overflows in %u frames", stats.fb_overflow, stats.no_eoi);
+    cam_deinit();
+    free((void *)frame.data);
+
+    // adaptive buffers of at most 16 KB, the sizer learns one sample from each frame that did not fit
+    config.jpeg_fb_budget = 32 * 1024;
+    start_camera(&config, pictures, 1, 0);
+    wait_dropped(5, &stats);
+    camera_fb_alloc_stats_t fb_stats;
+    cam_get_fb_alloc_stats(&fb_stats);
+    cam_get_stats(&stats);
+    HOST_TEST_CHECK(fb_stats.overflows <= stats.no_eoi + 1, "%u sizer samples from %u frames", fb_stats.overflows, stats.no_eoi);
+    HOST_TEST_CHECK(fb_stats.fb_size_target == 16 * 1024, "target %zu", fb_stats.fb_size_target);
+    cam_deinit();
+}
+
+static void test_jpeg_adaptive(void)
+{
+    camera_config_t config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    config.jpeg_fb_budget = 64 * 1024;
+    start_camera(&config, pictures, TEST_PICTURE_CNT, 0);
+    take_frames(pictures, TEST_PICTURE_CNT, 20, true);
+
+    camera_fb_alloc_stats_t fb_stats;
+    cam_get_fb_alloc_stats(&fb_stats);
+    HOST_TEST_CHECK(fb_stats.fb_size_total <= config.jpeg_fb_budget, "%zu bytes allocated", fb_stats.fb_size_total);
+    HOST_TEST_CHECK(fb_stats.jpeg_high_water == pictures[0].len, "high water %zu", fb_stats.jpeg_high_water);
+    cam_deinit();
+}
+
+// with a real pixel clock the sensor does not wait for cam_task
+static void test_jpeg_paced(void)
+{
+    camera_config_t config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    start_camera(&config, pictures, TEST_PICTURE_CNT, 20000000);
+    uint32_t sequence = 0;
+    for (int i = 0; i < 10; i++) {
+        camera_fb_t *fb = cam_take(pdMS_TO_TICKS(1000));
+        HOST_TEST_CHECK(fb != NULL, "frame %d timed out", i);
+        HOST_TEST_CHECK(fb->sequence > sequence, "frame %d: sequence %u after %u", i, fb->sequence, sequence);
+        sequence = fb->sequence;
+        cam_give(fb);
+    }
+    cam_deinit();
+}
+
+// frames cut off before their EOI are never handed out
+static void test_jpeg_truncated(void)
+{
+    ll_cam_sim_frame_t truncated = {
+        .data = pictures[0].data,
+        .len = pictures[0].len / 2,
+    };
+    camera_config_t config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    start_camera(&config, &truncated, 1, 0);
+    HOST_TEST_CHECK(cam_take(pdMS_TO_TICKS(100)) == NULL, "truncated frame taken");
+
+    camera_stats_t stats;
+    cam_get_stats(&stats);
+    HOST_TEST_CHECK(stats.no_eoi > 0, "no_eoi %u", stats.no_eoi);
+    HOST_TEST_CHECK(stats.frames_captured == 0, "captured %u", stats.frames_captured);
+    HOST_TEST_CHECK(stats.fb_get_timeouts == 1, "timeouts %u", stats.fb_get_timeouts);
+    cam_deinit();
+}
+
+static void test_rgb565(void)
+{
+    const size_t len = 160 * 120 * 2;
+    ll_cam_sim_frame_t frames[2];
+    for (int f = 0; f < 2; f++) {
+        uint8_t *data = (uint8_t *)malloc(len);
+        for (size_t i = 0; i < len; i++) {
+            data[i] = (uint8_t)(i * (f + 1) + (i >> 8));
+        }
+        frames[f].data = data;
+        frames[f].len = len;
+    }
+    camera_config_t config = test_config(PIXFORMAT_RGB565, FRAMESIZE_QQVGA);
+    start_camera(&config, frames, 2, 0);
+    take_frames(frames, 2, 20, true);
+    check_clean_stats(20);
+    cam_deinit();
+
+    // zero-copy RGB frames raise no EOF, the DMA fills the whole frame buffer
+    config.dma_mode = CAMERA_DMA_ZERO_COPY;
+    start_camera(&config, frames, 2, 0);
+    take_frames(frames, 2, 20, false);
+    check_clean_stats(20);
+    cam_deinit();
+
+    for (int f = 0; f < 2; f++) {
+        free((void *)frames[f].data);
+    }
+}
+
+typedef struct {
+    uint8_t *frame;
+    size_t line_size;
+    size_t lines;//of the current frame
+    uint32_t sequence;
+    int frames;
+    bool ok;
+} strip_sink_t;
+
+static void collect_strip(const camera_strip_t *strip, void *arg)
+{
+    strip_sink_t *sink = (strip_sink_t *)arg;
+    if (strip->y == 0) {
+        sink->ok = sink->ok && strip->sequence > sink->sequence;
+        sink->sequence = strip->sequence;
+        sink->lines = 0;
+    }
+    sink->ok = sink->ok && strip->y == sink->lines && strip->sequence == sink->sequence
+               && strip->len == strip->lines * sink->line_size && strip->format == PIXFORMAT_RGB565;
+    memcpy(sink->frame + strip->y * sink->line_size, strip->buf, strip->len);
+    sink->lines += strip->lines;
+    if (sink->lines == strip->height) {
+        sink->frames++;
+    }
+}
+
+static void test_rgb565_strips(void)
+{
+    const size_t len = 160 * 120 * 2;
+    uint8_t *data = (uint8_t *)malloc(len);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (uint8_t)(i * 3 + (i >> 8));
+    }
+    ll_cam_sim_frame_t frame = { .data = data, .len = len };
+    strip_sink_t sink = {
+        .frame = (uint8_t *)calloc(1, len),
+        .line_size = 160 * 2,
+        .ok = true,
+    };
+    camera_config_t config = test_config(PIXFORMAT_RGB565, FRAMESIZE_QQVGA);
+    config.strip_cb = collect_strip;
+    config.strip_cb_arg = &sink;
+    start_camera(&config, &frame, 1, 0);
+    HOST_TEST_CHECK(cam_take(0) == NULL, "frame taken in strip mode");
+
+    camera_stats_t stats;
+    for (int i = 0; i < 100; i++) {
+        cam_get_stats(&stats);
+        if (stats.frames_captured >= 5) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    cam_deinit();
+    HOST_TEST_CHECK(stats.frames_captured >= 5, "captured %u", stats.frames_captured);
+    HOST_TEST_CHECK(stats.size_mismatch == 0, "size_mismatch %u", stats.size_mismatch);
+    HOST_TEST_CHECK(sink.ok, "strips out of order");
+    HOST_TEST_CHECK(sink.frames >= 5, "%d frames", sink.frames);
+    HOST_TEST_CHECK(memcmp(sink.frame, data, len) == 0, "strips do not match the stream");
+
+    // JPEG frames do not split into lines
+    config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    config.strip_cb = collect_strip;
+    HOST_TEST_CHECK(cam_init(&config) == ESP_OK, "cam_init");
+    HOST_TEST_CHECK(cam_config(&config, config.frame_size, OV2640_PID) == ESP_ERR_NOT_SUPPORTED, "JPEG strips");
+    cam_deinit();
+
+    free(sink.frame);
+    free(data);
+}
+
+typedef struct {
+    esp_jpg_stream_t stream;
+    uint8_t *expected[TEST_PICTURE_CNT];//whole decode of each picture
+    uint8_t *pixels;
+    int width;
+    int height;
+    size_t blocks;
+    size_t early;//blocks decoded before the frame was complete
+    uint32_t sequence;
+    int frames;
+    bool ok;
+} jpeg_sink_t;
+
+static bool sink_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    jpeg_sink_t *sink = (jpeg_sink_t *)arg;
+    if (!data) {
+        if (x == 0 && y == 0) {
+            sink->width = w;
+            sink->height = h;
+            free(sink->pixels);
+            sink->pixels = (uint8_t *)malloc(w * h * 3);
+        }
+        return true;
+    }
+    for (int iy = 0; iy < h; iy++, data += w * 3) {
+        memcpy(sink->pixels + ((y + iy) * sink->width + x) * 3, data, w * 3);
+    }
+    sink->blocks++;
+    return true;
+}
+
+// decodes every frame from the chunks, while the rest of it is captured
+static void decode_chunk(const camera_jpeg_chunk_t *chunk, void *arg)
+{
+    jpeg_sink_t *sink = (jpeg_sink_t *)arg;
+    if (chunk->state == CAMERA_JPEG_CHUNK_DROPPED) {
+        esp_jpg_stream_delete(sink->stream);
+        sink->stream = NULL;
+        return;
+    }
+    if (!sink->stream) {
+        sink->stream = esp_jpg_stream_create(JPG_SCALE_NONE, JPG_FORMAT_RGB888, sink_write, sink);
+        sink->ok = sink->ok && sink->stream != NULL && chunk->sequence > sink->sequence;
+        sink->sequence = chunk->sequence;
+    }
+    size_t blocks = sink->blocks;
+    bool done = false;
+    sink->ok = sink->ok && chunk->sequence == sink->sequence
+               && esp_jpg_stream_write(sink->stream, chunk->buf, chunk->len, &done) == ESP_OK;
+    if (chunk->state == CAMERA_JPEG_CHUNK_DATA) {
+        sink->early += sink->blocks - blocks;
+        return;
+    }
+    bool match = false;
+    for (int i = 0; i < TEST_PICTURE_CNT && done && !match; i++) {
+        match = chunk->len == pictures[i].len && memcmp(sink->pixels, sink->expected[i], sink->width * sink->height * 3) == 0;
+    }
+    sink->ok = sink->ok && done && match;
+    sink->frames++;
+    esp_jpg_stream_delete(sink->stream);
+    sink->stream = NULL;
+}
+
+static void check_jpeg_chunks(camera_dma_mode_t dma_mode)
+{
+    jpeg_sink_t sink = { .ok = true };
+    for (int i = 0; i < TEST_PICTURE_CNT; i++) {
+        HOST_TEST_CHECK(esp_jpg_decode_mem(pictures[i].data, pictures[i].len, JPG_SCALE_NONE, sink_write, &sink) == ESP_OK, "decode");
+        sink.expected[i] = sink.pixels;
+        sink.pixels = NULL;
+    }
+    sink.blocks = 0;
+
+    camera_config_t config = test_config(PIXFORMAT_JPEG, FRAMESIZE_VGA);
+    config.dma_mode = dma_mode;
+    config.jpeg_chunk_cb = decode_chunk;
+    config.jpeg_chunk_cb_arg = &sink;
+    start_camera(&config, pictures, TEST_PICTURE_CNT, 0);
+    take_frames(pictures, TEST_PICTURE_CNT, 10, true);
+    check_clean_stats(10);
+    cam_deinit();
+
+    HOST_TEST_CHECK(sink.ok, "a frame did not decode to its picture");
+    HOST_TEST_CHECK(sink.frames >= 10, "%d frames decoded", sink.frames);
+    HOST_TEST_CHECK(sink.early > sink.blocks / 2, "only %zu of %zu blocks decoded during the capture", sink.early, sink.blocks);
+    esp_jpg_stream_delete(sink.stream);
+    free(sink.pixels);
+    for (int i = 0; i < TEST_PICTURE_CNT; i++) {
+        free(sink.expected[i]);
+    }
+}
+
+static void test_jpeg_chunks(void)
+{
+    check_jpeg_chunks(CAMERA_DMA_COPY);
+    check_jpeg_chunks(CAMERA_DMA_ZERO_COPY);
+
+    // only JPEG frames come in chunks
+    camera_config_t config = test_config(PIXFORMAT_RGB565, FRAMESIZE_QQVGA);
+    config.jpeg_chunk_cb = decode_chunk;
+    HOST_TEST_CHECK(cam_init(&config) == ESP_OK, "cam_init");
+    HOST_TEST_CHECK(cam_config(&config, config.frame_size, OV2640_PID) == ESP_ERR_NOT_SUPPORTED, "RGB565 chunks");
+    cam_deinit();
+}
+
+int main(void)
+{
+    load_pictures();
+    HOST_TEST_RUN(test_jpeg_copy);
+    HOST_TEST_RUN(test_jpeg_zero_copy);
+    HOST_TEST_RUN(test_jpeg_exact_fit);
+    HOST_TEST_RUN(test_jpeg_overflow);
+    HOST_TEST_RUN(test_jpeg_adaptive);
+    HOST_TEST_RUN(test_jpeg_paced);
+    HOST_TEST_RUN(test_jpeg_truncated);
+    HOST_TEST_RUN(test_jpeg_chunks);
+    HOST_TEST_RUN(test_rgb565);
+    HOST_TEST_RUN(test_rgb565_strips);
+    for (int i = 0; i < TEST_PICTURE_CNT; i++) {
+        free((void *)pictures[i].data);
+    }
+    return 0;
+}
@@ -0,0 +1,208 @@
+// Checks the packed ESP32 DMA filter kernels byte for byte against
+// the original one-sample-at-a-time implementations.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <string.h>
+#include "ll_cam_dma_filter.h"
+#include "host_test.h"
+
+typedef union {
+    struct {
+        uint32_t sample2:8;
+        uint32_t unused2:8;
+        uint32_t sample1:8;
+        uint32_t unused1:8;
+    };
+    uint32_t val;
+} dma_elem_t;
+
+typedef enum {
+    SM_0A0B_0B0C = 0,
+    SM_0A0B_0C0D = 1,
+    SM_0A00_0B00 = 3,
+} i2s_sampling_mode_t;
+
+static size_t ref_filter_jpeg(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 4;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[1].sample1;
+        dst[2] = dma_el[2].sample1;
+        dst[3] = dma_el[3].sample1;
+        dma_el += 4;
+        dst += 4;
+    }
+    return elements;
+}
+
+static size_t ref_filter_grayscale_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 8;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[2].sample1;
+        dst[2] = dma_el[4].sample1;
+        dst[3] = dma_el[6].sample1;
+        dma_el += 8;
+        dst += 4;
+    }
+    if ((elements & 0x7) != 0) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[2].sample1;
+        elements += 1;
+    }
+    return elements * 2;
+}
+
+static size_t ref_filter_yuyv(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 4;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[0].sample2;
+        dst[2] = dma_el[1].sample1;
+        dst[3] = dma_el[1].sample2;
+        dst[4] = dma_el[2].sample1;
+        dst[5] = dma_el[2].sample2;
+        dst[6] = dma_el[3].sample1;
+        dst[7] = dma_el[3].sample2;
+        dma_el += 4;
+        dst += 8;
+    }
+    return elements * 2;
+}
+
+static size_t ref_filter_yuyv_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 8;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[1].sample1;
+        dst[2] = dma_el[2].sample1;
+        dst[3] = dma_el[3].sample1;
+        dst[4] = dma_el[4].sample1;
+        dst[5] = dma_el[5].sample1;
+        dst[6] = dma_el[6].sample1;
+        dst[7] = dma_el[7].sample1;
+        dma_el += 8;
+        dst += 8;
+    }
+    if ((elements & 0x7) != 0) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[1].sample1;
+        dst[2] = dma_el[2].sample1;
+        dst[3] = dma_el[2].sample2;
+        elements += 4;
+    }
+    return elements;
+}
+
+typedef struct {
+    const char *name;
+    i2s_sampling_mode_t mode;
+    dma_filter_t filter;
+    dma_filter_t reference;
+} filter_case_t;
+
+// every sampling mode with the filters ll_cam_set_sample_mode() pairs it with
+static const filter_case_t cases[] = {
+    {"jpeg",                 SM_0A00_0B00, ll_cam_dma_filter_jpeg,                ref_filter_jpeg},
+    {"grayscale_highspeed",  SM_0A00_0B00, ll_cam_dma_filter_grayscale_highspeed, ref_filter_grayscale_highspeed},
+    {"yuyv_highspeed",       SM_0A00_0B00, ll_cam_dma_filter_yuyv_highspeed,      ref_filter_yuyv_highspeed},
+    {"yuyv_highspeed",       SM_0A0B_0B0C, ll_cam_dma_filter_yuyv_highspeed,      ref_filter_yuyv_highspeed},
+    {"grayscale",            SM_0A0B_0C0D, ll_cam_dma_filter_grayscale,           ref_filter_jpeg},
+    {"yuyv",                 SM_0A0B_0C0D, ll_cam_dma_filter_yuyv,                ref_filter_yuyv},
+};
+
+#define MAX_ELEMENTS 2048
+#define SRC_PAD      8      // the tail paths read a few elements past len
+#define DST_GUARD    64
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// fill the unused byte lanes the way the I2S FIFO does for each mode, or with noise
+static void fill_src(uint32_t *src, size_t count, i2s_sampling_mode_t mode, bool noise)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v = rng();
+        if (!noise) {
+            v &= (mode == SM_0A00_0B00) ? 0x00FF0000 : 0x00FF00FF;
+        }
+        src[i] = v;
+    }
+}
+
+static void check_case(const filter_case_t *c, const uint32_t *src, size_t elements, size_t dst_offset)
+{
+    static uint8_t out[2 * MAX_ELEMENTS + 2 * DST_GUARD] __attribute__((aligned(8)));
+    static uint8_t ref[2 * MAX_ELEMENTS + 2 * DST_GUARD] __attribute__((aligned(8)));
+    memset(out, 0xA5, sizeof(out));
+    memset(ref, 0xA5, sizeof(ref));
+
+    size_t len = elements * sizeof(uint32_t);
+    size_t r_out = c->filter(out + DST_GUARD + dst_offset, (const uint8_t *)src, len);
+    size_t r_ref = c->reference(ref + DST_GUARD + dst_offset, (const uint8_t *)src, len);
+
+    HOST_TEST_CHECK(r_out == r_ref, "%s mode %d elements %zu offset %zu: returned %zu, expected %zu",
+                    c->name, c->mode, elements, dst_offset, r_out, r_ref);
+    for (size_t i = 0; i < sizeof(out); i++) {
+        HOST_TEST_CHECK(out[i] == ref[i], "%s mode %d elements %zu offset %zu: byte %zd is 0x%02x, expected 0x%02x",
+                        c->name, c->mode, elements, dst_offset, (ssize_t)i - DST_GUARD - (ssize_t)dst_offset, out[i], ref[i]);
+    }
+}
+
+static void test_small_lengths_all_alignments(void)
+{
+    static uint32_t src[MAX_ELEMENTS + SRC_PAD];
+    for (size_t ci = 0; ci < sizeof(cases) / sizeof(cases[0]); ci++) {
+        for (int noise = 0; noise < 2; noise++) {
+            fill_src(src, MAX_ELEMENTS + SRC_PAD, cases[ci].mode, noise);
+            for (size_t elements = 0; elements <= 67; elements++) {
+                for (size_t offset = 0; offset < 8; offset++) {
+                    check_case(&cases[ci], src, elements, offset);
+                }
+            }
+        }
+    }
+}
+
+static void test_dma_half_buffer_sizes(void)
+{
+    static uint32_t src[MAX_ELEMENTS + SRC_PAD];
+    // JPEG half buffer and a few line-sized RGB/YUV half buffers (QQVGA..VGA)
+    static const size_t half_buffer_bytes[] = {4096, 160 * 2 * 4, 320 * 2 * 4, 640 * 2 * 4, 8188};
+    for (size_t ci = 0; ci < sizeof(cases) / sizeof(cases[0]); ci++) {
+        fill_src(src, MAX_ELEMENTS + SRC_PAD, cases[ci].mode, true);
+        for (size_t hi = 0; hi < sizeof(half_buffer_bytes) / sizeof(half_buffer_bytes[0]); hi++) {
+            for (size_t offset = 0; offset < 4; offset++) {
+                check_case(&cases[ci], src, half_buffer_bytes[hi] / sizeof(uint32_t), offset);
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    HOST_TEST_RUN(test_small_lengths_all_alignments);
+    HOST_TEST_RUN(test_dma_half_buffer_sizes);
+    return 0;
+}
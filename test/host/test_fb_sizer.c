@@ -0,0 +1,110 @@
+// Checks the adaptive JPEG frame buffer sizing policy.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cam_fb_sizer.h"
+#include "host_test.h"
+
+#define KB 1024
+
+static void test_initial_size(void)
+{
+    cam_fb_sizer_t sizer;
+    cam_fb_sizer_init(&sizer, 96000, 8 * KB, 200 * KB, 400 * KB);
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 94 * KB, "initial size %zu", cam_fb_sizer_target(&sizer));
+    HOST_TEST_CHECK(cam_fb_sizer_resize(&sizer, 94 * KB, 188 * KB) == 94 * KB, "no change without data");
+
+    // the budget share caps the initial size
+    cam_fb_sizer_init(&sizer, 96000, 8 * KB, 50 * KB, 100 * KB);
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 50 * KB, "capped initial size %zu", cam_fb_sizer_target(&sizer));
+}
+
+static void test_shrink_with_hysteresis(void)
+{
+    cam_fb_sizer_t sizer;
+    cam_fb_sizer_init(&sizer, 96000, 8 * KB, 200 * KB, 400 * KB);
+    for (int i = 0; i < 40; i++) {
+        cam_fb_sizer_add(&sizer, 20000 + (i % 10) * 100);
+    }
+    // p95 20900 + 1/4 headroom
+    size_t target = cam_fb_sizer_target(&sizer);
+    HOST_TEST_CHECK(target == 26 * KB, "target %zu", target);
+    HOST_TEST_CHECK(cam_fb_sizer_high_water(&sizer) == 20900, "high water %zu", cam_fb_sizer_high_water(&sizer));
+    HOST_TEST_CHECK(cam_fb_sizer_resize(&sizer, 94 * KB, 188 * KB) == target, "big buffer shrinks");
+    HOST_TEST_CHECK(cam_fb_sizer_resize(&sizer, 36 * KB, 72 * KB) == 36 * KB, "slightly big buffer is kept");
+    HOST_TEST_CHECK(cam_fb_sizer_resize(&sizer, 40 * KB, 80 * KB) == target, "1.5x target shrinks");
+}
+
+static void test_outlier_sets_floor(void)
+{
+    cam_fb_sizer_t sizer;
+    cam_fb_sizer_init(&sizer, 96000, 8 * KB, 200 * KB, 400 * KB);
+    for (int i = 0; i < 31; i++) {
+        cam_fb_sizer_add(&sizer, 10000);
+    }
+    cam_fb_sizer_add(&sizer, 60000);
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 59 * KB, "largest recent frame must fit: %zu", cam_fb_sizer_target(&sizer));
+    // the outlier leaves the window
+    for (int i = 0; i < 32; i++) {
+        cam_fb_sizer_add(&sizer, 10000);
+    }
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 13 * KB, "target %zu", cam_fb_sizer_target(&sizer));
+    HOST_TEST_CHECK(cam_fb_sizer_high_water(&sizer) == 60000, "high water is kept");
+}
+
+static void test_grow_within_budget(void)
+{
+    cam_fb_sizer_t sizer;
+    cam_fb_sizer_init(&sizer, 30 * KB, 8 * KB, 100 * KB, 150 * KB);
+    cam_fb_sizer_overflow(&sizer, 30 * KB);
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 75 * KB, "overflow counts double plus headroom: %zu", cam_fb_sizer_target(&sizer));
+    HOST_TEST_CHECK(cam_fb_sizer_high_water(&sizer) == 0, "overflow is not a frame length");
+    HOST_TEST_CHECK(sizer.current->count == 1, "%u samples from one overflow", sizer.current->count);
+    HOST_TEST_CHECK(cam_fb_sizer_resize(&sizer, 30 * KB, 90 * KB) == 75 * KB, "grow");
+    // only 20 KB left in the budget
+    HOST_TEST_CHECK(cam_fb_sizer_resize(&sizer, 30 * KB, 130 * KB) == 50 * KB, "partial grow");
+    HOST_TEST_CHECK(cam_fb_sizer_resize(&sizer, 30 * KB, 150 * KB) == 30 * KB, "budget used up");
+
+    cam_fb_sizer_overflow(&sizer, 60 * KB);
+    cam_fb_sizer_overflow(&sizer, 100 * KB);
+    HOST_TEST_CHECK(sizer.current->count == 3, "%u samples from three overflows", sizer.current->count);
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 100 * KB, "per frame maximum: %zu", cam_fb_sizer_target(&sizer));
+}
+
+static void test_profiles(void)
+{
+    cam_fb_sizer_t sizer;
+    cam_fb_sizer_init(&sizer, 96000, 8 * KB, 200 * KB, 400 * KB);
+    cam_fb_sizer_set_profile(&sizer, 1);
+    cam_fb_sizer_add(&sizer, 40 * KB);
+    cam_fb_sizer_set_profile(&sizer, 2);
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 94 * KB, "new profile starts from the initial size");
+    cam_fb_sizer_add(&sizer, 8 * KB);
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 10 * KB, "target %zu", cam_fb_sizer_target(&sizer));
+    cam_fb_sizer_set_profile(&sizer, 1);
+    HOST_TEST_CHECK(cam_fb_sizer_target(&sizer) == 50 * KB, "profile 1 remembered: %zu", cam_fb_sizer_target(&sizer));
+
+    // profile 2 is used least recently and makes room for the fifth one
+    for (uint32_t key = 3; key <= 5; key++) {
+        cam_fb_sizer_set_profile(&sizer, key);
+        cam_fb_sizer_add(&sizer, key * KB * 10);
+    }
+    cam_fb_sizer_set_profile(&sizer, 1);
+    cam_fb_sizer_add(&sizer, 40 * KB);
+    cam_fb_sizer_set_profile(&sizer, 6);
+    cam_fb_sizer_add(&sizer, 20 * KB);
+    cam_fb_sizer_set_profile(&sizer, 1);
+    HOST_TEST_CHECK(cam_fb_sizer_high_water(&sizer) == 40 * KB, "profile 1 kept");
+    cam_fb_sizer_set_profile(&sizer, 3);
+    HOST_TEST_CHECK(cam_fb_sizer_high_water(&sizer) == 0, "profile 3 evicted: %zu", cam_fb_sizer_high_water(&sizer));
+}
+
+int main(void)
+{
+    HOST_TEST_RUN(test_initial_size);
+    HOST_TEST_RUN(test_shrink_with_hysteresis);
+    HOST_TEST_RUN(test_outlier_sets_floor);
+    HOST_TEST_RUN(test_grow_within_budget);
+    HOST_TEST_RUN(test_profiles);
+    return 0;
+}
@@ -0,0 +1,218 @@
+// Exercises the frame ownership ring used between cam_task and cam_take/cam_give.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include "cam_frame_ring.h"
+#include "host_test.h"
+
+static void test_fifo_and_drop_oldest(void)
+{
+    cam_frame_ring_t ring = {0};
+    int dropped;
+    HOST_TEST_CHECK(cam_frame_ring_init(&ring, 3, 2), "init");
+
+    int a = cam_frame_ring_acquire(&ring, 0);
+    HOST_TEST_CHECK(a == 0, "acquire returned %d", a);
+    // an abandoned capture keeps its frame
+    HOST_TEST_CHECK(cam_frame_ring_acquire(&ring, 0) == 0, "re-acquire");
+    HOST_TEST_CHECK(cam_frame_ring_push(&ring, a, &dropped) && dropped == -1, "push a");
+
+    int b = cam_frame_ring_acquire(&ring, a);
+    HOST_TEST_CHECK(b == 1, "acquire returned %d", b);
+    HOST_TEST_CHECK(cam_frame_ring_push(&ring, b, &dropped) && dropped == -1, "push b");
+    HOST_TEST_CHECK(cam_frame_ring_count(&ring) == 2, "count %u", cam_frame_ring_count(&ring));
+
+    // the queue holds two frames, the third push evicts the oldest
+    int c = cam_frame_ring_acquire(&ring, b);
+    HOST_TEST_CHECK(c == 2, "acquire returned %d", c);
+    HOST_TEST_CHECK(cam_frame_ring_push(&ring, c, &dropped) && dropped == a, "push c dropped %d", dropped);
+    HOST_TEST_CHECK(cam_frame_ring_state(&ring, a) == CAM_FRAME_FREE, "dropped frame is free");
+
+    HOST_TEST_CHECK(cam_frame_ring_pop(&ring) == b, "pop b");
+    HOST_TEST_CHECK(cam_frame_ring_state(&ring, b) == CAM_FRAME_HELD, "b held");
+    HOST_TEST_CHECK(cam_frame_ring_pop(&ring) == c, "pop c");
+    HOST_TEST_CHECK(cam_frame_ring_pop(&ring) == -1, "empty");
+
+    // held frames are never handed to the producer
+    int d = cam_frame_ring_acquire(&ring, b);
+    HOST_TEST_CHECK(d == a, "acquire returned %d", d);
+    HOST_TEST_CHECK(cam_frame_ring_push(&ring, d, &dropped), "push d");
+    HOST_TEST_CHECK(cam_frame_ring_acquire(&ring, 0) == -1, "all frames taken");
+
+    HOST_TEST_CHECK(cam_frame_ring_give(&ring, b), "give b");
+    HOST_TEST_CHECK(!cam_frame_ring_give(&ring, b), "double give is rejected");
+    HOST_TEST_CHECK(!cam_frame_ring_give(&ring, d), "queued frame can not be given");
+    HOST_TEST_CHECK(cam_frame_ring_acquire(&ring, 0) == b, "given frame is reused");
+
+    cam_frame_ring_deinit(&ring);
+}
+
+static void test_shared_holders(void)
+{
+    cam_frame_ring_t ring = {0};
+    int dropped;
+    HOST_TEST_CHECK(cam_frame_ring_init(&ring, 2, 2), "init");
+
+    int a = cam_frame_ring_acquire(&ring, 0);
+    HOST_TEST_CHECK(!cam_frame_ring_ref(&ring, a), "filling frame can not be referenced");
+    cam_frame_ring_push(&ring, a, &dropped);
+    HOST_TEST_CHECK(!cam_frame_ring_ref(&ring, a), "queued frame can not be referenced");
+    HOST_TEST_CHECK(cam_frame_ring_pop(&ring) == a, "pop");
+
+    HOST_TEST_CHECK(cam_frame_ring_ref(&ring, a), "second holder");
+    HOST_TEST_CHECK(cam_frame_ring_ref(&ring, a), "third holder");
+    HOST_TEST_CHECK(cam_frame_ring_give(&ring, a), "give 1");
+    HOST_TEST_CHECK(cam_frame_ring_give(&ring, a), "give 2");
+    HOST_TEST_CHECK(cam_frame_ring_state(&ring, a) == CAM_FRAME_HELD, "still held by the last holder");
+    int b = cam_frame_ring_acquire(&ring, a);
+    HOST_TEST_CHECK(b != a, "held frame handed to the producer");
+    HOST_TEST_CHECK(cam_frame_ring_give(&ring, a), "give 3");
+    HOST_TEST_CHECK(cam_frame_ring_state(&ring, a) == CAM_FRAME_FREE, "last give frees the frame");
+    HOST_TEST_CHECK(!cam_frame_ring_give(&ring, a), "extra give is rejected");
+    HOST_TEST_CHECK(!cam_frame_ring_ref(&ring, a), "returned frame can not be referenced");
+
+    cam_frame_ring_deinit(&ring);
+}
+
+#define STRESS_FRAMES   4
+#define STRESS_PUSHES   200000
+#define STRESS_CONSUMERS 2
+
+typedef struct {
+    cam_frame_ring_t ring;
+    _Atomic int owners[STRESS_FRAMES];
+    uint32_t payload[STRESS_FRAMES];
+    _Atomic bool done;
+    _Atomic uint32_t popped;
+    _Atomic uint32_t dropped;
+} stress_t;
+
+static void own(stress_t *s, int pos)
+{
+    int prev = atomic_fetch_add(&s->owners[pos], 1);
+    HOST_TEST_CHECK(prev == 0, "frame %d already has %d owner(s)", pos, prev);
+}
+
+static void disown(stress_t *s, int pos)
+{
+    atomic_fetch_sub(&s->owners[pos], 1);
+}
+
+static void *stress_producer(void *arg)
+{
+    stress_t *s = (stress_t *)arg;
+    int pos = 0;
+    for (uint32_t seq = 1; seq <= STRESS_PUSHES;) {
+        int p = cam_frame_ring_acquire(&s->ring, pos);
+        if (p < 0) {
+            sched_yield();
+            continue;
+        }
+        HOST_TEST_CHECK(cam_frame_ring_state(&s->ring, p) == CAM_FRAME_FILLING, "acquired frame not filling");
+        pos = p;
+        own(s, pos);
+        s->payload[pos] = seq;
+        disown(s, pos);
+        int dropped;
+        HOST_TEST_CHECK(cam_frame_ring_push(&s->ring, pos, &dropped), "push failed");
+        if (dropped >= 0) {
+            atomic_fetch_add(&s->dropped, 1);
+        }
+        seq++;
+        if ((seq & 63) == 0) {
+            // let the consumers in on single core hosts
+            sched_yield();
+        }
+    }
+    atomic_store(&s->done, true);
+    return NULL;
+}
+
+static void *stress_consumer(void *arg)
+{
+    stress_t *s = (stress_t *)arg;
+    uint32_t last = 0;
+    while (1) {
+        int pos = cam_frame_ring_pop(&s->ring);
+        if (pos < 0) {
+            if (atomic_load(&s->done) && cam_frame_ring_count(&s->ring) == 0) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        own(s, pos);
+        HOST_TEST_CHECK(cam_frame_ring_state(&s->ring, pos) == CAM_FRAME_HELD, "popped frame not held");
+        uint32_t seq = s->payload[pos];
+        HOST_TEST_CHECK(seq > last, "frame %u after %u", seq, last);
+        last = seq;
+        atomic_fetch_add(&s->popped, 1);
+        disown(s, pos);
+        // every other frame is shared with a second holder that lets go last
+        bool shared = seq & 1;
+        if (shared) {
+            HOST_TEST_CHECK(cam_frame_ring_ref(&s->ring, pos), "ref failed");
+        }
+        HOST_TEST_CHECK(cam_frame_ring_give(&s->ring, pos), "give failed");
+        if (shared) {
+            HOST_TEST_CHECK(cam_frame_ring_state(&s->ring, pos) == CAM_FRAME_HELD, "shared frame released early");
+            sched_yield();
+            HOST_TEST_CHECK(cam_frame_ring_give(&s->ring, pos), "second give failed");
+        }
+    }
+    return NULL;
+}
+
+static void run_stress(uint32_t limit, int consumers)
+{
+    static stress_t s;
+    s = (stress_t){0};
+    HOST_TEST_CHECK(cam_frame_ring_init(&s.ring, STRESS_FRAMES, limit), "init");
+
+    pthread_t producer, consumer[STRESS_CONSUMERS];
+    pthread_create(&producer, NULL, stress_producer, &s);
+    for (int i = 0; i < consumers; i++) {
+        pthread_create(&consumer[i], NULL, stress_consumer, &s);
+    }
+    pthread_join(producer, NULL);
+    for (int i = 0; i < consumers; i++) {
+        pthread_join(consumer[i], NULL);
+    }
+
+    uint32_t popped = atomic_load(&s.popped), dropped = atomic_load(&s.dropped);
+    printf("  limit %u, consumers %d: popped %u, dropped %u\n", limit, consumers, popped, dropped);
+    HOST_TEST_CHECK(popped + dropped == STRESS_PUSHES, "%u popped + %u dropped != %u", popped, dropped, STRESS_PUSHES);
+    for (int i = 0; i < STRESS_FRAMES; i++) {
+        HOST_TEST_CHECK(cam_frame_ring_state(&s.ring, i) == CAM_FRAME_FREE, "frame %d not free at the end", i);
+    }
+    cam_frame_ring_deinit(&s.ring);
+}
+
+static void test_stress_grab_when_empty(void)
+{
+    run_stress(STRESS_FRAMES, 1);
+}
+
+static void test_stress_grab_latest(void)
+{
+    run_stress(STRESS_FRAMES - 1, 1);
+    run_stress(1, 1);
+}
+
+static void test_stress_two_consumers(void)
+{
+    run_stress(STRESS_FRAMES - 1, STRESS_CONSUMERS);
+}
+
+int main(void)
+{
+    HOST_TEST_RUN(test_fifo_and_drop_oldest);
+    HOST_TEST_RUN(test_shared_holders);
+    HOST_TEST_RUN(test_stress_grab_when_empty);
+    HOST_TEST_RUN(test_stress_grab_latest);
+    HOST_TEST_RUN(test_stress_two_consumers);
+    return 0;
+}
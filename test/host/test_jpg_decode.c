@@ -0,0 +1,708 @@
+// Checks the JPEG decode paths built on esp_jpg_decode against a plain full decode
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "tjpgd.h"
+
+// runs check on each of the camera pictures in test/pictures
+static void for_each_picture(void (*check)(const uint8_t *jpg, size_t len, const char *name))
+{
+    static const char *pictures[] = { "testimg.jpeg", "test_inside.jpeg", "test_outside.jpeg" };
+    for (size_t i = 0; i < sizeof(pictures) / sizeof(pictures[0]); i++) {
+        char path[256];
+        size_t len;
+        snprintf(path, sizeof(path), CAMERA_TEST_PICTURES "/%s", pictures[i]);
+        uint8_t *jpg = host_test_load_file(path, &len);
+        check(jpg, len, pictures[i]);
+        free(jpg);
+    }
+}
+
+typedef struct {
+    const uint8_t *jpg;
+    int width;
+    int height;
+    uint8_t *rgb;//R G B as tjpgd outputs it
+    bool yield;//lets the other decodes run between the blocks, even on one core
+} full_decode_t;
+
+static size_t full_read(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    full_decode_t *d = (full_decode_t *)arg;
+    if (buf) {
+        memcpy(buf, d->jpg + index, len);
+    }
+    return len;
+}
+
+static bool full_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    full_decode_t *d = (full_decode_t *)arg;
+    if (!data) {
+        if (x == 0 && y == 0) {
+            d->width = w;
+            d->height = h;
+            d->rgb = (uint8_t *)malloc(w * h * 3);
+        }
+        return true;
+    }
+    for (int iy = 0; iy < h; iy++, data += w * 3) {
+        memcpy(d->rgb + ((y + iy) * d->width + x) * 3, data, w * 3);
+    }
+    if (d->yield) {
+        sched_yield();
+    }
+    return true;
+}
+
+static full_decode_t decode_full(const uint8_t *jpg, size_t len, jpg_scale_t scale)
+{
+    full_decode_t d = { .jpg = jpg };
+    HOST_TEST_CHECK(esp_jpg_decode(len, scale, full_read, full_write, &d) == ESP_OK, "decode at scale %d", scale);
+    return d;
+}
+
+// smooth gradients and some edges, encoded at high quality, with a restart marker between the strips
+static uint8_t *make_jpeg(int width, int height, uint8_t strips, size_t *len)
+{
+    uint8_t *bgr = (uint8_t *)malloc(width * height * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t *p = bgr + (y * width + x) * 3;
+            p[0] = x * 255 / width;
+            p[1] = y * 255 / height;
+            p[2] = ((x / 40) ^ (y / 30)) & 1 ? 220 : 30;
+        }
+    }
+    jpg_encoder_ctx_t encoder = jpg_encoder_create_parallel(width, height, PIXFORMAT_RGB888, 90, strips);
+    HOST_TEST_CHECK(encoder != NULL, "%d strips", strips);
+    uint8_t *jpg = (uint8_t *)malloc(width * height * 3);
+    HOST_TEST_CHECK(jpg_encoder_encode_buf(encoder, bgr, width * height * 3, jpg, width * height * 3, len), "encode");
+    jpg_encoder_delete(encoder);
+    free(bgr);
+    return jpg;
+}
+
+// the area average of the scaled decode, in doubles
+static void reference_resize(const full_decode_t *d, int width, int height, double *out)
+{
+    double sx = (double)d->width / width, sy = (double)d->height / height;
+    for (int oy = 0; oy < height; oy++) {
+        for (int ox = 0; ox < width; ox++) {
+            double sum[3] = { 0 };
+            for (int y = (int)(oy * sy); y < d->height && y < (oy + 1) * sy; y++) {
+                double wy = fmin(y + 1, (oy + 1) * sy) - fmax(y, oy * sy);
+                for (int x = (int)(ox * sx); x < d->width && x < (ox + 1) * sx; x++) {
+                    double wx = fmin(x + 1, (ox + 1) * sx) - fmax(x, ox * sx);
+                    for (int c = 0; c < 3; c++) {
+                        sum[c] += d->rgb[(y * d->width + x) * 3 + c] * wx * wy;
+                    }
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                out[(oy * width + ox) * 3 + c] = sum[c] / (sx * sy);
+            }
+        }
+    }
+}
+
+static void check_scaled(const uint8_t *jpg, size_t len, int jpg_width, int jpg_height, int width, int height)
+{
+    jpg_scale_t scale = JPG_SCALE_NONE;
+    while (scale < JPG_SCALE_MAX && (jpg_width >> (scale + 1)) >= width && (jpg_height >> (scale + 1)) >= height) {
+        scale++;
+    }
+    full_decode_t full = decode_full(jpg, len, scale);
+    double *expected = (double *)malloc(width * height * 3 * sizeof(double));
+    reference_resize(&full, width, height, expected);
+
+    size_t pixels = width * height;
+    uint8_t *bgr = (uint8_t *)malloc(pixels * 3 + 1);
+    bgr[pixels * 3] = 0xa5;
+    HOST_TEST_CHECK(jpg2fmt_scaled(jpg, len, width, height, PIXFORMAT_RGB888, bgr), "%dx%d", width, height);
+    HOST_TEST_CHECK(bgr[pixels * 3] == 0xa5, "%dx%d wrote past the end", width, height);
+    for (size_t i = 0; i < pixels; i++) {
+        for (int c = 0; c < 3; c++) {
+            double e = expected[i * 3 + c];
+            HOST_TEST_CHECK(fabs(bgr[i * 3 + 2 - c] - e) <= 1.0, "%dx%d pixel %zu channel %d: %d, expected %.2f",
+                            width, height, i, c, bgr[i * 3 + 2 - c], e);
+        }
+    }
+
+    // the other formats come from the same pixels
+    uint8_t *rgb565 = (uint8_t *)malloc(pixels * 2);
+    uint8_t *gray = (uint8_t *)malloc(pixels);
+    HOST_TEST_CHECK(jpg2fmt_scaled(jpg, len, width, height, PIXFORMAT_RGB565, rgb565), "RGB565");
+    HOST_TEST_CHECK(jpg2fmt_scaled(jpg, len, width, height, PIXFORMAT_GRAYSCALE, gray), "grayscale");
+    for (size_t i = 0; i < pixels; i++) {
+        const uint8_t *p = bgr + i * 3;
+        uint16_t c = ((p[2] & 0xF8) << 8) | ((p[1] & 0xFC) << 3) | (p[0] >> 3);
+        HOST_TEST_CHECK(rgb565[i * 2] == (c & 0xff) && rgb565[i * 2 + 1] == (c >> 8), "RGB565 pixel %zu", i);
+        HOST_TEST_CHECK(gray[i] == ((p[2] * 77 + p[1] * 150 + p[0] * 29 + 128) >> 8), "gray pixel %zu", i);
+    }
+    free(gray);
+    free(rgb565);
+    free(bgr);
+    free(expected);
+    free(full.rgb);
+}
+
+static void test_scaled(void)
+{
+    size_t len;
+    uint8_t *jpg = make_jpeg(640, 480, 1, &len);
+    check_scaled(jpg, len, 640, 480, 96, 96);
+    check_scaled(jpg, len, 640, 480, 224, 224);
+    check_scaled(jpg, len, 640, 480, 160, 120);
+    check_scaled(jpg, len, 640, 480, 640, 480);
+    check_scaled(jpg, len, 640, 480, 1, 1);
+    check_scaled(jpg, len, 640, 480, 639, 17);
+
+    // a power of two is the scaled decode as it is
+    full_decode_t full = decode_full(jpg, len, JPG_SCALE_4X);
+    uint8_t *bgr = (uint8_t *)malloc(160 * 120 * 3);
+    HOST_TEST_CHECK(jpg2fmt_scaled(jpg, len, 160, 120, PIXFORMAT_RGB888, bgr), "160x120");
+    for (int i = 0; i < 160 * 120 * 3; i += 3) {
+        HOST_TEST_CHECK(bgr[i] == full.rgb[i + 2] && bgr[i + 1] == full.rgb[i + 1] && bgr[i + 2] == full.rgb[i], "pixel %d", i / 3);
+    }
+    free(bgr);
+    free(full.rgb);
+
+    uint8_t out[4];
+    HOST_TEST_CHECK(!jpg2fmt_scaled(jpg, len, 641, 1, PIXFORMAT_RGB888, out), "upscaling");
+    HOST_TEST_CHECK(!jpg2fmt_scaled(jpg, len, 1, 1, PIXFORMAT_YUV422, out), "YUV output");
+    free(jpg);
+
+    // sizes that are no multiple of the MCU
+    jpg = host_test_load_file(CAMERA_TEST_PICTURES "/testimg.jpeg", &len);
+    check_scaled(jpg, len, 227, 149, 96, 96);
+    check_scaled(jpg, len, 227, 149, 100, 37);
+    free(jpg);
+    jpg = host_test_load_file(CAMERA_TEST_PICTURES "/test_outside.jpeg", &len);
+    check_scaled(jpg, len, 480, 320, 224, 224);
+    free(jpg);
+}
+
+typedef struct {
+    const uint8_t *jpg;
+    int x;
+    int y;
+    int width;
+    int height;
+    uint8_t *rgb;
+    uint8_t *written;//how often every pixel was written
+} roi_decode_t;
+
+static size_t roi_read(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    roi_decode_t *d = (roi_decode_t *)arg;
+    if (buf) {
+        memcpy(buf, d->jpg + index, len);
+    }
+    return len;
+}
+
+static bool roi_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    roi_decode_t *d = (roi_decode_t *)arg;
+    if (!data) {
+        if (x == 0 && y == 0) {
+            HOST_TEST_CHECK(w == d->width && h == d->height, "started with %ux%u", w, h);
+        }
+        return true;
+    }
+    HOST_TEST_CHECK(x + w <= d->width && y + h <= d->height, "block %u,%u %ux%u is outside", x, y, w, h);
+    for (int iy = 0; iy < h; iy++, data += w * 3) {
+        memcpy(d->rgb + ((y + iy) * d->width + x) * 3, data, w * 3);
+        for (int ix = 0; ix < w; ix++) {
+            d->written[(y + iy) * d->width + x + ix]++;
+        }
+    }
+    return true;
+}
+
+// the region has to be exactly the crop of the full decode
+static void check_roi(const uint8_t *jpg, size_t len, const full_decode_t *full, jpg_scale_t scale, int x, int y, int width, int height)
+{
+    roi_decode_t d = {
+        .jpg = jpg,
+        .x = x,
+        .y = y,
+        .width = width,
+        .height = height,
+        .rgb = (uint8_t *)malloc(width * height * 3),
+        .written = (uint8_t *)calloc(width * height, 1),
+    };
+    HOST_TEST_CHECK(esp_jpg_decode_roi(len, scale, x, y, width, height, roi_read, roi_write, &d) == ESP_OK,
+                    "scale %d, %d,%d %dx%d", scale, x, y, width, height);
+    for (int iy = 0; iy < height; iy++) {
+        for (int ix = 0; ix < width; ix++) {
+            int i = iy * width + ix;
+            HOST_TEST_CHECK(d.written[i] == 1, "scale %d, %d,%d %dx%d: pixel %d,%d written %d times",
+                            scale, x, y, width, height, ix, iy, d.written[i]);
+            HOST_TEST_CHECK(memcmp(d.rgb + i * 3, full->rgb + ((y + iy) * full->width + x + ix) * 3, 3) == 0,
+                            "scale %d, %d,%d %dx%d: pixel %d,%d differs", scale, x, y, width, height, ix, iy);
+        }
+    }
+    free(d.written);
+    free(d.rgb);
+}
+
+static void check_rois(const uint8_t *jpg, size_t len)
+{
+    for (jpg_scale_t scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        full_decode_t full = decode_full(jpg, len, scale);
+        int w = full.width, h = full.height;
+        check_roi(jpg, len, &full, scale, 0, 0, w, h);
+        check_roi(jpg, len, &full, scale, 0, 0, 1, 1);
+        check_roi(jpg, len, &full, scale, w - 1, h - 1, 1, 1);
+        check_roi(jpg, len, &full, scale, w / 3, h / 3, w / 4, h / 5);
+        check_roi(jpg, len, &full, scale, w / 2 + 1, 3, w / 2 - 1, 1);
+        check_roi(jpg, len, &full, scale, 5, h / 2, 1, h / 2);
+        check_roi(jpg, len, &full, scale, 0, h - 2, w, 2);
+        free(full.rgb);
+    }
+}
+
+static void test_roi(void)
+{
+    size_t len;
+    uint8_t *jpg = make_jpeg(640, 480, 1, &len);
+    check_rois(jpg, len);
+    roi_decode_t d = { .jpg = jpg };
+    HOST_TEST_CHECK(esp_jpg_decode_roi(len, JPG_SCALE_NONE, 600, 0, 41, 1, roi_read, roi_write, &d) == ESP_FAIL, "outside");
+    HOST_TEST_CHECK(esp_jpg_decode_roi(len, JPG_SCALE_2X, 0, 240, 1, 1, roi_read, roi_write, &d) == ESP_FAIL, "outside scaled");
+    HOST_TEST_CHECK(esp_jpg_decode_roi(len, JPG_SCALE_NONE, 0, 0, 0, 1, roi_read, roi_write, &d) == ESP_ERR_INVALID_ARG, "empty");
+    free(jpg);
+
+    // restart intervals of one and of several MCU rows, the ones outside of the region are skipped
+    jpg = make_jpeg(640, 480, 30, &len);
+    check_rois(jpg, len);
+    free(jpg);
+    jpg = make_jpeg(640, 480, 7, &len);
+    check_rois(jpg, len);
+    free(jpg);
+
+    jpg = host_test_load_file(CAMERA_TEST_PICTURES "/testimg.jpeg", &len);
+    check_rois(jpg, len);
+    free(jpg);
+}
+
+static full_decode_t decode_with_pool(const uint8_t *jpg, size_t len, jpg_scale_t scale, void *pool, size_t pool_size, esp_err_t *err)
+{
+    full_decode_t d = { .jpg = jpg };
+    *err = esp_jpg_decode_with_pool(len, scale, pool, pool_size, full_read, full_write, &d);
+    return d;
+}
+
+// the pool jd_prepare() needs, not a word more. The host has the tjpgd of the component,
+// its pool holds a Huffman look up table for each of the four tables of a camera JPEG
+static void check_pool_size(const uint8_t *jpg, size_t len, const char *name)
+{
+    size_t pool_size = 0;
+    HOST_TEST_CHECK(esp_jpg_decode_pool_size(len, full_read, &(full_decode_t){ .jpg = jpg }, &pool_size) == ESP_OK, "%s", name);
+    HOST_TEST_CHECK(pool_size > JD_SZBUF + 4 * (1 << JD_HUFFLUT_BITS) * sizeof(WORD), "%s: pool of %zu without look up tables", name, pool_size);
+    uint8_t *pool = (uint8_t *)malloc(pool_size);
+    full_decode_t full = decode_full(jpg, len, JPG_SCALE_NONE);
+    esp_err_t err;
+    full_decode_t d = decode_with_pool(jpg, len, JPG_SCALE_NONE, pool, pool_size, &err);
+    HOST_TEST_CHECK(err == ESP_OK, "%s with a pool of %zu", name, pool_size);
+    HOST_TEST_CHECK(memcmp(d.rgb, full.rgb, full.width * full.height * 3) == 0, "%s differs", name);
+    free(d.rgb);
+    d = decode_with_pool(jpg, len, JPG_SCALE_NONE, pool, pool_size - 4, &err);
+    HOST_TEST_CHECK(err == ESP_FAIL, "%s with a pool of %zu", name, pool_size - 4);
+    free(d.rgb);
+    free(full.rgb);
+    free(pool);
+}
+
+static void test_pool_size(void)
+{
+    size_t len;
+    for_each_picture(check_pool_size);
+    uint8_t *jpg = make_jpeg(640, 480, 4, &len);
+    check_pool_size(jpg, len, "640x480");
+    size_t pool_size;
+    HOST_TEST_CHECK(esp_jpg_decode_pool_size(len / 8, full_read, &(full_decode_t){ .jpg = jpg }, &pool_size) == ESP_OK, "header only");
+    HOST_TEST_CHECK(esp_jpg_decode_pool_size(100, full_read, &(full_decode_t){ .jpg = jpg }, &pool_size) == ESP_FAIL, "cut header");
+    free(jpg);
+}
+
+typedef struct {
+    const uint8_t *jpg;
+    size_t len;
+    jpg_scale_t scale;
+    full_decode_t expected;
+    bool ok;
+} decode_thread_t;
+
+// every other decode is with a pool of its own
+static void *decode_thread(void *arg)
+{
+    decode_thread_t *t = (decode_thread_t *)arg;
+    size_t pool_size = 0;
+    t->ok = esp_jpg_decode_pool_size(t->len, full_read, &(full_decode_t){ .jpg = t->jpg }, &pool_size) == ESP_OK;
+    uint8_t *pool = (uint8_t *)malloc(pool_size);
+    for (int i = 0; i < 40 && t->ok; i++) {
+        full_decode_t d = { .jpg = t->jpg, .yield = true };
+        esp_err_t err = (i & 1) ? esp_jpg_decode_with_pool(t->len, t->scale, pool, pool_size, full_read, full_write, &d)
+                                : esp_jpg_decode(t->len, t->scale, full_read, full_write, &d);
+        t->ok = err == ESP_OK && d.width == t->expected.width && d.height == t->expected.height
+                && memcmp(d.rgb, t->expected.rgb, d.width * d.height * 3) == 0;
+        free(d.rgb);
+    }
+    free(pool);
+    return NULL;
+}
+
+// decodes of different JPEGs and scales at the same time, each matching its decode on its own
+static void test_concurrent(void)
+{
+    size_t len[2];
+    uint8_t *jpg[2] = {
+        make_jpeg(320, 240, 1, &len[0]),
+        host_test_load_file(CAMERA_TEST_PICTURES "/test_outside.jpeg", &len[1]),
+    };
+    decode_thread_t threads[4];
+    pthread_t ids[4];
+    for (int i = 0; i < 4; i++) {
+        threads[i] = (decode_thread_t) {
+            .jpg = jpg[i & 1],
+            .len = len[i & 1],
+            .scale = (jpg_scale_t)(i >> 1),
+        };
+        threads[i].expected = decode_full(threads[i].jpg, threads[i].len, threads[i].scale);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&ids[i], NULL, decode_thread, &threads[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(ids[i], NULL);
+        HOST_TEST_CHECK(threads[i].ok, "thread %d", i);
+        free(threads[i].expected.rgb);
+    }
+    free(jpg[1]);
+    free(jpg[0]);
+}
+
+// in place, the JPEG must come out the same as through the reader and stay as it was
+static void check_mem(const uint8_t *jpg, size_t len, const char *name)
+{
+    uint8_t *copy = (uint8_t *)malloc(len);
+    memcpy(copy, jpg, len);
+    for (jpg_scale_t scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        full_decode_t full = decode_full(jpg, len, scale);
+        full_decode_t d = { .jpg = NULL };
+        HOST_TEST_CHECK(esp_jpg_decode_mem(copy, len, scale, full_write, &d) == ESP_OK, "%s at scale %d", name, scale);
+        HOST_TEST_CHECK(d.width == full.width && d.height == full.height
+                        && memcmp(d.rgb, full.rgb, full.width * full.height * 3) == 0, "%s at scale %d differs", name, scale);
+        HOST_TEST_CHECK(memcmp(copy, jpg, len) == 0, "%s was written", name);
+        free(d.rgb);
+        free(full.rgb);
+    }
+    free(copy);
+}
+
+static void test_mem(void)
+{
+    size_t len;
+    for_each_picture(check_mem);
+    uint8_t *jpg = make_jpeg(640, 480, 7, &len);
+    check_mem(jpg, len, "restart markers");
+
+    // a cut JPEG ends the decode, nothing past it is read
+    uint8_t *cut = (uint8_t *)malloc(len / 2);
+    memcpy(cut, jpg, len / 2);
+    full_decode_t d = { .jpg = NULL };
+    HOST_TEST_CHECK(esp_jpg_decode_mem(cut, len / 2, JPG_SCALE_NONE, full_write, &d) == ESP_FAIL, "cut JPEG");
+    HOST_TEST_CHECK(esp_jpg_decode_mem(NULL, len, JPG_SCALE_NONE, full_write, &d) == ESP_ERR_INVALID_ARG, "no JPEG");
+    free(d.rgb);
+    free(cut);
+    free(jpg);
+}
+
+typedef struct {
+    int width;
+    int height;
+    size_t bpp;
+    uint8_t *pixels;
+} format_decode_t;
+
+static bool format_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    format_decode_t *d = (format_decode_t *)arg;
+    if (!data) {
+        if (x == 0 && y == 0) {
+            d->width = w;
+            d->height = h;
+            d->pixels = (uint8_t *)malloc(w * h * d->bpp);
+        }
+        return true;
+    }
+    for (int iy = 0; iy < h; iy++, data += w * d->bpp) {
+        memcpy(d->pixels + ((y + iy) * d->width + x) * d->bpp, data, w * d->bpp);
+    }
+    return true;
+}
+
+// every format has to be the RGB888 decode packed, the gray one about its luminance
+static void check_formats(const uint8_t *jpg, size_t len, const char *name)
+{
+    static const size_t bpp[] = { 3, 3, 2, 2, 1 };
+    for (jpg_scale_t scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        full_decode_t rgb = { .jpg = NULL };
+        HOST_TEST_CHECK(esp_jpg_decode_mem(jpg, len, scale, full_write, &rgb) == ESP_OK, "%s at scale %d", name, scale);
+        size_t pixels = rgb.width * rgb.height;
+        uint8_t *expected = (uint8_t *)malloc(pixels * 3);
+        for (jpg_format_t format = JPG_FORMAT_RGB888; format <= JPG_FORMAT_GRAY; format++) {
+            format_decode_t d = { .bpp = bpp[format] };
+            HOST_TEST_CHECK(esp_jpg_decode_mem_format(jpg, len, scale, format, format_write, &d) == ESP_OK,
+                            "%s at scale %d, format %d", name, scale, format);
+            HOST_TEST_CHECK(d.width == rgb.width && d.height == rgb.height, "%s format %d size", name, format);
+            double error = 0;
+            for (size_t i = 0; i < pixels; i++) {
+                const uint8_t *p = rgb.rgb + i * 3;
+                uint16_t c = ((p[0] & 0xF8) << 8) | ((p[1] & 0xFC) << 3) | (p[2] >> 3);
+                uint8_t *e = expected + i * bpp[format];
+                switch (format) {
+                case JPG_FORMAT_RGB888:
+                    memcpy(e, p, 3);
+                    break;
+                case JPG_FORMAT_BGR888:
+                    e[0] = p[2];
+                    e[1] = p[1];
+                    e[2] = p[0];
+                    break;
+                case JPG_FORMAT_RGB565_LE:
+                    e[0] = c & 0xff;
+                    e[1] = c >> 8;
+                    break;
+                case JPG_FORMAT_RGB565_BE:
+                    e[0] = c >> 8;
+                    e[1] = c & 0xff;
+                    break;
+                default:
+                    error += fabs(0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2] - d.pixels[i]);
+                    break;
+                }
+            }
+            if (format == JPG_FORMAT_GRAY) {
+                // the luminance before the color conversion rounds and clips it
+                HOST_TEST_CHECK(error / pixels < 1.0, "%s at scale %d: gray is %.2f off", name, scale, error / pixels);
+            } else {
+                HOST_TEST_CHECK(memcmp(d.pixels, expected, pixels * bpp[format]) == 0, "%s at scale %d, format %d differs", name, scale, format);
+            }
+            free(d.pixels);
+        }
+        free(expected);
+        free(rgb.rgb);
+    }
+}
+
+// jpg2rgb565 takes the format straight from the decoder
+static void check_jpg2rgb565(const uint8_t *jpg, size_t len, const char *name)
+{
+    format_decode_t d = { .bpp = 2 };
+    HOST_TEST_CHECK(esp_jpg_decode_mem_format(jpg, len, JPG_SCALE_NONE, JPG_FORMAT_RGB565_LE, format_write, &d) == ESP_OK, "decode");
+    uint8_t *rgb565 = (uint8_t *)malloc(d.width * d.height * 2);
+    HOST_TEST_CHECK(jpg2rgb565(jpg, len, rgb565, JPG_SCALE_NONE), "jpg2rgb565");
+    HOST_TEST_CHECK(memcmp(rgb565, d.pixels, d.width * d.height * 2) == 0, "jpg2rgb565 of %s differs", name);
+    free(rgb565);
+    free(d.pixels);
+}
+
+static void test_formats(void)
+{
+    size_t len;
+    for_each_picture(check_formats);
+    for_each_picture(check_jpg2rgb565);
+    // 4:4:4 and the partial MCUs on the right and bottom edges
+    uint8_t *jpg = make_jpeg(97, 61, 2, &len);
+    check_formats(jpg, len, "97x61");
+
+    format_decode_t d = { .bpp = 1 };
+    HOST_TEST_CHECK(esp_jpg_decode_mem_format(jpg, len, JPG_SCALE_NONE, (jpg_format_t)(JPG_FORMAT_GRAY + 1), format_write, &d) == ESP_ERR_INVALID_ARG, "format");
+    free(jpg);
+}
+
+typedef struct {
+    full_decode_t d;
+    size_t blocks;//blocks the writer got
+} stream_decode_t;
+
+static bool stream_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    stream_decode_t *s = (stream_decode_t *)arg;
+    s->blocks += data != NULL;
+    return full_write(&s->d, x, y, w, h, data);
+}
+
+// written in chunks of random sizes, like the DMA appends them, the picture must be the one of the whole JPEG
+static void check_stream(const uint8_t *jpg, size_t len, const char *name)
+{
+    uint32_t seed = len;
+    uint8_t *fb = (uint8_t *)malloc(len);
+    for (jpg_scale_t scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        full_decode_t full = decode_full(jpg, len, scale);
+        memset(fb, 0xFF, len);//what is not written yet must not be read
+        stream_decode_t s = { .d = { .jpg = NULL } };
+        esp_jpg_stream_t stream = esp_jpg_stream_create(scale, JPG_FORMAT_RGB888, stream_write, &s);
+        HOST_TEST_CHECK(stream != NULL, "%s create", name);
+        size_t written = 0, early = 0;
+        bool done = false;
+        while (written < len) {
+            seed = seed * 1103515245 + 12345;
+            size_t chunk = 1 + (seed >> 8) % (scale == JPG_SCALE_NONE ? 64 : 4096);
+            if (chunk > len - written) {
+                chunk = len - written;
+            }
+            memcpy(fb + written, jpg + written, chunk);
+            written += chunk;
+            HOST_TEST_CHECK(esp_jpg_stream_write(stream, fb, written, &done) == ESP_OK, "%s at %u", name, (unsigned)written);
+            if (!done) {
+                early = s.blocks;
+            }
+        }
+        HOST_TEST_CHECK(done, "%s at scale %d is not done", name, scale);
+        HOST_TEST_CHECK(scale != JPG_SCALE_NONE || early > s.blocks / 2, "%s: only %u of %u blocks before the end", name, (unsigned)early, (unsigned)s.blocks);
+        HOST_TEST_CHECK(s.d.width == full.width && s.d.height == full.height
+                        && memcmp(s.d.rgb, full.rgb, full.width * full.height * 3) == 0, "%s at scale %d differs", name, scale);
+        HOST_TEST_CHECK(esp_jpg_stream_write(stream, fb, len, &done) == ESP_OK && done, "%s done again", name);
+        esp_jpg_stream_delete(stream);
+        free(s.d.rgb);
+        free(full.rgb);
+    }
+    free(fb);
+}
+
+static void test_stream(void)
+{
+    size_t len;
+    for_each_picture(check_stream);
+    uint8_t *jpg = make_jpeg(640, 480, 7, &len);
+    check_stream(jpg, len, "restart markers");
+    free(jpg);
+    jpg = make_jpeg(97, 61, 1, &len);
+    check_stream(jpg, len, "97x61");
+    free(jpg);
+
+    // a cut JPEG waits for the rest, a broken one fails for good
+    jpg = make_jpeg(160, 120, 3, &len);
+    stream_decode_t s = { .d = { .jpg = NULL } };
+    bool done = true;
+    esp_jpg_stream_t stream = esp_jpg_stream_create(JPG_SCALE_NONE, JPG_FORMAT_GRAY, stream_write, &s);
+    HOST_TEST_CHECK(esp_jpg_stream_write(stream, jpg, len / 2, &done) == ESP_OK && !done, "cut JPEG");
+    HOST_TEST_CHECK(esp_jpg_stream_write(stream, jpg, len / 4, &done) == ESP_ERR_INVALID_ARG, "shrunk");
+    HOST_TEST_CHECK(esp_jpg_stream_write(stream, jpg + 1, len, &done) == ESP_ERR_INVALID_ARG, "moved");
+    esp_jpg_stream_delete(stream);
+    free(s.d.rgb);
+
+    uint8_t *bad = (uint8_t *)malloc(len);
+    memcpy(bad, jpg, len);
+    bad[2] = 0;//no marker after the SOI
+    s.d.rgb = NULL;
+    stream = esp_jpg_stream_create(JPG_SCALE_NONE, JPG_FORMAT_RGB888, stream_write, &s);
+    HOST_TEST_CHECK(esp_jpg_stream_write(stream, bad, len, &done) == ESP_FAIL, "broken JPEG");
+    HOST_TEST_CHECK(esp_jpg_stream_write(stream, bad, len, &done) == ESP_FAIL, "broken JPEG again");
+    esp_jpg_stream_delete(stream);
+    HOST_TEST_CHECK(esp_jpg_stream_create(JPG_SCALE_NONE, JPG_FORMAT_GRAY + 1, stream_write, &s) == NULL, "format");
+    free(bad);
+    free(jpg);
+}
+
+static uint32_t fnv1a(const uint8_t *data, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+// the decoder is exact, the pictures have to come out as they did before the Huffman look up table
+static void check_golden(const uint8_t *jpg, size_t len, const char *name)
+{
+    static const struct {
+        const char *name;
+        uint32_t hash[JPG_SCALE_MAX + 1];
+    } golden[] = {
+        { "testimg.jpeg", { 0x3a077a9c, 0x67783f45, 0x2341d945, 0x03b9b8f2 } },
+        { "test_inside.jpeg", { 0x49011320, 0x40b9238e, 0x6617dc58, 0x44caa382 } },
+        { "test_outside.jpeg", { 0x78fe5718, 0x04a3427b, 0x388a6718, 0x678fa474 } },
+    };
+    size_t i = 0;
+    while (i < sizeof(golden) / sizeof(golden[0]) && strcmp(golden[i].name, name) != 0) {
+        i++;
+    }
+    HOST_TEST_CHECK(i < sizeof(golden) / sizeof(golden[0]), "no hashes for %s", name);
+    for (jpg_scale_t scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        full_decode_t d = { .jpg = NULL };
+        HOST_TEST_CHECK(esp_jpg_decode_mem(jpg, len, scale, full_write, &d) == ESP_OK, "%s at scale %d", name, scale);
+        uint32_t hash = fnv1a(d.rgb, d.width * d.height * 3);
+        HOST_TEST_CHECK(hash == golden[i].hash[scale], "%s at scale %d: 0x%08x", name, scale, hash);
+        free(d.rgb);
+    }
+}
+
+static void test_golden(void)
+{
+    for_each_picture(check_golden);
+}
+
+// flipped bits and bytes in the entropy coded data, restart markers included, must end in an error or some picture, never outside the buffers
+static void test_corrupt(void)
+{
+    size_t len;
+    uint8_t *jpg = make_jpeg(160, 120, 3, &len);
+    uint8_t *bad = (uint8_t *)malloc(len);
+    size_t scan = 2;
+    while (scan + 4 < len && jpg[scan + 1] != 0xda) {
+        scan += 2 + ((jpg[scan + 2] << 8) | jpg[scan + 3]);
+    }
+    scan += 2 + ((jpg[scan + 2] << 8) | jpg[scan + 3]);
+    HOST_TEST_CHECK(scan < len, "no SOS");
+    uint32_t seed = 1;
+    int failed = 0;
+    for (int i = 0; i < 2000; i++) {
+        memcpy(bad, jpg, len);
+        for (int n = 0; n <= i % 4; n++) {
+            seed = seed * 1103515245 + 12345;
+            size_t at = scan + (seed >> 8) % (len - scan);
+            seed = seed * 1103515245 + 12345;
+            if (seed & 0x80000000) {
+                bad[at] ^= 1 << ((seed >> 16) & 7);
+            } else {
+                bad[at] = seed >> 16;
+            }
+        }
+        full_decode_t d = { .jpg = bad };
+        esp_err_t err = i & 1 ? esp_jpg_decode_mem(bad, len, (jpg_scale_t)(i % 4), full_write, &d)
+                        : esp_jpg_decode(len, (jpg_scale_t)(i % 4), full_read, full_write, &d);
+        HOST_TEST_CHECK(err == ESP_OK || err == ESP_FAIL, "mutation %d: %d", i, err);
+        failed += err != ESP_OK;
+        free(d.rgb);
+    }
+    printf("%d of 2000 corrupted JPEGs failed to decode\n", failed);
+    free(bad);
+    free(jpg);
+}
+
+int main(void)
+{
+    HOST_TEST_RUN(test_scaled);
+    HOST_TEST_RUN(test_roi);
+    HOST_TEST_RUN(test_pool_size);
+    HOST_TEST_RUN(test_concurrent);
+    HOST_TEST_RUN(test_mem);
+    HOST_TEST_RUN(test_golden);
+    HOST_TEST_RUN(test_formats);
+    HOST_TEST_RUN(test_stream);
+    HOST_TEST_RUN(test_corrupt);
+    return 0;
+}
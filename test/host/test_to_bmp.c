@@ -0,0 +1,161 @@
+// Checks the batched raw format kernels of fmt2rgb888 and fmt2bmp against the per pixel loops, for every input value
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "img_converters.h"
+#include "yuv.h"
+
+#define BMP_HEADER_LEN 54
+
+// the loops fmt2rgb888 had before, they write B, G, R
+static void reference_rgb565(const uint8_t *src, uint8_t *rgb, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++) {
+        uint8_t hb = *src++;
+        uint8_t lb = *src++;
+        *rgb++ = (lb & 0x1F) << 3;
+        *rgb++ = (hb & 0x07) << 5 | (lb & 0xE0) >> 3;
+        *rgb++ = hb & 0xF8;
+    }
+}
+
+static void reference_grayscale(const uint8_t *src, uint8_t *rgb, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++) {
+        memset(rgb, *src++, 3);
+        rgb += 3;
+    }
+}
+
+static void reference_yuv422(const uint8_t *src, uint8_t *rgb, size_t pixels)
+{
+    for (size_t i = 0; i < pixels / 2; i++, src += 4) {
+        uint8_t r, g, b;
+        yuv2rgb(src[0], src[1], src[3], &r, &g, &b);
+        *rgb++ = b;
+        *rgb++ = g;
+        *rgb++ = r;
+        yuv2rgb(src[2], src[1], src[3], &r, &g, &b);
+        *rgb++ = b;
+        *rgb++ = g;
+        *rgb++ = r;
+    }
+}
+
+typedef void (*reference_fn_t)(const uint8_t *src, uint8_t *rgb, size_t pixels);
+
+// converts with fmt2rgb888 from an odd address, in steps too short for the vector loop and with fmt2bmp,
+// all of them have to match the reference
+static void check_all(const uint8_t *src, size_t pixels, int width, pixformat_t format, size_t bytes_per_pixel, reference_fn_t reference)
+{
+    size_t src_len = pixels * bytes_per_pixel;
+    uint8_t *unaligned = (uint8_t *)malloc(src_len + 1);
+    memcpy(unaligned + 1, src, src_len);
+    uint8_t *expected = (uint8_t *)malloc(pixels * 3);
+    uint8_t *rgb = (uint8_t *)malloc(pixels * 3 + 1);
+    reference(src, expected, pixels);
+
+    HOST_TEST_CHECK(fmt2rgb888(unaligned + 1, src_len, format, rgb + 1), "fmt2rgb888");
+    for (size_t i = 0; i < pixels * 3; i++) {
+        HOST_TEST_CHECK(rgb[i + 1] == expected[i], "format %d, pixel %zu byte %zu: %d, expected %d",
+                        format, i / 3, i % 3, rgb[i + 1], expected[i]);
+    }
+
+    // 4 pixels take the 32-bit loop, 2 the last pair or pixels
+    for (size_t step = 4; step >= 2; step -= 2) {
+        memset(rgb, 0, pixels * 3);
+        for (size_t i = 0; i < pixels; i += step) {
+            fmt2rgb888(src + i * bytes_per_pixel, step * bytes_per_pixel, format, rgb + i * 3);
+        }
+        HOST_TEST_CHECK(memcmp(rgb, expected, pixels * 3) == 0, "format %d in steps of %zu differs", format, step);
+    }
+
+    uint8_t *bmp = NULL;
+    size_t bmp_len = 0;
+    HOST_TEST_CHECK(fmt2bmp((uint8_t *)src, src_len, width, pixels / width, format, &bmp, &bmp_len), "fmt2bmp");
+    HOST_TEST_CHECK(bmp_len == BMP_HEADER_LEN + pixels * 3, "%zu bytes", bmp_len);
+    HOST_TEST_CHECK(memcmp(bmp + BMP_HEADER_LEN, expected, pixels * 3) == 0, "fmt2bmp format %d differs", format);
+    free(bmp);
+    free(rgb);
+    free(expected);
+    free(unaligned);
+}
+
+static void test_rgb565(void)
+{
+    uint8_t *src = (uint8_t *)malloc(65536 * 2);
+    for (size_t i = 0; i < 65536; i++) {
+        src[i * 2] = i >> 8;
+        src[i * 2 + 1] = i & 0xFF;
+    }
+    check_all(src, 65536, 256, PIXFORMAT_RGB565, 2, reference_rgb565);
+    free(src);
+}
+
+static void test_grayscale(void)
+{
+    uint8_t src[256];
+    for (size_t i = 0; i < 256; i++) {
+        src[i] = i;
+    }
+    check_all(src, 256, 16, PIXFORMAT_GRAYSCALE, 1, reference_grayscale);
+}
+
+// every Y with every U and V, one U per image of 256 x 256 pixels
+static void test_yuv422(void)
+{
+    uint8_t *src = (uint8_t *)malloc(65536 * 2);
+    for (int u = 0; u < 256; u++) {
+        uint8_t *s = src;
+        for (int v = 0; v < 256; v++) {
+            for (int y = 0; y < 256; y += 2, s += 4) {
+                s[0] = y;
+                s[1] = u;
+                s[2] = y + 1;
+                s[3] = v;
+            }
+        }
+        check_all(src, 65536, 256, PIXFORMAT_YUV422, 2, reference_yuv422);
+    }
+    free(src);
+}
+
+// the lengths that leave a tail after the 8 and 4 pixel steps, nothing past the end is written
+static void test_tails(void)
+{
+    const struct {
+        pixformat_t format;
+        size_t bytes_per_pixel;
+        reference_fn_t reference;
+    } formats[] = {
+        { PIXFORMAT_RGB565, 2, reference_rgb565 },
+        { PIXFORMAT_GRAYSCALE, 1, reference_grayscale },
+        { PIXFORMAT_YUV422, 2, reference_yuv422 },
+    };
+    uint8_t src[40];
+    uint8_t expected[60];
+    uint8_t rgb[61];
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = i * 37 + 11;
+    }
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (size_t pixels = 1; pixels <= 20; pixels++) {
+            memset(expected, 0xa5, sizeof(expected));
+            memset(rgb, 0xa5, sizeof(rgb));
+            formats[f].reference(src, expected, pixels);
+            HOST_TEST_CHECK(fmt2rgb888(src, pixels * formats[f].bytes_per_pixel, formats[f].format, rgb), "fmt2rgb888");
+            HOST_TEST_CHECK(memcmp(rgb, expected, sizeof(expected)) == 0 && rgb[60] == 0xa5,
+                            "format %d, %zu pixels", formats[f].format, pixels);
+        }
+    }
+}
+
+int main(void)
+{
+    HOST_TEST_RUN(test_rgb565);
+    HOST_TEST_RUN(test_grayscale);
+    HOST_TEST_RUN(test_yuv422);
+    HOST_TEST_RUN(test_tails);
+    return 0;
+}
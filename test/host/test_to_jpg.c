@@ -0,0 +1,452 @@
+// Encodes with fmt2jpg and decodes the result, the quality is measured as PSNR against the source
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "img_converters.h"
+#include "sdkconfig.h"
+
+#define TEST_QUALITY 80
+
+static double psnr(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    double se = 0;
+    for (size_t i = 0; i < len; i++) {
+        double d = (double)a[i] - b[i];
+        se += d * d;
+    }
+    return se ? 10 * log10(255.0 * 255.0 * len / se) : 99.0;
+}
+
+// encodes src and decodes it back to BGR888
+static uint8_t *round_trip(const uint8_t *src, size_t len, int width, int height, pixformat_t format)
+{
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    HOST_TEST_CHECK(fmt2jpg((uint8_t *)src, len, width, height, format, TEST_QUALITY, &jpg, &jpg_len), "fmt2jpg format %d", format);
+    uint8_t *bgr = (uint8_t *)malloc(width * height * 3);
+    HOST_TEST_CHECK(fmt2rgb888(jpg, jpg_len, PIXFORMAT_JPEG, bgr), "decode format %d", format);
+    free(jpg);
+    return bgr;
+}
+
+static uint8_t limit(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// BT.601 limited range, what the sensors send
+static void bgr_to_yuyv(const uint8_t *bgr, uint8_t *yuyv, int pixels)
+{
+    for (int i = 0; i < pixels; i += 2, bgr += 6, yuyv += 4) {
+        int r = (bgr[2] + bgr[5]) / 2, g = (bgr[1] + bgr[4]) / 2, b = (bgr[0] + bgr[3]) / 2;
+        yuyv[0] = limit(16 + ((66 * bgr[2] + 129 * bgr[1] + 25 * bgr[0] + 128) >> 8));
+        yuyv[1] = limit(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+        yuyv[2] = limit(16 + ((66 * bgr[5] + 129 * bgr[4] + 25 * bgr[3] + 128) >> 8));
+        yuyv[3] = limit(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+    }
+}
+
+static uint8_t *picture;
+static int width = 320;
+static int height = 240;
+
+static void test_yuv422(void)
+{
+    size_t pixels = width * height;
+    uint8_t *yuyv = (uint8_t *)malloc(pixels * 2);
+    bgr_to_yuyv(picture, yuyv, pixels);
+    uint8_t *bgr = (uint8_t *)malloc(pixels * 3);
+    HOST_TEST_CHECK(fmt2rgb888(yuyv, pixels * 2, PIXFORMAT_YUV422, bgr), "fmt2rgb888");
+
+    // what YUV422 went through before, RGB888 input subsampled H2V2
+    uint8_t *via_rgb = round_trip(bgr, pixels * 3, width, height, PIXFORMAT_RGB888);
+    uint8_t *direct = round_trip(yuyv, pixels * 2, width, height, PIXFORMAT_YUV422);
+    double psnr_rgb = psnr(bgr, via_rgb, pixels * 3);
+    double psnr_direct = psnr(bgr, direct, pixels * 3);
+    printf("YUV422 PSNR: %.2f dB direct, %.2f dB through RGB\n", psnr_direct, psnr_rgb);
+    HOST_TEST_CHECK(psnr_direct >= 30.0, "direct %.2f dB", psnr_direct);
+    // both round the samples once more than the other in places, they should be about even
+    HOST_TEST_CHECK(psnr_direct >= psnr_rgb - 1.0, "direct %.2f dB, through RGB %.2f dB", psnr_direct, psnr_rgb);
+
+    free(direct);
+    free(via_rgb);
+    free(bgr);
+    free(yuyv);
+}
+
+// guards the accuracy of the fixed point DCT and quantisation
+static void test_rgb888(void)
+{
+    size_t pixels = width * height;
+    uint8_t *bgr = round_trip(picture, pixels * 3, width, height, PIXFORMAT_RGB888);
+    double p = psnr(picture, bgr, pixels * 3);
+    printf("RGB888 PSNR: %.2f dB\n", p);
+    HOST_TEST_CHECK(p >= 36.0, "%.2f dB", p);
+    free(bgr);
+
+    // full scale edges are the largest DCT coefficients, they must not overflow
+    uint8_t *edges = (uint8_t *)malloc(pixels * 3);
+    for (size_t i = 0; i < pixels; i++) {
+        memset(edges + i * 3, ((i % width) ^ (i / width)) & 1 ? 255 : 0, 3);
+    }
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    HOST_TEST_CHECK(fmt2jpg(edges, pixels * 3, width, height, PIXFORMAT_RGB888, 100, &jpg, &jpg_len), "fmt2jpg");
+    bgr = (uint8_t *)malloc(pixels * 3);
+    HOST_TEST_CHECK(fmt2rgb888(jpg, jpg_len, PIXFORMAT_JPEG, bgr), "decode");
+    p = psnr(edges, bgr, pixels * 3);
+    HOST_TEST_CHECK(p >= 30.0, "checkerboard %.2f dB", p);
+    free(bgr);
+    free(jpg);
+    free(edges);
+}
+
+// the caller buffer gets the same bytes or the exact size needed, fmt2jpg grows past any fixed size
+static void test_output_buffers(void)
+{
+    size_t pixels = width * height;
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    HOST_TEST_CHECK(fmt2jpg(picture, pixels * 3, width, height, PIXFORMAT_RGB888, TEST_QUALITY, &jpg, &jpg_len), "fmt2jpg");
+
+    uint8_t *buf = (uint8_t *)malloc(jpg_len + 1);
+    size_t buf_len = 0;
+    HOST_TEST_CHECK(!fmt2jpg_buf(picture, pixels * 3, width, height, PIXFORMAT_RGB888, TEST_QUALITY, buf, jpg_len / 2, &buf_len), "half size fits");
+    HOST_TEST_CHECK(buf_len == jpg_len, "needs %zu, expected %zu", buf_len, jpg_len);
+    buf[jpg_len] = 0xa5;
+    HOST_TEST_CHECK(fmt2jpg_buf(picture, pixels * 3, width, height, PIXFORMAT_RGB888, TEST_QUALITY, buf, jpg_len, &buf_len), "exact size");
+    HOST_TEST_CHECK(buf_len == jpg_len && memcmp(buf, jpg, jpg_len) == 0 && buf[jpg_len] == 0xa5, "output differs");
+    free(buf);
+    free(jpg);
+
+    // noise at full quality is far larger than the initial estimate and the old 128 KB
+    int big_width = 640, big_height = 480;
+    size_t big_len = big_width * big_height * 3;
+    uint8_t *noise = (uint8_t *)malloc(big_len);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < big_len; i++) {
+        seed = seed * 1103515245 + 12345;
+        noise[i] = seed >> 24;
+    }
+    HOST_TEST_CHECK(fmt2jpg(noise, big_len, big_width, big_height, PIXFORMAT_RGB888, 100, &jpg, &jpg_len), "fmt2jpg noise");
+    HOST_TEST_CHECK(jpg_len > 128 * 1024, "%zu bytes", jpg_len);
+    HOST_TEST_CHECK(jpg[jpg_len - 2] == 0xff && jpg[jpg_len - 1] == 0xd9, "no EOI");
+    free(jpg);
+    free(noise);
+}
+
+typedef struct {
+    uint8_t quality;
+    const uint8_t *expected;
+    size_t expected_len;
+    bool ok;
+} encoder_thread_t;
+
+static void *encoder_thread(void *arg)
+{
+    encoder_thread_t *t = (encoder_thread_t *)arg;
+    size_t pixels = width * height;
+    jpg_encoder_ctx_t ctx = jpg_encoder_create(width, height, PIXFORMAT_RGB888, t->quality);
+    uint8_t *buf = (uint8_t *)malloc(t->expected_len);
+    t->ok = ctx != NULL;
+    for (int i = 0; i < 20 && t->ok; i++) {
+        size_t len = 0;
+        t->ok = jpg_encoder_encode_buf(ctx, picture, pixels * 3, buf, t->expected_len, &len)
+                && len == t->expected_len && memcmp(buf, t->expected, len) == 0;
+    }
+    free(buf);
+    jpg_encoder_delete(ctx);
+    return NULL;
+}
+
+// contexts at different qualities encode in parallel, every frame matching fmt2jpg
+static void test_encoder_ctx(void)
+{
+    size_t pixels = width * height;
+    encoder_thread_t threads[2] = { { .quality = 30 }, { .quality = 90 } };
+    pthread_t ids[2];
+    for (int i = 0; i < 2; i++) {
+        uint8_t *jpg = NULL;
+        HOST_TEST_CHECK(fmt2jpg(picture, pixels * 3, width, height, PIXFORMAT_RGB888, threads[i].quality, &jpg, &threads[i].expected_len), "fmt2jpg");
+        threads[i].expected = jpg;
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&ids[i], NULL, encoder_thread, &threads[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(ids[i], NULL);
+        HOST_TEST_CHECK(threads[i].ok, "quality %d", threads[i].quality);
+        free((void *)threads[i].expected);
+    }
+
+    HOST_TEST_CHECK(jpg_encoder_create(width, height, PIXFORMAT_JPEG, 80) == NULL, "JPEG source");
+    jpg_encoder_ctx_t ctx = jpg_encoder_create(width, height, PIXFORMAT_RGB565, 80);
+    uint8_t out[64];
+    size_t out_len = 0;
+    HOST_TEST_CHECK(!jpg_encoder_encode_buf(ctx, picture, pixels, out, sizeof(out), &out_len), "short source");
+    jpg_encoder_delete(ctx);
+}
+
+static uint8_t *encode_with(jpg_encoder_ctx_t ctx, const uint8_t *src, size_t src_len, size_t *jpg_len)
+{
+    size_t size = src_len + 1024;
+    uint8_t *jpg = (uint8_t *)malloc(size);
+    HOST_TEST_CHECK(ctx != NULL, "no encoder");
+    HOST_TEST_CHECK(jpg_encoder_encode_buf(ctx, src, src_len, jpg, size, jpg_len), "encode");
+    return jpg;
+}
+
+// the strips only restart the DC prediction, tjpgd has to decode the same pixels as from one strip
+static void test_parallel(void)
+{
+    // 232 lines leave a partial MCU row at the end
+    int lines = 232;
+    size_t pixels = width * lines;
+    uint8_t *yuyv = (uint8_t *)malloc(pixels * 2);
+    bgr_to_yuyv(picture, yuyv, pixels);
+    const struct {
+        pixformat_t format;
+        const uint8_t *src;
+        size_t len;
+    } sources[] = {
+        { PIXFORMAT_RGB888, picture, pixels * 3 },
+        { PIXFORMAT_YUV422, yuyv, pixels * 2 },
+    };
+    uint8_t *serial_bgr = (uint8_t *)malloc(pixels * 3);
+    uint8_t *bgr = (uint8_t *)malloc(pixels * 3);
+
+    for (size_t f = 0; f < sizeof(sources) / sizeof(sources[0]); f++) {
+        jpg_encoder_ctx_t ctx = jpg_encoder_create(width, lines, sources[f].format, TEST_QUALITY);
+        size_t jpg_len = 0;
+        uint8_t *jpg = encode_with(ctx, sources[f].src, sources[f].len, &jpg_len);
+        HOST_TEST_CHECK(fmt2rgb888(jpg, jpg_len, PIXFORMAT_JPEG, serial_bgr), "decode serial");
+        free(jpg);
+        jpg_encoder_delete(ctx);
+
+        for (int strips = 2; strips <= 4; strips++) {
+            ctx = jpg_encoder_create_parallel(width, lines, sources[f].format, TEST_QUALITY, strips);
+            // the second frame reuses the strip buffers
+            for (int frame = 0; frame < 2; frame++) {
+                jpg = encode_with(ctx, sources[f].src, sources[f].len, &jpg_len);
+                memset(bgr, 0, pixels * 3);
+                HOST_TEST_CHECK(fmt2rgb888(jpg, jpg_len, PIXFORMAT_JPEG, bgr), "decode format %d, %d strips", sources[f].format, strips);
+                HOST_TEST_CHECK(memcmp(bgr, serial_bgr, pixels * 3) == 0, "format %d, %d strips differ", sources[f].format, strips);
+                HOST_TEST_CHECK(jpg[jpg_len - 2] == 0xff && jpg[jpg_len - 1] == 0xd9, "no EOI");
+                free(jpg);
+            }
+            jpg_encoder_delete(ctx);
+        }
+    }
+
+    free(bgr);
+    free(serial_bgr);
+    free(yuyv);
+}
+
+// tjpgd only decodes YCbCr, check that a single component image comes out
+static void test_grayscale(void)
+{
+    size_t pixels = width * height;
+    uint8_t *gray = (uint8_t *)malloc(pixels);
+    for (size_t i = 0; i < pixels; i++) {
+        gray[i] = (picture[i * 3] * 29 + picture[i * 3 + 1] * 150 + picture[i * 3 + 2] * 77) >> 8;
+    }
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    HOST_TEST_CHECK(fmt2jpg(gray, pixels, width, height, PIXFORMAT_GRAYSCALE, TEST_QUALITY, &jpg, &jpg_len), "fmt2jpg");
+    HOST_TEST_CHECK(jpg[0] == 0xff && jpg[1] == 0xd8 && jpg[jpg_len - 2] == 0xff && jpg[jpg_len - 1] == 0xd9, "SOI/EOI");
+    size_t i = 2;
+    while (i + 9 < jpg_len && jpg[i] == 0xff && jpg[i + 1] != 0xc0) {
+        i += 2 + ((jpg[i + 2] << 8) | jpg[i + 3]);
+    }
+    HOST_TEST_CHECK(i + 9 < jpg_len && jpg[i + 1] == 0xc0, "no SOF0");
+    HOST_TEST_CHECK(((jpg[i + 5] << 8) | jpg[i + 6]) == height && ((jpg[i + 7] << 8) | jpg[i + 8]) == width, "size");
+    HOST_TEST_CHECK(jpg[i + 9] == 1, "%d components", jpg[i + 9]);
+    free(jpg);
+    free(gray);
+}
+
+typedef struct {
+    size_t chunks;
+    size_t short_chunks;//shorter than the flush size, only the last one may be
+    size_t len;
+} chunk_stats_t;
+
+static size_t count_chunk(void *arg, size_t index, const void *data, size_t len)
+{
+    chunk_stats_t *stats = (chunk_stats_t *)arg;
+    if (!len) {
+        return 0;
+    }
+    stats->chunks++;
+    stats->short_chunks += len != CONFIG_CAMERA_JPG_CB_FLUSH_SIZE;
+    stats->len += len;
+    return len;
+}
+
+// the callback gets the configured chunk size, the shim sets it to a value other than the default
+static void test_flush_size(void)
+{
+    size_t pixels = width * height;
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    HOST_TEST_CHECK(fmt2jpg(picture, pixels * 3, width, height, PIXFORMAT_RGB888, TEST_QUALITY, &jpg, &jpg_len), "fmt2jpg");
+    free(jpg);
+
+    chunk_stats_t stats = { 0 };
+    HOST_TEST_CHECK(fmt2jpg_cb(picture, pixels * 3, width, height, PIXFORMAT_RGB888, TEST_QUALITY, count_chunk, &stats), "fmt2jpg_cb");
+    HOST_TEST_CHECK(stats.len == jpg_len, "%zu bytes, expected %zu", stats.len, jpg_len);
+    HOST_TEST_CHECK(stats.chunks == (jpg_len + CONFIG_CAMERA_JPG_CB_FLUSH_SIZE - 1) / CONFIG_CAMERA_JPG_CB_FLUSH_SIZE, "%zu chunks", stats.chunks);
+    HOST_TEST_CHECK(stats.short_chunks <= 1, "%zu short chunks", stats.short_chunks);
+}
+
+// RGB888 frames are B, G, R and the encoder reads them in place, the colours must not swap
+static void test_bgr_order(void)
+{
+    static const uint8_t colours[3][3] = { { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 } };
+    int w = 48, h = 16;
+    size_t pixels = w * h;
+    uint8_t *src = (uint8_t *)malloc(pixels * 3);
+    for (size_t i = 0; i < pixels; i++) {
+        memcpy(src + i * 3, colours[(i % w) / 16], 3);
+    }
+    uint8_t *bgr = round_trip(src, pixels * 3, w, h, PIXFORMAT_RGB888);
+    for (int c = 0; c < 3; c++) {
+        const uint8_t *p = bgr + ((h / 2) * w + c * 16 + 8) * 3;
+        HOST_TEST_CHECK(p[c] > 200 && p[(c + 1) % 3] < 50 && p[(c + 2) % 3] < 50, "stripe %d is %d %d %d", c, p[0], p[1], p[2]);
+    }
+    free(bgr);
+    free(src);
+}
+
+// RGB565 as the sensors send it, big endian
+static void bgr_to_rgb565(const uint8_t *bgr, uint8_t *rgb565, int pixels)
+{
+    for (int i = 0; i < pixels; i++, bgr += 3, rgb565 += 2) {
+        uint16_t v = ((bgr[2] >> 3) << 11) | ((bgr[1] >> 2) << 5) | (bgr[0] >> 3);
+        rgb565[0] = v >> 8;
+        rgb565[1] = v & 0xff;
+    }
+}
+
+// RGB565 is unpacked by the encoder, it has to encode to the same bytes as the RGB888 frame it widens to
+static void test_rgb565(void)
+{
+    size_t pixels = width * height;
+    uint8_t *rgb565 = (uint8_t *)malloc(pixels * 2);
+    bgr_to_rgb565(picture, rgb565, pixels);
+    uint8_t *bgr = (uint8_t *)malloc(pixels * 3);
+    for (size_t i = 0; i < pixels; i++) {
+        bgr[i * 3 + 2] = rgb565[i * 2] & 0xf8;
+        bgr[i * 3 + 1] = ((rgb565[i * 2] & 0x07) << 5) | ((rgb565[i * 2 + 1] & 0xe0) >> 3);
+        bgr[i * 3] = (rgb565[i * 2 + 1] & 0x1f) << 3;
+    }
+    uint8_t *jpg = NULL, *expected = NULL;
+    size_t jpg_len = 0, expected_len = 0;
+    HOST_TEST_CHECK(fmt2jpg(rgb565, pixels * 2, width, height, PIXFORMAT_RGB565, TEST_QUALITY, &jpg, &jpg_len), "fmt2jpg RGB565");
+    HOST_TEST_CHECK(fmt2jpg(bgr, pixels * 3, width, height, PIXFORMAT_RGB888, TEST_QUALITY, &expected, &expected_len), "fmt2jpg RGB888");
+    HOST_TEST_CHECK(jpg_len == expected_len && memcmp(jpg, expected, jpg_len) == 0, "RGB565 and RGB888 differ");
+    free(expected);
+    free(jpg);
+    free(bgr);
+    free(rgb565);
+}
+
+// copies a w x h frame into a padded_w x padded_h one, repeating the last pixel of each line and the last line
+static uint8_t *pad_frame(const uint8_t *src, int w, int h, int padded_w, int padded_h, pixformat_t format)
+{
+    int bpp = format == PIXFORMAT_RGB888 ? 3 : 2;
+    uint8_t *dst = (uint8_t *)malloc(padded_w * padded_h * bpp);
+    for (int y = 0; y < padded_h; y++) {
+        const uint8_t *line = src + (y < h ? y : h - 1) * w * bpp;
+        uint8_t *out = dst + y * padded_w * bpp;
+        memcpy(out, line, w * bpp);
+        for (int x = w; x < padded_w; x++) {
+            if (format == PIXFORMAT_YUV422) {
+                //the pair of the last pixel, with its luma for both
+                memcpy(out + x * 2, line + (w - 2) * 2, 4);
+                out[x * 2] = out[x * 2 + 2];
+                x++;
+            } else {
+                memcpy(out + x * bpp, line + (w - 1) * bpp, bpp);
+            }
+        }
+    }
+    return dst;
+}
+
+// sizes that are not whole MCUs: the encoder pads every component plane with the last pixel,
+// so the picture has to decode exactly like one padded beforehand to whole MCUs
+static void test_partial_mcus(void)
+{
+    static const int sizes[][2] = { { 37, 21 }, { 38, 9 }, { 17, 30 } };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int w = sizes[s][0], h = sizes[s][1];
+        int padded_w = (w + 15) & ~15, padded_h = (h + 15) & ~15;
+        size_t pixels = w * h;
+        uint8_t *crop = (uint8_t *)malloc(pixels * 3);
+        for (int y = 0; y < h; y++) {
+            memcpy(crop + y * w * 3, picture + ((y + 100) * width + 100) * 3, w * 3);
+            // the chroma of a pixel pair is repeated in the padding, not that of the last pixel alone
+            if ((w & 1) == 0) {
+                memcpy(crop + (y * w + w - 2) * 3, crop + (y * w + w - 1) * 3, 3);
+            }
+        }
+        uint8_t *rgb565 = (uint8_t *)malloc(pixels * 2);
+        bgr_to_rgb565(crop, rgb565, pixels);
+        uint8_t *yuyv = (uint8_t *)malloc(pixels * 2);
+        bgr_to_yuyv(crop, yuyv, pixels);
+        const struct {
+            pixformat_t format;
+            const uint8_t *src;
+        } sources[] = {
+            { PIXFORMAT_RGB888, crop },
+            { PIXFORMAT_RGB565, rgb565 },
+            { PIXFORMAT_YUV422, yuyv },
+        };
+        for (size_t f = 0; f < sizeof(sources) / sizeof(sources[0]); f++) {
+            // YUYV has even widths only
+            if (sources[f].format == PIXFORMAT_YUV422 && (w & 1)) {
+                continue;
+            }
+            size_t bpp = sources[f].format == PIXFORMAT_RGB888 ? 3 : 2;
+            uint8_t *padded = pad_frame(sources[f].src, w, h, padded_w, padded_h, sources[f].format);
+            uint8_t *bgr = round_trip(sources[f].src, pixels * bpp, w, h, sources[f].format);
+            uint8_t *padded_bgr = round_trip(padded, padded_w * padded_h * bpp, padded_w, padded_h, sources[f].format);
+            for (int y = 0; y < h; y++) {
+                HOST_TEST_CHECK(memcmp(bgr + y * w * 3, padded_bgr + y * padded_w * 3, w * 3) == 0, "format %d %dx%d line %d", sources[f].format, w, h, y);
+            }
+            free(padded_bgr);
+            free(bgr);
+            free(padded);
+        }
+        free(yuyv);
+        free(rgb565);
+        free(crop);
+    }
+}
+
+int main(void)
+{
+    size_t len;
+    uint8_t *jpg = host_test_load_file(CAMERA_TEST_PICTURES "/test_inside.jpeg", &len);
+    picture = (uint8_t *)malloc(width * height * 3);
+    HOST_TEST_CHECK(fmt2rgb888(jpg, len, PIXFORMAT_JPEG, picture), "decode test picture");
+    free(jpg);
+
+    HOST_TEST_RUN(test_rgb888);
+    HOST_TEST_RUN(test_output_buffers);
+    HOST_TEST_RUN(test_flush_size);
+    HOST_TEST_RUN(test_encoder_ctx);
+    HOST_TEST_RUN(test_parallel);
+    HOST_TEST_RUN(test_yuv422);
+    HOST_TEST_RUN(test_grayscale);
+    HOST_TEST_RUN(test_bgr_order);
+    HOST_TEST_RUN(test_rgb565);
+    HOST_TEST_RUN(test_partial_mcus);
+    free(picture);
+    return 0;
+}
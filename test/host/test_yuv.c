@@ -0,0 +1,76 @@
+// Checks the fixed point yuv2rgb and yuv422_to_rgb888_row against the lookup table they replaced, for every Y, U and V
+#include <stdint.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "yuv.h"
+
+// the table held BT.601 terms truncated toward zero
+static int16_t table_y[256], table_vr[256], table_vg[256], table_ug[256], table_ub[256];
+
+static void make_table(void)
+{
+    for (int i = 0; i < 256; i++) {
+        table_y[i] = (int)(1.164 * (i - 16));
+        table_vr[i] = (int)(1.596 * (i - 128));
+        table_vg[i] = (int)(-0.391 * (i - 128));
+        table_ug[i] = (int)(-0.813 * (i - 128));
+        table_ub[i] = (int)(2.018 * (i - 128));
+    }
+    // a few rows as they were in yuv.c
+    HOST_TEST_CHECK(table_y[0] == -18 && table_vr[0] == -204 && table_vg[0] == 50 && table_ug[0] == 104 && table_ub[0] == -258, "row 0");
+    HOST_TEST_CHECK(table_y[128] == 130 && table_vr[128] == 0 && table_ub[128] == 0, "row 128");
+    HOST_TEST_CHECK(table_y[255] == 278 && table_vr[255] == 202 && table_vg[255] == -49 && table_ug[255] == -103 && table_ub[255] == 256, "row 255");
+}
+
+static void table_yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    *r = yuv_clamp(table_y[y] + table_vr[v]);
+    *g = yuv_clamp(table_y[y] + table_ug[u] + table_vg[v]);
+    *b = yuv_clamp(table_y[y] + table_ub[u]);
+}
+
+static void test_yuv2rgb(void)
+{
+    for (int y = 0; y < 256; y++) {
+        for (int u = 0; u < 256; u++) {
+            for (int v = 0; v < 256; v++) {
+                uint8_t r, g, b, tr, tg, tb;
+                yuv2rgb(y, u, v, &r, &g, &b);
+                table_yuv2rgb(y, u, v, &tr, &tg, &tb);
+                HOST_TEST_CHECK(r == tr && g == tg && b == tb, "YUV %d %d %d: %d %d %d, expected %d %d %d", y, u, v, r, g, b, tr, tg, tb);
+            }
+        }
+    }
+}
+
+// one row per U and V with every Y, plus an odd pixel at the end that is left alone
+static void test_row(void)
+{
+    uint8_t src[516], dst[771];
+    for (int u = 0; u < 256; u++) {
+        for (int v = 0; v < 256; v++) {
+            for (int y = 0; y < 258; y += 2) {
+                src[y * 2] = y;
+                src[y * 2 + 1] = u;
+                src[y * 2 + 2] = y + 1;
+                src[y * 2 + 3] = v;
+            }
+            dst[768] = dst[769] = dst[770] = 0xa5;
+            yuv422_to_rgb888_row(src, dst, 257);
+            for (int x = 0; x < 256; x++) {
+                uint8_t r, g, b;
+                table_yuv2rgb(x, u, v, &r, &g, &b);
+                HOST_TEST_CHECK(dst[x * 3] == b && dst[x * 3 + 1] == g && dst[x * 3 + 2] == r, "U %d V %d, pixel %d", u, v, x);
+            }
+            HOST_TEST_CHECK(dst[768] == 0xa5 && dst[769] == 0xa5 && dst[770] == 0xa5, "odd pixel written");
+        }
+    }
+}
+
+int main(void)
+{
+    make_table();
+    HOST_TEST_RUN(test_yuv2rgb);
+    HOST_TEST_RUN(test_row);
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Times the YUV to RGB conversion on the host and prints the results as JSON, one case per line:
+//   yuv_bench [iterations] [width] [height]
+// yuv2rgb_table is the lookup table yuv2rgb used before, yuv2rgb the fixed point one called per
+// pixel and yuv422_to_rgb888_row the pair-wise row, all of them on the same synthetic YUV422 frame.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "yuv.h"
+
+static int16_t table_y[256], table_vr[256], table_vg[256], table_ug[256], table_ub[256];
+
+static void make_table(void)
+{
+    for (int i = 0; i < 256; i++) {
+        table_y[i] = (int)(1.164 * (i - 16));
+        table_vr[i] = (int)(1.596 * (i - 128));
+        table_vg[i] = (int)(-0.391 * (i - 128));
+        table_ug[i] = (int)(-0.813 * (i - 128));
+        table_ub[i] = (int)(2.018 * (i - 128));
+    }
+}
+
+// out of line like the table version was, in another translation unit
+__attribute__((noinline)) static void table_yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    *r = yuv_clamp(table_y[y] + table_vr[v]);
+    *g = yuv_clamp(table_y[y] + table_ug[u] + table_vg[v]);
+    *b = yuv_clamp(table_y[y] + table_ub[u]);
+}
+
+typedef void (*pair_fn_t)(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b);
+
+static void convert_pairs(pair_fn_t fn, const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i += 2, src += 4) {
+        uint8_t r, g, b;
+        fn(src[0], src[1], src[3], &r, &g, &b);
+        *dst++ = b;
+        *dst++ = g;
+        *dst++ = r;
+        fn(src[2], src[1], src[3], &r, &g, &b);
+        *dst++ = b;
+        *dst++ = g;
+        *dst++ = r;
+    }
+}
+
+static void run_table(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    convert_pairs(table_yuv2rgb, src, dst, pixels);
+}
+
+static void run_yuv2rgb(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i += 2, src += 4) {
+        uint8_t r, g, b;
+        yuv2rgb(src[0], src[1], src[3], &r, &g, &b);
+        *dst++ = b;
+        *dst++ = g;
+        *dst++ = r;
+        yuv2rgb(src[2], src[1], src[3], &r, &g, &b);
+        *dst++ = b;
+        *dst++ = g;
+        *dst++ = r;
+    }
+}
+
+static void run_row(const uint8_t *src, uint8_t *dst, size_t pixels)
+{
+    yuv422_to_rgb888_row(src, dst, pixels);
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t d = *(const int64_t *)a - *(const int64_t *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+static void bench(const char *op, void (*fn)(const uint8_t *, uint8_t *, size_t), const uint8_t *src, uint8_t *dst,
+                  int width, int height, int iterations)
+{
+    size_t pixels = (size_t)width * height;
+    int64_t *times = (int64_t *)malloc(iterations * sizeof(int64_t));
+    for (int i = 0; i < iterations; i++) {
+        int64_t start = esp_timer_get_time();
+        fn(src, dst, pixels);
+        times[i] = esp_timer_get_time() - start;
+    }
+    qsort(times, iterations, sizeof(int64_t), compare_us);
+    int64_t p50 = times[iterations / 2];
+    printf("{\"op\": \"%s\", \"width\": %d, \"height\": %d, \"iterations\": %d, \"p50_us\": %lld, \"ns_per_pixel\": %.2f}\n",
+           op, width, height, iterations, (long long)p50, p50 * 1000.0 / pixels);
+    free(times);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 50;
+    int width = argc > 2 ? atoi(argv[2]) : 640;
+    int height = argc > 3 ? atoi(argv[3]) : 480;
+    if (iterations < 1 || width < 2 || width % 2 || height < 1) {
+        fprintf(stderr, "usage: %s [iterations] [width] [height]\n", argv[0]);
+        return 1;
+    }
+    make_table();
+
+    uint8_t *src = (uint8_t *)malloc((size_t)width * height * 2);
+    uint8_t *dst = (uint8_t *)malloc((size_t)width * height * 3);
+    uint8_t *s = src;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += 2) {
+            *s++ = (x + y) * 255 / (width + height);
+            *s++ = 128 + (x * 64 / width) - 32;
+            *s++ = (x + 1 + y) * 255 / (width + height);
+            *s++ = 128 + ((x ^ y) & 0x3f) - 32;
+        }
+    }
+    bench("yuv2rgb_table", run_table, src, dst, width, height, iterations);
+    bench("yuv2rgb", run_yuv2rgb, src, dst, width, height, iterations);
+    bench("yuv422_to_rgb888_row", run_row, src, dst, width, height, iterations);
+    free(dst);
+    free(src);
+    return 0;
+}
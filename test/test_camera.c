@@ -61,7 +61,7 @@ static const char *TAG = "test camera";
 
 typedef void (*decode_func_t)(uint8_t *jpegbuffer, uint32_t size, uint8_t *outbuffer);
 
-static esp_err_t init_camera(uint32_t xclk_freq_hz, pixformat_t pixel_format, uint8_t fb_count)
+static esp_err_t init_camera(uint32_t xclk_freq_hz, pixformat_t pixel_format, uint8_t fb_count, camera_dma_mode_t dma_mode)
 {
     camera_config_t camera_config = {
         .pin_pwdn = CAM_PIN_PWDN,
@@ -92,7 +92,8 @@ static esp_err_t init_camera(uint32_t xclk_freq_hz, pixformat_t pixel_format, ui
 
         .jpeg_quality = 12, //0-63 lower number means higher quality
         .fb_count = fb_count,       //if more than one, i2s runs in continuous mode. Use only with JPEG
-        .grab_mode = CAMERA_GRAB_WHEN_EMPTY
+        .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+        .dma_mode = dma_mode
     };
 
     //initialize the camera
@@ -148,6 +149,12 @@ static void camera_test(framesize_t max_size, uint32_t pic_num)
     for (size_t i = 0; i < max_size; i++) {
         printf("%4d x %4d , %5d, %5.2f  \n", resolution[i].width, resolution[i].height, size[i], fps[i]);
     }
+
+    camera_stats_t stats;
+    TEST_ESP_OK(esp_camera_get_stats(&stats));
+    printf("captured: %u, taken: %u, dropped: %u, no fb: %u, FB-OVF: %u, NO-SOI: %u, NO-EOI: %u, FB-SIZE: %u, EV-OVF: %u\n",
+           stats.frames_captured, stats.frames_taken, stats.frames_dropped, stats.no_free_fb, stats.fb_overflow,
+           stats.no_soi, stats.no_eoi, stats.size_mismatch, stats.event_overflow);
 }
 
 static camera_sensor_info_t *get_camera_info_from_pid(uint8_t pid)
@@ -311,18 +318,20 @@ static void img_jpeg_decode_test(uint16_t pic_index, uint16_t lib_index)
 
 TEST_CASE("Camera driver init, deinit test", "[camera]")
 {
-    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, 2));
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, 2, CAMERA_DMA_COPY));
     TEST_ESP_OK(esp_camera_deinit());
 }
 
 TEST_CASE("Camera driver take picture test", "[camera]")
 {
-    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, 2));
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, 2, CAMERA_DMA_COPY));
 
     ESP_LOGI(TAG, "Taking picture...");
     camera_fb_t *pic = esp_camera_fb_get();
     if (pic) {
         ESP_LOGI(TAG, "picrute: %d x %d, size: %u", pic->width, pic->height, pic->len);
+        ESP_LOGI(TAG, "dma: %u chunks in %lld us, queued for %u us", pic->meta.dma_chunks,
+                 pic->meta.last_dma_us - pic->meta.first_dma_us, pic->meta.queue_wait_us);
         esp_camera_fb_return(pic);
     }
 
@@ -333,7 +342,7 @@ TEST_CASE("Camera driver take picture test", "[camera]")
 TEST_CASE("Camera driver jpeg fps test", "[camera]")
 {
     uint64_t t1 = esp_timer_get_time();
-    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, 2));
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, 2, CAMERA_DMA_COPY));
     uint64_t t2 = esp_timer_get_time();
     ESP_LOGI(TAG, "Camera init time %llu ms", (t2 - t1) / 1000);
 
@@ -349,10 +358,26 @@ TEST_CASE("Camera driver jpeg fps test", "[camera]")
     esp_camera_deinit();
 }
 
+TEST_CASE("Camera driver zero-copy jpeg fps test", "[camera]")
+{
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, 2, CAMERA_DMA_ZERO_COPY));
+
+    sensor_t *s = esp_camera_sensor_get();
+    camera_sensor_info_t *info = get_camera_info_from_pid(s->id.PID);
+    framesize_t max_size = info->max_size;
+    int pic_num = 16;
+
+    ESP_LOGI(TAG, "max_framesize:%d", max_size);
+    ESP_LOGI(TAG, "pic_number:%d", pic_num);
+
+    camera_test(max_size, pic_num);
+    esp_camera_deinit();
+}
+
 TEST_CASE("Camera driver rgb565 fps test", "[camera]")
 {
     uint64_t t1 = esp_timer_get_time();
-    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_RGB565, 2));
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_RGB565, 2, CAMERA_DMA_COPY));
     uint64_t t2 = esp_timer_get_time();
     ESP_LOGI(TAG, "Camera init time %llu ms", (t2 - t1) / 1000);
 